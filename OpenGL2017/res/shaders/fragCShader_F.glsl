@@ -7,8 +7,6 @@
 in vec3 tc;
 out vec4 fragColor;
 
-uniform mat4 v_matrix, proj_matrix;
-
 layout(binding = 0) uniform samplerCube samp;
 
 void main(void) {
@@ -0,0 +1,22 @@
+// Pranav Rao
+// Fragment shader for baking impostors
+#sof
+#version 430 core
+
+in vec2 tc;
+in vec3 objectNormal;
+
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 normalOut;
+
+layout(binding = 1) uniform sampler2DArray tex_map;
+
+#include "include/material.glsl"
+
+void main(void) {
+	// Alpha 1 marks the texels the model covers
+	albedo = vec4(texture(tex_map, vec3(tc, texLayer)).rgb * baseColor.rgb, 1.0);
+	normalOut = vec4(normalize(objectNormal) * 0.5 + 0.5, 1.0);
+}
+
+#eof
@@ -0,0 +1,60 @@
+// Pranav Rao
+// Fragment shader for impostors (blends the 4 baked views closest to the viewing direction)
+#sof
+#version 430 core
+
+in vec3 varyingVertPos;
+in vec2 quadUV;
+
+out vec4 fragColor;
+
+#include "include/frame.glsl"
+
+uniform mat4 nrm_matrix;
+uniform float fac;
+uniform vec3 viewDir;
+uniform float gridSize;
+
+layout(binding = 5) uniform samplerCube env_map;
+layout(binding = 3) uniform sampler2D albedo_atlas;
+layout(binding = 4) uniform sampler2D normal_atlas;
+
+// Same octahedral mapping the views were baked with (VertexQuantizer::octEncode)
+#include "include/octahedral.glsl"
+
+void main(void) {
+	// Position of the viewing direction in the grid of views, in cells
+	vec2 grid = (octEncode(viewDir) * 0.5 + 0.5) * gridSize - 0.5;
+	vec2 base = floor(grid);
+	vec2 blend = grid - base;
+
+	// Keep samples half a texel inside each cell so neighbouring views don't bleed in
+	vec2 halfTexel = 0.5 / vec2(textureSize(albedo_atlas, 0));
+	vec2 cellUV = clamp(quadUV / gridSize, halfTexel, 1.0 / gridSize - halfTexel);
+
+	vec4 albedo = vec4(0.0);
+	vec3 normal = vec3(0.0);
+	for (int i = 0; i < 4; i++) {
+		vec2 offset = vec2(i & 1, i >> 1);
+		vec2 cell = clamp(base + offset, vec2(0.0), vec2(gridSize - 1.0));
+		float weight = mix(1.0 - blend.x, blend.x, offset.x) * mix(1.0 - blend.y, blend.y, offset.y);
+
+		vec2 uv = cell / gridSize + cellUV;
+		vec4 viewAlbedo = texture(albedo_atlas, uv);
+		albedo += viewAlbedo * weight;
+		normal += (texture(normal_atlas, uv).xyz * 2.0 - 1.0) * weight * viewAlbedo.a; // Empty texels have no normal
+	}
+
+	// Outside the silhouette
+	if (albedo.a < 0.5) {
+		discard;
+	}
+
+	// Same sky reflection as the full model (fragShader_F.glsl)
+	vec3 N = normalize((nrm_matrix * vec4(normal, 0.0)).xyz);
+	vec3 r = mat3(env_matrix) * reflect(normalize(varyingVertPos), N);
+	vec4 gloss = vec4(textureLod(env_map, r, 0.0).rgb, 1.0);
+	fragColor = mix(gloss, vec4(albedo.rgb / albedo.a, 1.0), fac);
+}
+
+#eof
@@ -0,0 +1,20 @@
+// Pranav Rao
+// Uniforms every program shares for the whole frame (FrameUniforms in SceneUniforms.h)
+
+struct PositionalLight {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	vec3 position;
+	vec3 direction;
+	float cutoff;
+};
+
+layout(std140) uniform FrameBlock {
+	mat4 proj_matrix;
+	mat4 v_matrix;
+	mat4 env_matrix;			// View space to world space directions (upper 3x3), for looking up the sky
+	vec4 globalAmbient;
+	PositionalLight light;		// The flashlight
+	vec4 skyIrradiance[9];		// Irradiance of the sky over pi as spherical harmonics (EnvironmentMap), linear, in xyz
+};
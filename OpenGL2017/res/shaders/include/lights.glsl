@@ -0,0 +1,13 @@
+// Pranav Rao
+// The flashlight and material (uniform blocks), and the light coming from the sky
+
+#include "frame.glsl"
+#include "material.glsl"
+
+// What a white diffuse surface facing world space direction n reflects of the sky
+vec3 skyLight(vec3 n) {
+	return max(skyIrradiance[0].xyz
+		+ skyIrradiance[1].xyz * n.y + skyIrradiance[2].xyz * n.z + skyIrradiance[3].xyz * n.x
+		+ skyIrradiance[4].xyz * (n.x * n.y) + skyIrradiance[5].xyz * (n.y * n.z) + skyIrradiance[6].xyz * (3.0 * n.z * n.z - 1.0)
+		+ skyIrradiance[7].xyz * (n.x * n.z) + skyIrradiance[8].xyz * (n.x * n.x - n.y * n.y), vec3(0.0));
+}
@@ -0,0 +1,16 @@
+// Pranav Rao
+// What the material being drawn looks like (MaterialUniforms in SceneUniforms.h, one per material)
+
+struct Material {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+};
+
+layout(std140) uniform MaterialBlock {
+	Material material;
+	vec4 baseColor;		// Multiplies the diffuse map (the material's color when it has no map)
+	float roughness;	// Picks the level of env_map reflections come from
+	int texLayer;		// Layer of tex_map holding this material's diffuse map
+};
@@ -0,0 +1,49 @@
+// Pranav Rao
+// Normal and color of a surface: its diffuse map mixed with the reflected sky (the prefiltered level matching the
+// material's roughness). The including shader declares
+// tc, varyingVertPos, varyingNormal, varyingTangent and varyingBitangentSign.
+// Permutations (#defines):
+//   NORMAL_MAP       perturb the normal with nrm_map (otherwise the interpolated normal is used as is)
+//   PURE_DIFFUSE     the diffuse map only (fac = 1, the sky is never sampled)
+//   PURE_REFLECTION  the reflected sky only (fac = 0, the diffuse map is never sampled)
+
+#include "frame.glsl"
+#include "material.glsl"
+
+uniform float fac; // Mixes sky reflection (0) and diffuse map (1)
+
+layout(binding = 0) uniform samplerCube sky_map;
+layout(binding = 1) uniform sampler2DArray tex_map;
+layout(binding = 2) uniform sampler2D nrm_map;
+layout(binding = 5) uniform samplerCube env_map;	// The sky prefiltered for roughness 0 (level 0) to 1 (last level)
+
+vec3 calcNewNormal() {
+	vec3 N = normalize(varyingNormal);
+#ifdef NORMAL_MAP
+	// Re-orthogonalize the interpolated tangent and rebuild the bitangent from its sign
+	vec3 T = normalize(varyingTangent - dot(varyingTangent, N) * N);
+	vec3 B = cross(N, T) * varyingBitangentSign;
+	vec3 mapped = texture(nrm_map, tc).xyz * 2.0 - 1.0;
+	N = normalize(mat3(T, B, N) * mapped);
+#endif
+	return N;
+}
+
+vec4 surfaceColor(vec3 N) {
+#ifndef PURE_REFLECTION
+	vec4 diffuse = texture(tex_map, vec3(tc, texLayer)) * baseColor;
+#endif
+#ifndef PURE_DIFFUSE
+	// Reflect sky map so it properly reflects off the airplane, blurred as much as the surface is rough
+	vec3 R = mat3(env_matrix) * reflect(normalize(varyingVertPos), N);
+	vec4 gloss = vec4(textureLod(env_map, R, roughness * float(textureQueryLevels(env_map) - 1)).rgb, 1.0);
+#endif
+
+#if defined(PURE_DIFFUSE)
+	return diffuse;
+#elif defined(PURE_REFLECTION)
+	return gloss;
+#else
+	return mix(gloss, diffuse, fac);
+#endif
+}
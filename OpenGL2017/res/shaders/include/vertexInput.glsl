@@ -0,0 +1,27 @@
+// Pranav Rao
+// Vertex attributes of the imported models and the plane, and their decoding
+
+#include "octahedral.glsl"
+
+// Packed vertices (PackedVertex in Vertex.h) arrive as 16-bit position + bitangent sign in w,
+// and octahedral normal and tangent in xy
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec2 tex_coord;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec4 tangent; // xyz = tangent, w = bitangent sign
+
+// Dequantization of packed vertices: position = posOffset + position.xyz * posScale
+uniform int packedVertices;
+uniform vec3 posScale, posOffset;
+
+// Object-space position, normal and tangent (w = bitangent sign) of this vertex
+void decodeVertex(out vec3 pos, out vec3 nrm, out vec4 tng) {
+	pos = position.xyz;
+	nrm = normal;
+	tng = tangent;
+	if (packedVertices != 0) {
+		pos = posOffset + position.xyz * posScale;
+		nrm = octDecode(normal.xy);
+		tng = vec4(octDecode(tangent.xy), position.w * 2.0 - 1.0);
+	}
+}
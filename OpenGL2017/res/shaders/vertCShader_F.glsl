@@ -9,7 +9,7 @@ layout(location = 0) in vec3 position;
 
 out vec3 tc;
 
-uniform mat4 v_matrix, proj_matrix;
+#include "include/frame.glsl"
 
 layout(binding = 0) uniform samplerCube samp;
 
@@ -0,0 +1,23 @@
+// Pranav Rao
+// Vertex shader for baking impostors (renders a model from one direction into the albedo and normal atlases)
+#sof
+#version 430 core
+
+#include "include/vertexInput.glsl"
+
+out vec2 tc;
+out vec3 objectNormal;
+
+uniform mat4 mv_matrix, proj_matrix;
+
+void main(void) {
+	vec3 pos, nrm;
+	vec4 tng;
+	decodeVertex(pos, nrm, tng);
+
+	tc = tex_coord;
+	objectNormal = nrm; // Stays in object space so the impostor can be lit from any direction
+	gl_Position = proj_matrix * mv_matrix * vec4(pos, 1.0);
+}
+
+#eof
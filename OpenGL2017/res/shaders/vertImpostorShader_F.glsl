@@ -0,0 +1,33 @@
+// Pranav Rao
+// Vertex shader for impostors (one camera-facing quad per far away model, generated from gl_VertexID)
+#sof
+#version 430 core
+
+out vec3 varyingVertPos;
+out vec2 quadUV;
+
+#include "include/frame.glsl"
+
+uniform mat4 mv_matrix;
+
+// Bounding sphere the impostor was baked around, and the direction from its center to the camera (object space)
+uniform vec3 center;
+uniform float radius;
+uniform vec3 viewDir;
+
+void main(void) {
+	// Triangle strip: (-1, -1), (1, -1), (-1, 1), (1, 1)
+	vec2 corner = vec2(float(gl_VertexID & 1) * 2.0 - 1.0, float(gl_VertexID >> 1) * 2.0 - 1.0);
+	quadUV = corner * 0.5 + 0.5;
+
+	// Orient the quad the same way ImpostorBaker oriented each view
+	vec3 upRef = (abs(viewDir.y) > 0.99) ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	vec3 right = normalize(cross(upRef, viewDir));
+	vec3 up = cross(viewDir, right);
+	vec3 pos = center + (corner.x * right + corner.y * up) * radius;
+
+	varyingVertPos = (mv_matrix * vec4(pos, 1.0)).xyz;
+	gl_Position = proj_matrix * mv_matrix * vec4(pos, 1.0);
+}
+
+#eof
@@ -0,0 +1,510 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class streams assets in while the scene is already running. Worker threads parse OBJs and decode
+ *              images; the main thread (the only one with the OpenGL context) uploads whatever has finished, a few
+ *              milliseconds' worth per frame, and hands the results to the callbacks given when loading started.
+ *              Meshes too big to import in one piece are streamed straight into their vertex buffers (MeshStreamer),
+ *              and textures can be uploaded block compressed from their KTX2 copies (TextureCache)
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <SOIL2\soil2.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "EnvironmentMap.h"
+#include "ImportedModel.h"
+#include "MaterialLibrary.h"
+#include "MeshStreamer.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+class AssetLoader {
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// An asset a worker is done with. upload runs on the main thread
+	struct FinishedAsset {
+		std::string name;
+		std::function<void()> upload;
+		Clock::time_point queued;
+		double decodeMilliseconds;
+	};
+
+	// Pixels straight from SOIL (freed with SOIL_free_image_data)
+	struct DecodedImage {
+		int width, height, channels;
+		std::shared_ptr<unsigned char> pixels;
+	};
+
+	// A mesh being streamed into its vertex buffer, pumped every frame
+	struct StreamingMesh {
+		std::unique_ptr<MeshStreamer> streamer;
+		std::function<void(ImportedModel &)> onReady;
+	};
+
+	ThreadPool & pool;
+	std::mutex finishedMutex;
+	std::condition_variable finishedSignal;
+	std::deque<FinishedAsset> finished;
+
+	// Touched by the main thread only
+	std::vector<StreamingMesh> streams;
+	int numPending;
+	Clock::time_point firstQueued;
+	double totalDecodeMilliseconds;
+	double totalUploadMilliseconds;
+	TextureCompression textureCompression;
+	size_t textureBytes;			// Video memory of the 2D textures and texture arrays uploaded so far...
+	size_t uncompressedTextureBytes;	// ...and what the same textures take as RGBA8 without mipmaps
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Called on the main thread whenever a queued or streamed asset is complete
+	void assetReady() {
+		numPending--;
+		if (numPending == 0) {
+			std::cout << "All assets ready " << millisecondsSince(firstQueued) << " ms after the first was queued ("
+				<< totalDecodeMilliseconds << " ms decoding on " << pool.getNumThreads() << " workers, "
+				<< totalUploadMilliseconds << " ms uploading)" << std::endl;
+			std::cout << "Textures use " << textureBytes / (1024.0 * 1024.0) << " MB of video memory as " << TextureCache::getName(textureCompression)
+				<< " (" << uncompressedTextureBytes / (1024.0 * 1024.0) << " MB as RGBA8 without mipmaps)" << std::endl;
+		}
+	}
+
+	// Pump the streamed meshes, handing the finished ones to their callbacks
+	void pumpStreams() {
+		for (size_t i = 0; i < streams.size(); ) {
+			Clock::time_point start = Clock::now();
+			bool done = streams[i].streamer->pump();
+			totalUploadMilliseconds += millisecondsSince(start);
+			if (!done) {
+				i++;
+				continue;
+			}
+
+			if (!streams[i].streamer->hasFailed()) {
+				ImportedModel model = streams[i].streamer->getModel();
+				streams[i].onReady(model);
+			}
+			streams.erase(streams.begin() + i);
+			assetReady();
+		}
+	}
+
+	// Run decode on a worker. It returns the work that has to happen on the main thread
+	void queue(const std::string & name, std::function<std::function<void()>()> decode) {
+		if (numPending == 0)
+			firstQueued = Clock::now();
+		numPending++;
+
+		Clock::time_point queued = Clock::now();
+		pool.submit([this, name, decode, queued]() {
+			Clock::time_point start = Clock::now();
+			FinishedAsset asset;
+			asset.name = name;
+			asset.upload = decode();
+			asset.queued = queued;
+			asset.decodeMilliseconds = millisecondsSince(start);
+
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			finished.push_back(asset);
+			finishedSignal.notify_all();
+		});
+	}
+
+	// The prefiltered sky and its irradiance, from the cache or made from the cube map's decoded faces, on a worker
+	void loadEnvironment(const std::string & dir, const std::vector<DecodedImage> & faces,
+		std::function<void(GLuint, const PrefilteredEnvironment &)> onEnvironment) {
+		ThreadPool * workers = &pool;
+		queue(dir + " (prefiltered)", [dir, faces, onEnvironment, workers]() -> std::function<void()> {
+			std::shared_ptr<PrefilteredEnvironment> environment = EnvironmentMap::open(dir);
+			if (!environment) {
+				const unsigned char * pixels[6];
+				for (int i = 0; i < 6; i++)
+					pixels[i] = faces[i].pixels.get();
+				environment = EnvironmentMap::build(dir, pixels, faces[0].width, faces[0].channels, *workers);
+			}
+
+			return [environment, onEnvironment]() {
+				if (environment)
+					onEnvironment(EnvironmentMap::upload(*environment), *environment);
+			};
+		});
+	}
+
+	// With forceRGBA, every image comes back with 4 channels whatever the file has. Rows are top to bottom, as in the file
+	static DecodedImage decodeImage(const std::string & path, bool forceRGBA = false) {
+		DecodedImage image = { 0, 0, 0, std::shared_ptr<unsigned char>() };
+		unsigned char * pixels = SOIL_load_image(path.c_str(), &image.width, &image.height, &image.channels,
+			forceRGBA ? SOIL_LOAD_RGBA : SOIL_LOAD_AUTO);
+		if (pixels == NULL)
+			return image;
+		if (forceRGBA)
+			image.channels = 4;
+		image.pixels = std::shared_ptr<unsigned char>(pixels, [](unsigned char * p) { SOIL_free_image_data(p); });
+		return image;
+	}
+
+	// Decode an image as RGBA and build its mipmap chain, flipped bottom to top like SOIL_FLAG_INVERT_Y did (OpenGL
+	// expects the bottom row first). NULL if the image couldn't be read
+	static std::shared_ptr<std::vector<MipLevel>> decodeMipmapped(const std::string & path, bool color, ThreadPool & workers) {
+		DecodedImage image = decodeImage(path, true);
+		if (!image.pixels)
+			return std::shared_ptr<std::vector<MipLevel>>();
+		return std::make_shared<std::vector<MipLevel>>(MipGenerator::generate(image.pixels.get(), image.width, image.height, true, color, workers));
+	}
+
+	// Upload every level of a chain from decodeMipmapped into the bound target: a GL_TEXTURE_2D, or layer of a
+	// GL_TEXTURE_2D_ARRAY, whose storage is already allocated
+	static void uploadMipmapped(GLenum target, int layer, const std::vector<MipLevel> & levels) {
+		for (size_t level = 0; level < levels.size(); level++) {
+			const MipLevel & l = levels[level];
+			if (target == GL_TEXTURE_2D_ARRAY)
+				glTexSubImage3D(target, (GLint)level, 0, 0, layer, l.width, l.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, l.pixels.data());
+			else
+				glTexSubImage2D(target, (GLint)level, 0, 0, l.width, l.height, GL_RGBA, GL_UNSIGNED_BYTE, l.pixels.data());
+		}
+	}
+
+	static size_t getBytes(const std::vector<MipLevel> & levels) {
+		size_t bytes = 0;
+		for (size_t level = 0; level < levels.size(); level++)
+			bytes += levels[level].pixels.size();
+		return bytes;
+	}
+
+	// Upload one image into target (GL_TEXTURE_2D or a cube map face) of the bound texture
+	static void uploadImage(GLenum target, const DecodedImage & image) {
+		static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		static const GLenum internalFormats[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+
+		// Rows of RGB images aren't always 4-byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(target, 0, internalFormats[image.channels - 1], image.width, image.height, 0,
+			formats[image.channels - 1], GL_UNSIGNED_BYTE, image.pixels.get());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	// Grey and grey-alpha images read as grey in every color channel, like SOIL's luminance textures did
+	static void setSwizzle(GLenum target, int channels) {
+		if (channels == 1) {
+			GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+			glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		}
+		else if (channels == 2) {
+			GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+			glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		}
+	}
+
+	// The compressed copy of an image from the texture cache, building it if there isn't one. NULL if the image
+	// couldn't be read either
+	static std::shared_ptr<CompressedTexture> loadCompressed(const std::string & path, bool color, TextureCompression compression, ThreadPool & workers) {
+		std::shared_ptr<CompressedTexture> texture = TextureCache::open(path, compression, color);
+		if (texture)
+			return texture;
+
+		std::shared_ptr<std::vector<MipLevel>> levels = decodeMipmapped(path, color, workers);
+		if (!levels)
+			return texture;
+		return TextureCache::build(path, *levels, color, compression, workers);
+	}
+
+	// Upload every level of texture into level 0 and below of the bound target: a GL_TEXTURE_2D, or layer of a
+	// GL_TEXTURE_2D_ARRAY whose storage is already allocated
+	static void uploadCompressed(GLenum target, int layer, const CompressedTexture & texture) {
+		GLenum internalFormat = BlockCompressor::getInternalFormat(texture.format);
+		for (size_t level = 0; level < texture.levels.size(); level++) {
+			const KtxLevel & l = texture.levels[level];
+			if (target == GL_TEXTURE_2D_ARRAY)
+				glCompressedTexSubImage3D(target, (GLint)level, 0, 0, layer, l.width, l.height, 1, internalFormat, (GLsizei)l.size, texture.getLevelData(level));
+			else
+				glCompressedTexSubImage2D(target, (GLint)level, 0, 0, l.width, l.height, internalFormat, (GLsizei)l.size, texture.getLevelData(level));
+		}
+	}
+
+public:
+	explicit AssetLoader(ThreadPool & workers = ThreadPool::shared())
+		: pool(workers), numPending(0), totalDecodeMilliseconds(0.0), totalUploadMilliseconds(0.0),
+		textureCompression(TEXTURE_UNCOMPRESSED), textureBytes(0), uncompressedTextureBytes(0) {
+	}
+
+	// The workers hold a pointer to this loader, so wait for them. Assets that were never uploaded are dropped
+	// (the GL context may already be gone), and unfinished streams are cancelled
+	~AssetLoader() {
+		std::unique_lock<std::mutex> lock(finishedMutex);
+		finishedSignal.wait(lock, [this] { return (int)finished.size() >= numPending - (int)streams.size(); });
+	}
+
+	// Import an OBJ (or its mesh cache) on a worker. onReady gets the model on the main thread, CPU data still in place
+	void loadMesh(const char * filePath, std::function<void(ImportedModel &)> onReady) {
+		std::string path = filePath;
+		queue(path, [path, onReady]() -> std::function<void()> {
+			std::shared_ptr<ImportedModel> model = std::make_shared<ImportedModel>(path.c_str());
+			return [model, onReady]() { onReady(*model); };
+		});
+	}
+
+	// Stream an OBJ into vertexBuffer as PackedVertex (packed) or Vertex records, a few megabytes at a time, without
+	// importing it whole. onReady gets an unindexed model without CPU data on the main thread once every vertex has been
+	// copied. Nothing is reported if the file can't be read
+	void streamMesh(const char * filePath, GLuint vertexBuffer, bool packed, std::function<void(ImportedModel &)> onReady) {
+		if (numPending == 0)
+			firstQueued = Clock::now();
+		numPending++;
+
+		StreamingMesh mesh;
+		mesh.streamer.reset(new MeshStreamer(filePath, vertexBuffer, packed));
+		mesh.onReady = onReady;
+		mesh.streamer->start(pool);
+		streams.push_back(std::move(mesh));
+	}
+
+	// How loadTexture and loadTextureArrays store textures from now on. TextureCache::bestSupported() picks the
+	// smallest the driver can sample
+	void setTextureCompression(TextureCompression compression) {
+		textureCompression = compression;
+		std::cout << "Textures are " << TextureCache::getName(compression) << std::endl;
+	}
+
+	// Decode an image on a worker and upload it as a GL_TEXTURE_2D with all its mipmaps, flipped (like SOIL_FLAG_INVERT_Y),
+	// trilinear, clamped. Compressed textures come from the texture cache. color is false for images that hold data,
+	// like normal maps, whose mipmaps are averaged without gamma. onReady gets 0 if the image couldn't be read
+	void loadTexture(const char * texImagePath, std::function<void(GLuint)> onReady, bool color = true) {
+		std::string path = texImagePath;
+		TextureCompression compression = textureCompression;
+		ThreadPool * workers = &pool;
+		queue(path, [this, path, onReady, color, compression, workers]() -> std::function<void()> {
+			std::shared_ptr<CompressedTexture> compressed;
+			std::shared_ptr<std::vector<MipLevel>> levels;
+			if (compression != TEXTURE_UNCOMPRESSED)
+				compressed = loadCompressed(path, color, compression, *workers);
+			else
+				levels = decodeMipmapped(path, color, *workers);
+
+			return [this, path, compressed, levels, onReady]() {
+				if (!compressed && !levels) {
+					std::cout << "Could not find Texture File " << path << std::endl;
+					onReady(0);
+					return;
+				}
+
+				GLuint texture;
+				glGenTextures(1, &texture);
+				glBindTexture(GL_TEXTURE_2D, texture);
+				if (compressed) {
+					glTexStorage2D(GL_TEXTURE_2D, (GLsizei)compressed->levels.size(), BlockCompressor::getInternalFormat(compressed->format),
+						compressed->width, compressed->height);
+					uploadCompressed(GL_TEXTURE_2D, 0, *compressed);
+					textureBytes += compressed->getBytes();
+				}
+				else {
+					glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels->size(), GL_RGBA8, (*levels)[0].width, (*levels)[0].height);
+					uploadMipmapped(GL_TEXTURE_2D, 0, *levels);
+					textureBytes += getBytes(*levels);
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				int width = compressed ? compressed->width : (*levels)[0].width;
+				int height = compressed ? compressed->height : (*levels)[0].height;
+				uncompressedTextureBytes += (size_t)width * height * 4;
+				onReady(texture);
+			};
+		});
+	}
+
+	// Decode several images in parallel on a worker, then upload all the ones with the same size and format into the
+	// layers of one GL_TEXTURE_2D_ARRAY with all their mipmaps (flipped, trilinear, clamped). Uncompressed arrays are
+	// RGBA; compressed ones come from the texture cache. onReady gets where each path ended up, in the same order;
+	// images that couldn't be read get array 0
+	void loadTextureArrays(const std::vector<std::string> & paths, std::function<void(std::vector<TextureLayer>)> onReady) {
+		ThreadPool * workers = &pool;
+		TextureCompression compression = textureCompression;
+		queue(paths.size() == 1 ? paths[0] : std::to_string(paths.size()) + " textures", [this, paths, onReady, workers, compression]() -> std::function<void()> {
+			// Every layer of an array has the same format, so grey and RGB images are expanded to RGBA here
+			std::vector<std::shared_ptr<std::vector<MipLevel>>> images(paths.size());
+			std::vector<std::shared_ptr<CompressedTexture>> compressed(paths.size());
+			workers->parallelFor(paths.size(), [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					if (compression != TEXTURE_UNCOMPRESSED)
+						compressed[i] = loadCompressed(paths[i], true, compression, *workers);
+					else
+						images[i] = decodeMipmapped(paths[i], true, *workers);
+				}
+			});
+
+			return [this, paths, images, compressed, onReady]() {
+				// One array per size and format
+				typedef std::pair<std::pair<int, int>, GLenum> ArrayKey;
+				std::map<ArrayKey, std::vector<size_t>> bySize;
+				std::vector<TextureLayer> layers(paths.size());
+				for (size_t i = 0; i < paths.size(); i++) {
+					layers[i].array = 0;
+					layers[i].layer = 0;
+					if (compressed[i]) {
+						ArrayKey key(std::make_pair(compressed[i]->width, compressed[i]->height), BlockCompressor::getInternalFormat(compressed[i]->format));
+						bySize[key].push_back(i);
+					}
+					else if (images[i]) {
+						bySize[ArrayKey(std::make_pair((*images[i])[0].width, (*images[i])[0].height), GL_RGBA8)].push_back(i);
+					}
+					else {
+						std::cout << "Could not find Texture File " << paths[i] << std::endl;
+					}
+				}
+
+				for (std::map<ArrayKey, std::vector<size_t>>::iterator group = bySize.begin(); group != bySize.end(); ++group) {
+					int width = group->first.first.first;
+					int height = group->first.first.second;
+					GLenum internalFormat = group->first.second;
+					const std::vector<size_t> & members = group->second;
+					const std::shared_ptr<CompressedTexture> & first = compressed[members[0]];
+					GLsizei numLevels = first ? (GLsizei)first->levels.size() : (GLsizei)images[members[0]]->size();
+
+					GLuint texture;
+					glGenTextures(1, &texture);
+					glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+					glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, internalFormat, width, height, (GLsizei)members.size());
+					for (size_t layer = 0; layer < members.size(); layer++) {
+						size_t i = members[layer];
+						if (compressed[i]) {
+							uploadCompressed(GL_TEXTURE_2D_ARRAY, (int)layer, *compressed[i]);
+							textureBytes += compressed[i]->getBytes();
+						}
+						else {
+							uploadMipmapped(GL_TEXTURE_2D_ARRAY, (int)layer, *images[i]);
+							textureBytes += getBytes(*images[i]);
+						}
+						uncompressedTextureBytes += (size_t)width * height * 4;
+						layers[i].array = texture;
+						layers[i].layer = (int)layer;
+					}
+					glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+					glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+					std::cout << "Texture array " << width << "x" << height << " " << (first ? BlockCompressor::getName(first->format) : "RGBA8")
+						<< " with " << numLevels << " levels and " << members.size() << " layers:";
+					for (size_t layer = 0; layer < members.size(); layer++)
+						std::cout << " " << paths[members[layer]];
+					std::cout << std::endl;
+				}
+				onReady(layers);
+			};
+		});
+	}
+
+	// Decode the six faces of a cube map (xp, xn, yp, yn, zp, zn .jpg in mapDir) in parallel, then upload them with
+	// mipmaps and clamped edges, like loadCubeMap() in Utils_PR.h. onReady gets 0 if a face couldn't be read. With
+	// onEnvironment, the sky is also prefiltered for reflections and lighting (EnvironmentMap) in a job of its own, queued
+	// once the faces are up, so the sky is drawn while that runs. onEnvironment gets the result after onReady
+	void loadCubeMap(const char * mapDir, std::function<void(GLuint)> onReady,
+		std::function<void(GLuint, const PrefilteredEnvironment &)> onEnvironment = std::function<void(GLuint, const PrefilteredEnvironment &)>()) {
+		std::string dir = mapDir;
+		ThreadPool * workers = &pool;
+		queue(dir, [this, dir, onReady, onEnvironment, workers]() -> std::function<void()> {
+			std::vector<DecodedImage> faces(6);
+			workers->parallelFor(6, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					faces[i] = decodeImage(EnvironmentMap::facePath(dir, (int)i));
+			});
+
+			return [this, dir, faces, onReady, onEnvironment]() {
+				for (int i = 0; i < 6; i++) {
+					if (!faces[i].pixels) {
+						std::cout << "error: Could not find Cube Map image file" << std::endl;
+						onReady(0);
+						return;
+					}
+				}
+
+				GLuint texture;
+				glGenTextures(1, &texture);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+				for (int i = 0; i < 6; i++)
+					uploadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i]);
+				setSwizzle(GL_TEXTURE_CUBE_MAP, faces[0].channels);
+				glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+				// Reduce the seams
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+				onReady(texture);
+
+				bool complete = true;
+				for (int i = 0; i < 6; i++)
+					complete = complete && faces[i].width == faces[i].height && faces[i].width == faces[0].width
+						&& faces[i].channels == faces[0].channels;
+				if (onEnvironment && complete)
+					loadEnvironment(dir, faces, onEnvironment);
+			};
+		});
+	}
+
+	// Upload finished assets on the calling (GL) thread until budgetMilliseconds have passed. At least one asset is
+	// uploaded per call so loading always moves forward, and streamed meshes are always pumped. Returns how many
+	// queued assets were uploaded
+	int uploadFinished(double budgetMilliseconds) {
+		Clock::time_point start = Clock::now();
+		int uploaded = 0;
+		pumpStreams();
+
+		while (numPending > 0) {
+			FinishedAsset asset;
+			{
+				std::lock_guard<std::mutex> lock(finishedMutex);
+				if (finished.empty())
+					break;
+				asset = finished.front();
+				finished.pop_front();
+			}
+
+			Clock::time_point uploadStart = Clock::now();
+			asset.upload();
+			double uploadMilliseconds = millisecondsSince(uploadStart);
+
+			totalDecodeMilliseconds += asset.decodeMilliseconds;
+			totalUploadMilliseconds += uploadMilliseconds;
+			uploaded++;
+
+			std::cout << "Streamed " << asset.name << ": decoded in " << asset.decodeMilliseconds << " ms, uploaded in "
+				<< uploadMilliseconds << " ms, ready " << millisecondsSince(asset.queued) << " ms after it was queued" << std::endl;
+			assetReady();
+
+			if (millisecondsSince(start) >= budgetMilliseconds)
+				break;
+		}
+		return uploaded;
+	}
+
+	// Number of assets queued but not uploaded yet
+	int getNumPending() {
+		return numPending;
+	}
+
+	bool isDone() {
+		return numPending == 0;
+	}
+
+};
@@ -0,0 +1,425 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class encodes RGBA8 images into the block compressed formats GPUs sample directly: BC1 (opaque,
+ *              4 bits per pixel), BC3 (with alpha, 8 bits per pixel) and BC7 (8 bits per pixel, best quality). It runs on
+ *              the CPU, so textures can be compressed without a GPU. Each 4x4 block gets endpoints along the principal axis
+ *              of its colors, refined once by least squares. BC7 uses mode 6 only (one subset, RGBA endpoints, 16 levels)
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "ThreadPool.h"
+
+// From GL_EXT_texture_compression_s3tc, for GLEW builds without it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum BlockFormat { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+
+class BlockCompressor {
+
+private:
+	// 16 pixels of one block, RGBA as floats (0-255)
+	struct Block {
+		float pixels[16][4];
+	};
+
+	static const int BC7_WEIGHTS[16];
+
+	static int clampInt(int value, int low, int high) {
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	// Copy the 4x4 block at (bx, by), repeating the last row/column past the edges of the image
+	static void readBlock(const unsigned char * rgba, int width, int height, int bx, int by, Block & block) {
+		for (int y = 0; y < 4; y++) {
+			int sy = std::min(by * 4 + y, height - 1);
+			for (int x = 0; x < 4; x++) {
+				int sx = std::min(bx * 4 + x, width - 1);
+				const unsigned char * p = rgba + ((size_t)sy * width + sx) * 4;
+				for (int c = 0; c < 4; c++)
+					block.pixels[y * 4 + x][c] = p[c];
+			}
+		}
+	}
+
+	// Mean and principal axis of the first channels channels of the block (power iteration on the covariance)
+	static void principalAxis(const Block & block, int channels, float mean[4], float axis[4]) {
+		for (int c = 0; c < 4; c++) {
+			mean[c] = 0.0f;
+			axis[c] = 0.0f;
+		}
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < channels; c++)
+				mean[c] += block.pixels[i][c] / 16.0f;
+
+		float covariance[4][4] = { { 0.0f } };
+		for (int i = 0; i < 16; i++) {
+			float d[4];
+			for (int c = 0; c < channels; c++)
+				d[c] = block.pixels[i][c] - mean[c];
+			for (int a = 0; a < channels; a++)
+				for (int b = 0; b < channels; b++)
+					covariance[a][b] += d[a] * d[b];
+		}
+
+		for (int c = 0; c < channels; c++)
+			axis[c] = 1.0f;
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float length = 0.0f;
+			for (int a = 0; a < channels; a++) {
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+			if (length < 1e-12f)
+				break;
+			length = std::sqrt(length);
+			for (int c = 0; c < channels; c++)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	// The block's extremes along its principal axis
+	static void fitEndpoints(const Block & block, int channels, float low[4], float high[4]) {
+		float mean[4], axis[4];
+		principalAxis(block, channels, mean, axis);
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (block.pixels[i][c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		for (int c = 0; c < 4; c++) {
+			low[c] = mean[c] + axis[c] * minT;
+			high[c] = mean[c] + axis[c] * maxT;
+		}
+	}
+
+	// Endpoints that best reproduce the block for the given palette positions (weights[i] in [0, 1] towards high)
+	static bool leastSquares(const Block & block, int channels, const float weights[16], float low[4], float high[4]) {
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			float b = weights[i], a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; c++) {
+				ax[c] += a * block.pixels[i][c];
+				bx[c] += b * block.pixels[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int c = 0; c < channels; c++) {
+			low[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+			high[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+		}
+		return true;
+	}
+
+	/*****************************************************   BC1   ****************************************************/
+
+	static uint16_t to565(const float color[4]) {
+		int r = clampInt((int)(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+		int g = clampInt((int)(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+		int b = clampInt((int)(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	static void from565(uint16_t packed, int color[3]) {
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// Indices of the nearest 4-color palette entries for endpoints c0, c1 (c0 > c1). Returns the squared error
+	static float bc1Indices(const Block & block, uint16_t c0, uint16_t c1, uint32_t & indices) {
+		int e0[3], e1[3];
+		from565(c0, e0);
+		from565(c1, e1);
+		int palette[4][3];
+		for (int c = 0; c < 3; c++) {
+			palette[0][c] = e0[c];
+			palette[1][c] = e1[c];
+			palette[2][c] = (2 * e0[c] + e1[c]) / 3;
+			palette[3][c] = (e0[c] + 2 * e1[c]) / 3;
+		}
+
+		float total = 0.0f;
+		indices = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestError = 1e30f;
+			for (int p = 0; p < 4; p++) {
+				float error = 0.0f;
+				for (int c = 0; c < 3; c++) {
+					float d = block.pixels[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (2 * i);
+			total += bestError;
+		}
+		return total;
+	}
+
+	// The 8 bytes of a 4-color BC1 block for low/high endpoints. Returns the squared error
+	static float bc1Quantize(const Block & block, const float low[4], const float high[4], unsigned char * out) {
+		uint16_t c0 = to565(high), c1 = to565(low);
+		uint32_t indices = 0;
+		float error;
+		if (c0 == c1) {
+			// One color: every pixel is c0 (index 0); the order of c0 and c1 doesn't matter in BC3's color block
+			error = bc1Indices(block, c0, c1, indices);
+			indices = 0;
+		}
+		else {
+			if (c0 < c1)
+				std::swap(c0, c1);
+			error = bc1Indices(block, c0, c1, indices);
+		}
+		out[0] = (unsigned char)(c0 & 0xFF);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xFF);
+		out[3] = (unsigned char)(c1 >> 8);
+		memcpy(out + 4, &indices, 4);
+		return error;
+	}
+
+	static void encodeBC1(const Block & block, unsigned char * out) {
+		float low[4], high[4];
+		fitEndpoints(block, 3, low, high);
+		float error = bc1Quantize(block, low, high, out);
+
+		// Refit the endpoints to the palette positions the pixels chose, and keep the result if it is better
+		static const float positions[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		uint16_t c0 = (uint16_t)(out[0] | (out[1] << 8)), c1 = (uint16_t)(out[2] | (out[3] << 8));
+		if (c0 == c1)
+			return;
+		uint32_t indices;
+		memcpy(&indices, out + 4, 4);
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+			weights[i] = 1.0f - positions[(indices >> (2 * i)) & 3]; // Index 0 is c0, the high endpoint
+		if (!leastSquares(block, 3, weights, low, high))
+			return;
+
+		unsigned char refined[8];
+		if (bc1Quantize(block, low, high, refined) < error)
+			memcpy(out, refined, 8);
+	}
+
+	/*****************************************************   BC3   ****************************************************/
+
+	// The 8 bytes of a BC3 (BC4) alpha block: two endpoints and 3-bit indices into 8 levels between them
+	static void encodeAlpha(const Block & block, unsigned char * out) {
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++) {
+			a0 = std::max(a0, (int)block.pixels[i][3]);
+			a1 = std::min(a1, (int)block.pixels[i][3]);
+		}
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+
+		// a0 > a1 selects the 8-level palette: a0, a1, then 6 steps between them
+		int palette[8] = { a0, a1 };
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+		uint64_t indices = 0;
+		if (a0 != a1) {
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestError = 1 << 30;
+				for (int p = 0; p < 8; p++) {
+					int error = std::abs((int)block.pixels[i][3] - palette[p]);
+					if (error < bestError) {
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (unsigned char)(indices >> (8 * i));
+	}
+
+	/*****************************************************   BC7   ****************************************************/
+
+	// Quantize an endpoint to 7 bits per channel plus a shared p-bit (the p-bit that reproduces it best)
+	static void bc7Endpoint(const float color[4], int quantized[4], int & pBit) {
+		float bestError = 1e30f;
+		for (int p = 0; p < 2; p++) {
+			int q[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++) {
+				q[c] = clampInt((int)((color[c] - p) / 2.0f + 0.5f), 0, 127);
+				float d = color[c] - (float)((q[c] << 1) | p);
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				pBit = p;
+				memcpy(quantized, q, sizeof(q));
+			}
+		}
+	}
+
+	// Mode 6 block for low/high endpoints: indices chosen per pixel, written into out. Returns the squared error
+	static float bc7Quantize(const Block & block, const float low[4], const float high[4], unsigned char * out, int indices[16]) {
+		int q0[4], q1[4], p0, p1;
+		bc7Endpoint(low, q0, p0);
+		bc7Endpoint(high, q1, p1);
+
+		int e0[4], e1[4], palette[16][4];
+		for (int c = 0; c < 4; c++) {
+			e0[c] = (q0[c] << 1) | p0;
+			e1[c] = (q1[c] << 1) | p1;
+		}
+		for (int p = 0; p < 16; p++)
+			for (int c = 0; c < 4; c++)
+				palette[p][c] = ((64 - BC7_WEIGHTS[p]) * e0[c] + BC7_WEIGHTS[p] * e1[c] + 32) >> 6;
+
+		float total = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestError = 1e30f;
+			for (int p = 0; p < 16; p++) {
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++) {
+					float d = block.pixels[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices[i] = best;
+			total += bestError;
+		}
+
+		// The first pixel's index is stored without its top bit, so it has to be below 8: swap the endpoints if it isn't
+		if (indices[0] >= 8) {
+			std::swap(q0, q1);
+			std::swap(p0, p1);
+			for (int i = 0; i < 16; i++)
+				indices[i] = 15 - indices[i];
+		}
+
+		// Mode 6, least significant bit first: 0000001, R0 R1 G0 G1 B0 B1 A0 A1 (7 bits each), P0 P1, indices (3 + 15 * 4 bits)
+		uint64_t bits[2] = { 0, 0 };
+		int position = 0;
+		auto put = [&](uint64_t value, int count) {
+			for (int b = 0; b < count; b++, position++)
+				bits[position >> 6] |= ((value >> b) & 1) << (position & 63);
+		};
+		put(1 << 6, 7);
+		for (int c = 0; c < 4; c++) {
+			put((uint64_t)q0[c], 7);
+			put((uint64_t)q1[c], 7);
+		}
+		put((uint64_t)p0, 1);
+		put((uint64_t)p1, 1);
+		put((uint64_t)indices[0], 3);
+		for (int i = 1; i < 16; i++)
+			put((uint64_t)indices[i], 4);
+		memcpy(out, bits, 16);
+		return total;
+	}
+
+	static void encodeBC7(const Block & block, unsigned char * out) {
+		float low[4], high[4];
+		fitEndpoints(block, 4, low, high);
+		int indices[16];
+		float error = bc7Quantize(block, low, high, out, indices);
+		if (error == 0.0f)
+			return;
+
+		// Refit to the chosen palette positions (bc7Quantize may have swapped the endpoints, so read them back from the indices)
+		float weights[16];
+		unsigned char refined[16];
+		int refinedIndices[16];
+		for (int i = 0; i < 16; i++)
+			weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+		if (!leastSquares(block, 4, weights, low, high))
+			return;
+		if (bc7Quantize(block, low, high, refined, refinedIndices) < error)
+			memcpy(out, refined, 16);
+	}
+
+public:
+	static int getBlockBytes(BlockFormat format) {
+		return (format == BLOCK_BC1) ? 8 : 16;
+	}
+
+	// Bytes of one compressed image (blocks at the edges are whole even if the image doesn't fill them)
+	static size_t getImageBytes(BlockFormat format, int width, int height) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+	}
+
+	static GLenum getInternalFormat(BlockFormat format) {
+		if (format == BLOCK_BC1)
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		if (format == BLOCK_BC3)
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+
+	static const char * getName(BlockFormat format) {
+		static const char * names[3] = { "BC1", "BC3", "BC7" };
+		return names[format];
+	}
+
+	// Compress a width x height RGBA8 image into out (getImageBytes(format, width, height) bytes), rows of blocks split
+	// across the pool
+	static void compress(const unsigned char * rgba, int width, int height, BlockFormat format, unsigned char * out,
+		ThreadPool & pool = ThreadPool::shared()) {
+		int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		int blockBytes = getBlockBytes(format);
+		pool.parallelFor((size_t)blocksY, [&](size_t begin, size_t end) {
+			Block block;
+			for (size_t by = begin; by < end; by++) {
+				for (int bx = 0; bx < blocksX; bx++) {
+					readBlock(rgba, width, height, bx, (int)by, block);
+					unsigned char * blockOut = out + (by * blocksX + bx) * blockBytes;
+					if (format == BLOCK_BC1) {
+						encodeBC1(block, blockOut);
+					}
+					else if (format == BLOCK_BC3) {
+						encodeAlpha(block, blockOut);
+						encodeBC1(block, blockOut + 8);
+					}
+					else {
+						encodeBC7(block, blockOut);
+					}
+				}
+			}
+		});
+	}
+
+};
+
+// Interpolation weights (out of 64) of BC7's 4-bit indices
+const int BlockCompressor::BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
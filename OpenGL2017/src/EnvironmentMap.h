@@ -0,0 +1,549 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class turns the skybox into the two things surfaces need to be lit by it: a small cube map whose
+ *              mipmaps are the sky blurred for rougher and rougher surfaces (GGX, importance sampled), and the sky's
+ *              irradiance as 9 spherical harmonics coefficients, which replace a flat ambient color. Both are computed
+ *              on the CPU across the thread pool and kept next to the faces (<cube map>/environment.envcache), rebuilt
+ *              when a face changes like the mesh cache
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <SOIL2\soil2.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FileInfo.h"
+#include "ThreadPool.h"
+
+// The prefiltered sky and its irradiance
+struct PrefilteredEnvironment {
+	int size;					// Faces of level 0 are size x size
+	int numLevels;				// Level i is for roughness i / (numLevels - 1)
+	std::vector<float> texels;	// RGB, sRGB encoded like the sky's images: level 0's faces (+X, -X, +Y, -Y, +Z, -Z), then level 1's...
+	float irradiance[9][3];		// Spherical harmonics of the irradiance over pi (linear), ready to be summed
+
+	int getLevelSize(int level) const {
+		return std::max(1, size >> level);
+	}
+
+	// Index of the first float of face (0-5) of level in texels
+	size_t getFaceOffset(int level, int face) const {
+		size_t offset = 0;
+		for (int i = 0; i < level; i++)
+			offset += (size_t)6 * getLevelSize(i) * getLevelSize(i) * 3;
+		return offset + (size_t)face * getLevelSize(level) * getLevelSize(level) * 3;
+	}
+
+	const float * getFace(int level, int face) const {
+		return texels.data() + getFaceOffset(level, face);
+	}
+};
+
+// Fixed-size header at the start of the cache file. The texels follow it
+struct EnvironmentCacheHeader {
+	char magic[4];				// "OGLE"
+	uint32_t version;
+	uint64_t sourceSize[6];		// Size, modification time and FNV-1a hash of each face the cache was built from
+	int64_t sourceModified[6];
+	uint64_t sourceHash[6];
+	uint32_t size;
+	uint32_t numLevels;
+	float irradiance[9][3];
+	uint32_t reserved;
+	uint64_t fileSize;
+};
+
+class EnvironmentMap {
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Size of level 0 and the number of levels (the last is 8x8, for fully rough surfaces)
+	static const int SIZE = 256;
+	static const int NUM_LEVELS = 6;
+
+	// GGX samples per texel. Each reads a mipmap of the sky chosen by how much of it the sample stands for, so few are enough
+	static const int NUM_SAMPLES = 64;
+
+	// A cube of linear RGB faces
+	struct Cube {
+		int size;
+		std::vector<float> faces[6];
+	};
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	static float toLinear(float c) {
+		return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	static float toSrgb(float l) {
+		l = std::min(std::max(l, 0.0f), 1.0f);
+		return (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Direction through (s, t) in [-1, 1] of a face, as OpenGL's cube map lookups define it (the first row is t = -1)
+	static void faceDirection(int face, float s, float t, float direction[3]) {
+		float x, y, z;
+		switch (face) {
+		case 0: x = 1.0f; y = -t; z = -s; break;
+		case 1: x = -1.0f; y = -t; z = s; break;
+		case 2: x = s; y = 1.0f; z = t; break;
+		case 3: x = s; y = -1.0f; z = -t; break;
+		case 4: x = s; y = -t; z = 1.0f; break;
+		default: x = -s; y = -t; z = -1.0f; break;
+		}
+		float length = std::sqrt(x * x + y * y + z * z);
+		direction[0] = x / length;
+		direction[1] = y / length;
+		direction[2] = z / length;
+	}
+
+	// The face a direction points into and where, the reverse of faceDirection
+	static int faceCoordinates(const float direction[3], float & s, float & t) {
+		float ax = std::fabs(direction[0]), ay = std::fabs(direction[1]), az = std::fabs(direction[2]);
+		if (ax >= ay && ax >= az) {
+			s = (direction[0] > 0.0f ? -direction[2] : direction[2]) / ax;
+			t = -direction[1] / ax;
+			return direction[0] > 0.0f ? 0 : 1;
+		}
+		if (ay >= az) {
+			s = direction[0] / ay;
+			t = (direction[1] > 0.0f ? direction[2] : -direction[2]) / ay;
+			return direction[1] > 0.0f ? 2 : 3;
+		}
+		s = (direction[2] > 0.0f ? direction[0] : -direction[0]) / az;
+		t = -direction[1] / az;
+		return direction[2] > 0.0f ? 4 : 5;
+	}
+
+	// Solid angle of texel (x, y) of a size x size face
+	static float texelSolidAngle(int x, int y, int size) {
+		float s0 = 2.0f * x / size - 1.0f, s1 = 2.0f * (x + 1) / size - 1.0f;
+		float t0 = 2.0f * y / size - 1.0f, t1 = 2.0f * (y + 1) / size - 1.0f;
+		auto area = [](float a, float b) { return std::atan2(a * b, std::sqrt(a * a + b * b + 1.0f)); };
+		return area(s0, t0) - area(s0, t1) - area(s1, t0) + area(s1, t1);
+	}
+
+	// Bilinear sample of one level in a direction (edges clamped within each face)
+	static void sampleCube(const Cube & cube, const float direction[3], float color[3]) {
+		float s, t;
+		int face = faceCoordinates(direction, s, t);
+		float x = std::min(std::max((s + 1.0f) * 0.5f * cube.size - 0.5f, 0.0f), (float)(cube.size - 1));
+		float y = std::min(std::max((t + 1.0f) * 0.5f * cube.size - 0.5f, 0.0f), (float)(cube.size - 1));
+		int x0 = (int)x, y0 = (int)y;
+		int x1 = std::min(x0 + 1, cube.size - 1), y1 = std::min(y0 + 1, cube.size - 1);
+		float fx = x - x0, fy = y - y0;
+		const float * pixels = cube.faces[face].data();
+		for (int c = 0; c < 3; c++) {
+			float top = pixels[(y0 * cube.size + x0) * 3 + c] * (1.0f - fx) + pixels[(y0 * cube.size + x1) * 3 + c] * fx;
+			float bottom = pixels[(y1 * cube.size + x0) * 3 + c] * (1.0f - fx) + pixels[(y1 * cube.size + x1) * 3 + c] * fx;
+			color[c] = top * (1.0f - fy) + bottom * fy;
+		}
+	}
+
+	// Trilinear sample of the sky's mipmaps
+	static void sampleChain(const std::vector<Cube> & chain, const float direction[3], float lod, float color[3]) {
+		lod = std::min(std::max(lod, 0.0f), (float)(chain.size() - 1));
+		int level = std::min((int)lod, (int)chain.size() - 2);
+		if (level < 0) {
+			sampleCube(chain[0], direction, color);
+			return;
+		}
+		float f = lod - level, a[3], b[3];
+		sampleCube(chain[level], direction, a);
+		sampleCube(chain[level + 1], direction, b);
+		for (int c = 0; c < 3; c++)
+			color[c] = a[c] * (1.0f - f) + b[c] * f;
+	}
+
+	// Average the decoded faces (8-bit, top row first) down to a size x size linear cube
+	static Cube toLinearCube(const unsigned char * const faces[6], int faceSize, int channels, int size, ThreadPool & pool) {
+		float table[256];
+		for (int i = 0; i < 256; i++)
+			table[i] = toLinear(i / 255.0f);
+
+		Cube cube;
+		cube.size = size;
+		for (int face = 0; face < 6; face++)
+			cube.faces[face].resize((size_t)size * size * 3);
+		pool.parallelFor((size_t)6 * size, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++) {
+				int face = (int)(row / size), y = (int)(row % size);
+				int sy0 = y * faceSize / size, sy1 = std::max(sy0 + 1, (y + 1) * faceSize / size);
+				for (int x = 0; x < size; x++) {
+					int sx0 = x * faceSize / size, sx1 = std::max(sx0 + 1, (x + 1) * faceSize / size);
+					float sum[3] = { 0.0f, 0.0f, 0.0f };
+					for (int sy = sy0; sy < sy1; sy++) {
+						const unsigned char * p = faces[face] + ((size_t)sy * faceSize + sx0) * channels;
+						for (int sx = sx0; sx < sx1; sx++, p += channels) {
+							for (int c = 0; c < 3; c++)
+								sum[c] += table[p[channels >= 3 ? c : 0]];
+						}
+					}
+					float weight = 1.0f / ((sy1 - sy0) * (sx1 - sx0));
+					for (int c = 0; c < 3; c++)
+						cube.faces[face][((size_t)y * size + x) * 3 + c] = sum[c] * weight;
+				}
+			}
+		});
+		return cube;
+	}
+
+	// The cube and its mipmaps down to 1x1 (2x2 box)
+	static std::vector<Cube> buildChain(const Cube & base) {
+		std::vector<Cube> chain(1, base);
+		while (chain.back().size > 1) {
+			const Cube & source = chain.back();
+			Cube next;
+			next.size = source.size / 2;
+			for (int face = 0; face < 6; face++) {
+				next.faces[face].resize((size_t)next.size * next.size * 3);
+				const float * p = source.faces[face].data();
+				for (int y = 0; y < next.size; y++)
+					for (int x = 0; x < next.size; x++)
+						for (int c = 0; c < 3; c++) {
+							float sum = p[((2 * y) * source.size + 2 * x) * 3 + c] + p[((2 * y) * source.size + 2 * x + 1) * 3 + c]
+								+ p[((2 * y + 1) * source.size + 2 * x) * 3 + c] + p[((2 * y + 1) * source.size + 2 * x + 1) * 3 + c];
+							next.faces[face][((size_t)y * next.size + x) * 3 + c] = sum * 0.25f;
+						}
+			}
+			chain.push_back(next);
+		}
+		return chain;
+	}
+
+	// One GGX sample around the +Z axis: the light direction that reflects into +Z, its weight and the sky mipmap to read
+	struct Sample {
+		float direction[3];
+		float weight;
+		float lod;
+	};
+
+	// Samples for roughness (Hammersley points, N = V = R as usual for prefiltered maps)
+	static std::vector<Sample> ggxSamples(float roughness, int skySize) {
+		float alpha = roughness * roughness;
+		float texelSolidAngle = 4.0f * 3.14159265f / (6.0f * skySize * skySize);
+		std::vector<Sample> samples;
+
+		// A mirror only sees the direction itself
+		if (roughness == 0.0f) {
+			Sample sample = { { 0.0f, 0.0f, 1.0f }, 1.0f, 0.0f };
+			samples.push_back(sample);
+			return samples;
+		}
+
+		for (uint32_t i = 0; i < (uint32_t)NUM_SAMPLES; i++) {
+			uint32_t bits = i;
+			bits = (bits << 16) | (bits >> 16);
+			bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+			bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+			bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+			bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+			float u = (float)i / NUM_SAMPLES, v = bits * 2.3283064365386963e-10f;
+
+			float phi = 2.0f * 3.14159265f * u;
+			float cosTheta = std::sqrt((1.0f - v) / (1.0f + (alpha * alpha - 1.0f) * v));
+			float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+			float h[3] = { sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+
+			// L = reflect(-V, H) with V = +Z
+			Sample sample;
+			sample.direction[0] = 2.0f * cosTheta * h[0];
+			sample.direction[1] = 2.0f * cosTheta * h[1];
+			sample.direction[2] = 2.0f * cosTheta * h[2] - 1.0f;
+			sample.weight = sample.direction[2];
+			if (sample.weight <= 0.0f)
+				continue;
+
+			// Read the mipmap whose texels cover about as much of the sky as this sample stands for
+			float d = (cosTheta * cosTheta) * (alpha * alpha - 1.0f) + 1.0f;
+			float pdf = alpha * alpha / (3.14159265f * d * d) / 4.0f;
+			float sampleSolidAngle = 1.0f / (NUM_SAMPLES * pdf + 1e-6f);
+			sample.lod = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	// Level level of the prefiltered map from the sky's mipmaps, written sRGB encoded into out
+	static void prefilterLevel(const std::vector<Cube> & chain, int level, int levelSize, float * out, ThreadPool & pool) {
+		std::vector<Sample> samples = ggxSamples((float)level / (NUM_LEVELS - 1), chain[0].size);
+		pool.parallelFor((size_t)6 * levelSize, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++) {
+				int face = (int)(row / levelSize), y = (int)(row % levelSize);
+				for (int x = 0; x < levelSize; x++) {
+					float n[3];
+					faceDirection(face, 2.0f * (x + 0.5f) / levelSize - 1.0f, 2.0f * (y + 0.5f) / levelSize - 1.0f, n);
+
+					// Tangent frame around the texel's direction
+					float up[3] = { 0.0f, 0.0f, 1.0f };
+					if (std::fabs(n[2]) > 0.999f) {
+						up[0] = 1.0f;
+						up[2] = 0.0f;
+					}
+					float tx[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+					float length = std::sqrt(tx[0] * tx[0] + tx[1] * tx[1] + tx[2] * tx[2]);
+					for (int c = 0; c < 3; c++)
+						tx[c] /= length;
+					float ty[3] = { n[1] * tx[2] - n[2] * tx[1], n[2] * tx[0] - n[0] * tx[2], n[0] * tx[1] - n[1] * tx[0] };
+
+					float sum[3] = { 0.0f, 0.0f, 0.0f }, totalWeight = 0.0f;
+					for (size_t i = 0; i < samples.size(); i++) {
+						const Sample & sample = samples[i];
+						float l[3], color[3];
+						for (int c = 0; c < 3; c++)
+							l[c] = tx[c] * sample.direction[0] + ty[c] * sample.direction[1] + n[c] * sample.direction[2];
+						sampleChain(chain, l, sample.lod, color);
+						for (int c = 0; c < 3; c++)
+							sum[c] += color[c] * sample.weight;
+						totalWeight += sample.weight;
+					}
+
+					float * texel = out + ((size_t)face * levelSize * levelSize + (size_t)y * levelSize + x) * 3;
+					for (int c = 0; c < 3; c++)
+						texel[c] = toSrgb(sum[c] / totalWeight);
+				}
+			}
+		});
+	}
+
+	// Project the cube onto the first 9 spherical harmonics and convolve with the cosine lobe, so that summing
+	// coefficient * basis gives the irradiance over pi (what a white diffuse surface reflects)
+	static void projectIrradiance(const Cube & cube, float irradiance[9][3], ThreadPool & pool) {
+		float partial[6][9][3];
+		memset(partial, 0, sizeof(partial));
+		pool.parallelFor(6, [&](size_t begin, size_t end) {
+			for (size_t face = begin; face < end; face++) {
+				for (int y = 0; y < cube.size; y++) {
+					for (int x = 0; x < cube.size; x++) {
+						float d[3];
+						faceDirection((int)face, 2.0f * (x + 0.5f) / cube.size - 1.0f, 2.0f * (y + 0.5f) / cube.size - 1.0f, d);
+						float basis[9] = {
+							0.282095f,
+							0.488603f * d[1], 0.488603f * d[2], 0.488603f * d[0],
+							1.092548f * d[0] * d[1], 1.092548f * d[1] * d[2], 0.315392f * (3.0f * d[2] * d[2] - 1.0f),
+							1.092548f * d[0] * d[2], 0.546274f * (d[0] * d[0] - d[1] * d[1])
+						};
+						float weight = texelSolidAngle(x, y, cube.size);
+						const float * color = cube.faces[face].data() + ((size_t)y * cube.size + x) * 3;
+						for (int i = 0; i < 9; i++)
+							for (int c = 0; c < 3; c++)
+								partial[face][i][c] += color[c] * basis[i] * weight;
+					}
+				}
+			}
+		});
+
+		// Cosine lobe convolution (pi, 2pi/3, pi/4 per band), over pi, times the basis constants the shader leaves out
+		static const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+		static const float basisConstant[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+		for (int i = 0; i < 9; i++) {
+			for (int c = 0; c < 3; c++) {
+				float sum = 0.0f;
+				for (int face = 0; face < 6; face++)
+					sum += partial[face][i][c];
+				irradiance[i][c] = sum * band[i] * basisConstant[i];
+			}
+		}
+	}
+
+public:
+	// Version 1: first version
+	static const uint32_t VERSION = 1;
+
+	// Path of face i (+X, -X, +Y, -Y, +Z, -Z) of the cube map in mapDir
+	static std::string facePath(const std::string & mapDir, int face) {
+		static const char * faceNames[6] = { "xp", "xn", "yp", "yn", "zp", "zn" };
+		return mapDir + "/" + faceNames[face] + ".jpg";
+	}
+
+	// The cache sits with the faces
+	static std::string cachePath(const std::string & mapDir) {
+		return mapDir + "/environment.envcache";
+	}
+
+	// Read the cache for the cube map in mapDir if it exists and none of the faces has changed. Returns NULL otherwise,
+	// after printing why. Faces that were only touched get their timestamps refreshed
+	static std::shared_ptr<PrefilteredEnvironment> open(const std::string & mapDir) {
+		Clock::time_point start = Clock::now();
+		std::string path = cachePath(mapDir);
+
+		EnvironmentCacheHeader header;
+		std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+		if (!in.read((char *)&header, sizeof(header))) {
+			std::cout << "Environment cache miss for " << path << " (no cache yet)" << std::endl;
+			return std::shared_ptr<PrefilteredEnvironment>();
+		}
+		if (memcmp(header.magic, "OGLE", 4) != 0 || header.version != VERSION || header.size != SIZE || header.numLevels != NUM_LEVELS) {
+			std::cout << "Environment cache miss for " << path << " (older version)" << std::endl;
+			return std::shared_ptr<PrefilteredEnvironment>();
+		}
+
+		bool touched = false;
+		for (int face = 0; face < 6; face++) {
+			std::string faceFile = facePath(mapDir, face);
+			uint64_t size;
+			int64_t modified;
+			if (!FileInfo::getSourceInfo(faceFile.c_str(), size, modified))
+				continue;
+			if (size != header.sourceSize[face]) {
+				std::cout << "Environment cache " << path << " is stale (" << faceFile << " changed size), rebuilding" << std::endl;
+				return std::shared_ptr<PrefilteredEnvironment>();
+			}
+			if (modified != header.sourceModified[face]) {
+				if (FileInfo::hashFile(faceFile.c_str()) != header.sourceHash[face]) {
+					std::cout << "Environment cache " << path << " is stale (" << faceFile << " changed), rebuilding" << std::endl;
+					return std::shared_ptr<PrefilteredEnvironment>();
+				}
+				header.sourceModified[face] = modified;
+				touched = true;
+			}
+		}
+
+		std::shared_ptr<PrefilteredEnvironment> environment = std::make_shared<PrefilteredEnvironment>();
+		environment->size = (int)header.size;
+		environment->numLevels = (int)header.numLevels;
+		memcpy(environment->irradiance, header.irradiance, sizeof(header.irradiance));
+		size_t numFloats = (header.fileSize - sizeof(header)) / sizeof(float);
+		environment->texels.resize(numFloats);
+		if (!in.read((char *)environment->texels.data(), (std::streamsize)(numFloats * sizeof(float)))) {
+			std::cout << "Environment cache " << path << " is truncated, rebuilding" << std::endl;
+			return std::shared_ptr<PrefilteredEnvironment>();
+		}
+		in.close();
+
+		// Same contents with new timestamps: refresh the header so we don't hash again next time
+		if (touched) {
+			std::fstream patch(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+			patch.write((const char *)&header, sizeof(header));
+		}
+
+		std::cout << "Environment cache hit for " << path << ", read in " << millisecondsSince(start) << " ms" << std::endl;
+		return environment;
+	}
+
+	// Prefilter the six decoded faces (faceSize x faceSize, channels per pixel, top row first as the images store them)
+	// of the cube map in mapDir, and write the cache. The environment is returned even if it couldn't be stored
+	static std::shared_ptr<PrefilteredEnvironment> build(const std::string & mapDir, const unsigned char * const faces[6], int faceSize,
+		int channels, ThreadPool & pool = ThreadPool::shared()) {
+		Clock::time_point start = Clock::now();
+		std::shared_ptr<PrefilteredEnvironment> environment = std::make_shared<PrefilteredEnvironment>();
+		environment->size = SIZE;
+		environment->numLevels = NUM_LEVELS;
+
+		// The sky in linear light and its mipmaps, at most level 0's size: finer detail would be blurred away anyway
+		std::vector<Cube> chain = buildChain(toLinearCube(faces, faceSize, channels, std::min(SIZE, faceSize), pool));
+
+		size_t numFloats = 0;
+		for (int level = 0; level < NUM_LEVELS; level++)
+			numFloats += (size_t)6 * environment->getLevelSize(level) * environment->getLevelSize(level) * 3;
+		environment->texels.resize(numFloats);
+		for (int level = 0; level < NUM_LEVELS; level++)
+			prefilterLevel(chain, level, environment->getLevelSize(level), environment->texels.data() + environment->getFaceOffset(level, 0), pool);
+
+		// 32x32 faces are plenty for 9 coefficients
+		size_t irradianceLevel = 0;
+		while (irradianceLevel + 1 < chain.size() && chain[irradianceLevel].size > 32)
+			irradianceLevel++;
+		projectIrradiance(chain[irradianceLevel], environment->irradiance, pool);
+
+		std::cout << "Prefiltered environment map (" << SIZE << "x" << SIZE << ", " << NUM_LEVELS << " levels) and sky irradiance built in "
+			<< millisecondsSince(start) << " ms" << std::endl;
+
+		// Write the cache under a temporary name and rename it, like the mesh cache
+		EnvironmentCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "OGLE", 4);
+		header.version = VERSION;
+		for (int face = 0; face < 6; face++) {
+			std::string faceFile = facePath(mapDir, face);
+			if (!FileInfo::getSourceInfo(faceFile.c_str(), header.sourceSize[face], header.sourceModified[face]))
+				return environment;
+			header.sourceHash[face] = FileInfo::hashFile(faceFile.c_str());
+		}
+		header.size = SIZE;
+		header.numLevels = NUM_LEVELS;
+		memcpy(header.irradiance, environment->irradiance, sizeof(header.irradiance));
+		header.fileSize = sizeof(header) + numFloats * sizeof(float);
+
+		std::string path = cachePath(mapDir);
+		std::string tempPath = path + ".tmp";
+		std::ofstream out(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write((const char *)&header, sizeof(header));
+		out.write((const char *)environment->texels.data(), (std::streamsize)(numFloats * sizeof(float)));
+		out.close();
+		if (!out) {
+			std::remove(tempPath.c_str());
+			std::cout << "Could not write environment cache " << path << std::endl;
+			return environment;
+		}
+
+		// rename() won't replace an existing file on Windows
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+			std::remove(tempPath.c_str());
+		return environment;
+	}
+
+	// The environment of the cube map in mapDir: from the cache, or decoded and prefiltered now. NULL if a face can't be
+	// read or the faces aren't square and the same size
+	static std::shared_ptr<PrefilteredEnvironment> load(const std::string & mapDir, ThreadPool & pool = ThreadPool::shared()) {
+		std::shared_ptr<PrefilteredEnvironment> environment = open(mapDir);
+		if (environment)
+			return environment;
+
+		unsigned char * faces[6] = { NULL };
+		int width = 0, channels = 0;
+		bool ok = true;
+		for (int face = 0; face < 6 && ok; face++) {
+			int w, h, c;
+			faces[face] = SOIL_load_image(facePath(mapDir, face).c_str(), &w, &h, &c, SOIL_LOAD_AUTO);
+			ok = faces[face] != NULL && w == h && (face == 0 || (w == width && c == channels));
+			width = w;
+			channels = c;
+		}
+		if (ok)
+			environment = build(mapDir, faces, width, channels, pool);
+		else
+			std::cout << "Could not prefilter the cube map in " << mapDir << " (missing or mismatched faces)" << std::endl;
+		for (int face = 0; face < 6; face++) {
+			if (faces[face] != NULL)
+				SOIL_free_image_data(faces[face]);
+		}
+		return environment;
+	}
+
+	// Upload the prefiltered map as a cube map texture with every level (needs the GL context)
+	static GLuint upload(const PrefilteredEnvironment & environment) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, environment.numLevels, GL_RGB16F, environment.size, environment.size);
+		for (int level = 0; level < environment.numLevels; level++) {
+			int size = environment.getLevelSize(level);
+			for (int face = 0; face < 6; face++)
+				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGB, GL_FLOAT, environment.getFace(level, face));
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+};
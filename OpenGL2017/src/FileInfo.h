@@ -0,0 +1,48 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class tells whether a file a cache was built from has changed: its size and modification time,
+ *              which are cheap to read, and a hash of its contents for when only the time changed
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sys/stat.h>
+#include "MappedFile.h"
+
+class FileInfo {
+
+public:
+	// Size and modification time of a file. Returns false if it does not exist
+	static bool getSourceInfo(const char * filePath, uint64_t & size, int64_t & modified) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(filePath, &info) != 0)
+			return false;
+#else
+		struct stat info;
+		if (stat(filePath, &info) != 0)
+			return false;
+#endif
+		size = (uint64_t)info.st_size;
+		modified = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	// 64-bit FNV-1a hash of a file's contents
+	static uint64_t hashFile(const char * filePath) {
+		uint64_t hash = 14695981039346656037ULL;
+		MappedFile file;
+		if (!file.open(filePath))
+			return 0;
+
+		const unsigned char * bytes = (const unsigned char *)file.getData();
+		for (size_t i = 0; i < file.getSize(); i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+};
@@ -0,0 +1,199 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class sits in front of the GL calls the draw loop repeats for every object (program, vertex array
+ *              and texture binds, uniform block ranges, enables, depth and winding state) and remembers what it last
+ *              set, so calls that would change nothing never reach the driver. Vertex buffers and attribute formats are
+ *              part of each mesh's vertex array, so they change with bindVertexArray. It also counts what each frame
+ *              sends (draws, state changes, binds) and what it filtered out. Only calls made through it are counted:
+ *              uniforms set through ShaderProgram and buffer or texture uploads are not. Code that sets GL state
+ *              without it (uploads, impostor bakes) has to be followed by invalidate()
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cstddef>
+#include <map>
+
+// What one frame sent to GL through GLState
+struct GLStateCounters {
+	int drawCalls;
+	int stateChanges;		// Every call that reached GL other than draws, the binds below included
+	int bufferBinds;		// Uniform block ranges; vertex buffers come with bindVertexArray
+	int textureBinds;		// Including the glActiveTexture calls they needed
+	int programBinds;
+	int redundantCalls;		// Calls that were filtered out because they would have changed nothing
+
+	GLStateCounters() : drawCalls(0), stateChanges(0), bufferBinds(0), textureBinds(0), programBinds(0), redundantCalls(0) {}
+};
+
+class GLState {
+
+private:
+	static const GLuint MAX_TEXTURE_UNITS = 16;
+	static const GLuint MAX_UNIFORM_BINDINGS = 16;
+	static const GLuint UNKNOWN = 0xFFFFFFFF;	// State that may have changed behind our back, so the next call goes through
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeUnit;
+	GLuint uniformBuffers[MAX_UNIFORM_BINDINGS];	// Range bound to each uniform block binding point
+	GLintptr uniformOffsets[MAX_UNIFORM_BINDINGS];
+	GLsizeiptr uniformSizes[MAX_UNIFORM_BINDINGS];
+	GLenum frontFaceMode;
+	GLenum depthFunction;
+	GLenum textureTargets[MAX_TEXTURE_UNITS];
+	GLuint textures[MAX_TEXTURE_UNITS];
+	std::map<GLenum, bool> capabilities;		// Only those set through enable()/disable()
+	GLStateCounters counters;
+
+	void setActiveUnit(GLuint unit) {
+		if (activeUnit == unit)
+			return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		counters.textureBinds++;
+		counters.stateChanges++;
+	}
+
+	void setCapability(GLenum capability, bool enabled) {
+		std::map<GLenum, bool>::iterator known = capabilities.find(capability);
+		if (known != capabilities.end() && known->second == enabled) {
+			counters.redundantCalls++;
+			return;
+		}
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		capabilities[capability] = enabled;
+		counters.stateChanges++;
+	}
+
+public:
+	GLState() {
+		invalidate();
+	}
+
+	// Forget everything: the next call of each kind goes through. For after GL has been used directly
+	void invalidate() {
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (GLuint i = 0; i < MAX_TEXTURE_UNITS; i++) {
+			textureTargets[i] = 0;
+			textures[i] = UNKNOWN;
+		}
+		for (GLuint i = 0; i < MAX_UNIFORM_BINDINGS; i++)
+			uniformBuffers[i] = UNKNOWN;
+		frontFaceMode = UNKNOWN;
+		depthFunction = UNKNOWN;
+		capabilities.clear();
+	}
+
+	void useProgram(GLuint id) {
+		if (program == id) {
+			counters.redundantCalls++;
+			return;
+		}
+		glUseProgram(id);
+		program = id;
+		counters.programBinds++;
+		counters.stateChanges++;
+	}
+
+	void bindVertexArray(GLuint id) {
+		if (vertexArray == id) {
+			counters.redundantCalls++;
+			return;
+		}
+		glBindVertexArray(id);
+		vertexArray = id;
+		counters.stateChanges++;
+	}
+
+	// glBindBufferRange. Uniform block binding points are filtered; other targets always go through
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+		bool tracked = (target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BINDINGS);
+		if (tracked && uniformBuffers[index] == buffer && uniformOffsets[index] == offset && uniformSizes[index] == size) {
+			counters.redundantCalls++;
+			return;
+		}
+		glBindBufferRange(target, index, buffer, offset, size);
+		if (tracked) {
+			uniformBuffers[index] = buffer;
+			uniformOffsets[index] = offset;
+			uniformSizes[index] = size;
+		}
+		counters.bufferBinds++;
+		counters.stateChanges++;
+	}
+
+	// Bind texture to target of unit, switching the active unit only if it has to
+	void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+		if (unit < MAX_TEXTURE_UNITS && textureTargets[unit] == target && textures[unit] == texture) {
+			counters.redundantCalls++;
+			return;
+		}
+		setActiveUnit(unit);
+		glBindTexture(target, texture);
+		if (unit < MAX_TEXTURE_UNITS) {
+			textureTargets[unit] = target;
+			textures[unit] = texture;
+		}
+		counters.textureBinds++;
+		counters.stateChanges++;
+	}
+
+	void enable(GLenum capability) {
+		setCapability(capability, true);
+	}
+
+	void disable(GLenum capability) {
+		setCapability(capability, false);
+	}
+
+	void frontFace(GLenum mode) {
+		if (frontFaceMode == mode) {
+			counters.redundantCalls++;
+			return;
+		}
+		glFrontFace(mode);
+		frontFaceMode = mode;
+		counters.stateChanges++;
+	}
+
+	void depthFunc(GLenum function) {
+		if (depthFunction == function) {
+			counters.redundantCalls++;
+			return;
+		}
+		glDepthFunc(function);
+		depthFunction = function;
+		counters.stateChanges++;
+	}
+
+	void drawArrays(GLenum mode, GLint first, GLsizei count) {
+		glDrawArrays(mode, first, count);
+		counters.drawCalls++;
+	}
+
+	void drawElements(GLenum mode, GLsizei count, GLenum type, const void * indices) {
+		glDrawElements(mode, count, type, indices);
+		counters.drawCalls++;
+	}
+
+	// What has been sent since the last endFrame()
+	const GLStateCounters & getCounters() const {
+		return counters;
+	}
+
+	// The frame's counters, which start over for the next one
+	GLStateCounters endFrame() {
+		GLStateCounters frame = counters;
+		counters = GLStateCounters();
+		return frame;
+	}
+
+};
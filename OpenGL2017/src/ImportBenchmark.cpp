@@ -0,0 +1,332 @@
+/**
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This program benchmarks OBJ import. It generates synthetic OBJ files (see ObjGenerator.h), then times
+ *              the three steps a mesh goes through before it can be drawn: parsing (ModelImporter::importOBJ), conversion
+ *              to an ImportedModel (parse plus optimization, tangents and LODs), and the repack that setupVerticesObj()
+ *              in final.cpp does before glBufferData. Every measurement is printed as one line of JSON
+ *
+ * Usage: ImportBenchmark [--faces 1000,10000,...] [--attributes none,vt,vn,vt+vn] [--parser parallel|mapped|stream]
+ *                        [--runs N] [--dir DIR] [--out FILE] [--float] [--regenerate] [--verbose]
+ *
+ * NOTES:
+ * Generated files are named DIR/bench_<faces>_<attributes>.obj and are reused by later runs unless --regenerate is given
+ * The files are read right after they are written (or from an earlier run), so the OS file cache is warm
+ * peak_rss_mb is the process-wide peak so far; heap_peak_mb is the most heap memory that was live during that phase
+ *
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ImportedModel.h"
+#include "MemoryStats.h"
+#include "ModelImporter.h"
+#include "ObjGenerator.h"
+
+/*************************************************   Allocation counting  ********************************************/
+
+// Every operator new in the process goes through here. The size is stored in front of each block so delete knows it
+std::atomic<unsigned long long> allocationCount(0);
+std::atomic<unsigned long long> allocatedBytes(0);
+std::atomic<long long> liveBytes(0);
+std::atomic<long long> peakLiveBytes(0);
+
+static const size_t allocationHeader = 16; // Keeps the returned pointer 16-byte aligned
+
+void * countedAllocate(size_t size) {
+	void * block = malloc(size + allocationHeader);
+	if (block == NULL)
+		return NULL;
+	*(size_t *)block = size;
+
+	allocationCount++;
+	allocatedBytes += size;
+	long long live = (liveBytes += (long long)size);
+	long long peak = peakLiveBytes.load();
+	while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live)) {
+	}
+	return (char *)block + allocationHeader;
+}
+
+void countedFree(void * pointer) {
+	if (pointer == NULL)
+		return;
+	void * block = (char *)pointer - allocationHeader;
+	liveBytes -= (long long)*(size_t *)block;
+	free(block);
+}
+
+void * operator new(size_t size) {
+	void * pointer = countedAllocate(size);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void * operator new[](size_t size) {
+	return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size);
+}
+
+void operator delete(void * pointer) noexcept {
+	countedFree(pointer);
+}
+
+void operator delete[](void * pointer) noexcept {
+	countedFree(pointer);
+}
+
+void operator delete(void * pointer, size_t) noexcept {
+	countedFree(pointer);
+}
+
+void operator delete[](void * pointer, size_t) noexcept {
+	countedFree(pointer);
+}
+
+/*************************************************   Measurements  ********************************************/
+
+// Counters at the start of a phase
+struct PhaseStart {
+	std::chrono::high_resolution_clock::time_point time;
+	unsigned long long allocations;
+	unsigned long long bytes;
+};
+
+PhaseStart startPhase() {
+	// The heap peak is tracked per phase, starting from what is live now
+	peakLiveBytes = liveBytes.load();
+
+	PhaseStart start;
+	start.allocations = allocationCount.load();
+	start.bytes = allocatedBytes.load();
+	start.time = std::chrono::high_resolution_clock::now();
+	return start;
+}
+
+// Settings of the benchmark
+std::vector<unsigned long long> faceCounts;
+std::vector<std::string> attributeSets;
+ModelImporter::ParseMode parseMode = ModelImporter::PARSE_PARALLEL;
+int numRuns = 3;
+std::string directory = ".";
+FILE * results = stdout;
+bool packVertices = true;
+bool regenerate = false;
+bool verbose = false;
+
+const char * parserName() {
+	switch (parseMode) {
+	case ModelImporter::PARSE_STREAM:
+		return "stream";
+	case ModelImporter::PARSE_MAPPED:
+		return "mapped";
+	default:
+		return "parallel";
+	}
+}
+
+// Print one measurement as a line of JSON. megabytes is what the phase read (or wrote, for the repack)
+void endPhase(const PhaseStart & start, const char * phase, unsigned long long faces, const std::string & attributes, int run,
+	double megabytes) {
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start.time).count();
+	double seconds = (ms > 0.0) ? ms / 1000.0 : 1e-9;
+
+	fprintf(results, "{\"phase\": \"%s\", \"faces\": %llu, \"attributes\": \"%s\", \"parser\": \"%s\", \"packed\": %s, \"run\": %d, "
+		"\"ms\": %.3f, \"mb\": %.3f, \"mb_per_s\": %.2f, \"faces_per_s\": %.0f, \"peak_rss_mb\": %.2f, \"heap_peak_mb\": %.2f, "
+		"\"allocations\": %llu, \"allocated_mb\": %.3f}\n",
+		phase, faces, attributes.c_str(), parserName(), packVertices ? "true" : "false", run,
+		ms, megabytes, megabytes / seconds, faces / seconds, toMegabytes(getPeakResidentBytes()), toMegabytes((size_t)peakLiveBytes.load()),
+		allocationCount.load() - start.allocations, toMegabytes((size_t)(allocatedBytes.load() - start.bytes)));
+	fflush(results);
+}
+
+long long fileSize(const std::string & path) {
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	return file ? (long long)file.tellg() : -1;
+}
+
+// Split "a,b,c"
+std::vector<std::string> splitList(const char * list) {
+	std::vector<std::string> items;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+bool parseArguments(int argc, char ** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+
+		if (arg == "--faces" && hasValue) {
+			faceCounts.clear();
+			std::vector<std::string> items = splitList(argv[++i]);
+			for (size_t k = 0; k < items.size(); k++)
+				faceCounts.push_back(strtoull(items[k].c_str(), NULL, 10));
+		}
+		else if (arg == "--attributes" && hasValue) {
+			attributeSets = splitList(argv[++i]);
+		}
+		else if (arg == "--parser" && hasValue) {
+			std::string parser = argv[++i];
+			if (parser == "stream")
+				parseMode = ModelImporter::PARSE_STREAM;
+			else if (parser == "mapped")
+				parseMode = ModelImporter::PARSE_MAPPED;
+			else if (parser == "parallel")
+				parseMode = ModelImporter::PARSE_PARALLEL;
+			else
+				return false;
+		}
+		else if (arg == "--runs" && hasValue) {
+			numRuns = atoi(argv[++i]);
+		}
+		else if (arg == "--dir" && hasValue) {
+			directory = argv[++i];
+		}
+		else if (arg == "--out" && hasValue) {
+			results = fopen(argv[++i], "w");
+			if (results == NULL) {
+				std::cerr << "Could not open " << argv[i] << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (arg == "--float") {
+			packVertices = false;
+		}
+		else if (arg == "--regenerate") {
+			regenerate = true;
+		}
+		else if (arg == "--verbose") {
+			verbose = true;
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char ** argv) {
+	unsigned long long defaultFaces[4] = { 1000, 10000, 100000, 1000000 };
+	faceCounts.assign(defaultFaces, defaultFaces + 4);
+	const char * defaultAttributes[4] = { "none", "vt", "vn", "vt+vn" };
+	attributeSets.assign(defaultAttributes, defaultAttributes + 4);
+
+	if (!parseArguments(argc, argv)) {
+		std::cerr << "Usage: ImportBenchmark [--faces 1000,10000,...] [--attributes none,vt,vn,vt+vn] [--parser parallel|mapped|stream]"
+			<< " [--runs N] [--dir DIR] [--out FILE] [--float] [--regenerate] [--verbose]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The importer and ImportedModel log as they go. That output isn't part of the results (or the timings)
+	std::ostringstream discarded;
+	std::streambuf * console = std::cout.rdbuf();
+	if (!verbose)
+		std::cout.rdbuf(discarded.rdbuf());
+
+	for (size_t f = 0; f < faceCounts.size(); f++) {
+		unsigned long long faces = faceCounts[f];
+		for (size_t a = 0; a < attributeSets.size(); a++) {
+			const std::string & attributes = attributeSets[a];
+			bool withTexCoords = (attributes.find("vt") != std::string::npos);
+			bool withNormals = (attributes.find("vn") != std::string::npos);
+
+			// The original stream parser assumes every corner is v/vt/vn
+			if (parseMode == ModelImporter::PARSE_STREAM && !(withTexCoords && withNormals)) {
+				std::cerr << "Skipping " << faces << " faces (" << attributes << "): the stream parser needs vt and vn" << std::endl;
+				continue;
+			}
+
+			std::ostringstream name;
+			name << directory << "/bench_" << faces << "_" << (withTexCoords ? "vt" : "") << (withNormals ? "vn" : "")
+				<< ((withTexCoords || withNormals) ? "" : "none") << ".obj";
+			std::string path = name.str();
+
+			// Generate the file once
+			if (regenerate || fileSize(path) <= 0) {
+				std::cerr << "Generating " << path << std::endl;
+				PhaseStart start = startPhase();
+				if (!ObjGenerator::write(path.c_str(), faces, withTexCoords, withNormals)) {
+					std::cerr << "Could not write " << path << std::endl;
+					return EXIT_FAILURE;
+				}
+				endPhase(start, "generate", faces, attributes, 0, toMegabytes((size_t)fileSize(path)));
+			}
+			double fileMegabytes = toMegabytes((size_t)fileSize(path));
+
+			for (int run = 0; run < numRuns; run++) {
+				std::cerr << "Importing " << path << " (run " << run + 1 << " of " << numRuns << ")" << std::endl;
+
+				// Parse only, the way ImportedModel calls the importer
+				{
+					PhaseStart start = startPhase();
+					ModelImporter importer;
+					if (parseMode == ModelImporter::PARSE_STREAM) {
+						importer.parseOBJ(path.c_str());
+					}
+					else {
+						importer.importOBJ(path.c_str(), true, parseMode == ModelImporter::PARSE_PARALLEL);
+						std::vector<Vertex> vertices;
+						std::vector<unsigned int> indices;
+						importer.takeVertexStream(vertices);
+						importer.takeIndices(indices);
+					}
+					endPhase(start, "parse", faces, attributes, run, fileMegabytes);
+				}
+
+				// Everything ImportedModel does (without its mesh cache, which would skip the work)
+				PhaseStart start = startPhase();
+				ImportedModel model(path.c_str(), true, parseMode, false);
+				endPhase(start, "import", faces, attributes, run, fileMegabytes);
+
+				// What setupVerticesObj() hands to glBufferData, copied into a staging buffer in place of the driver
+				start = startPhase();
+				std::vector<char> staging;
+				if (packVertices) {
+					ArrayView<PackedVertex> vertices = model.getPackedVertexStream();
+					staging.resize(vertices.sizeInBytes());
+					if (!staging.empty())
+						memcpy(staging.data(), vertices.data, vertices.sizeInBytes());
+				}
+				else {
+					ArrayView<Vertex> vertices = model.getVertexStream();
+					staging.resize(vertices.sizeInBytes());
+					if (!staging.empty())
+						memcpy(staging.data(), vertices.data, vertices.sizeInBytes());
+				}
+				size_t vertexBytes = staging.size();
+				if (model.isIndexed() && model.getIndexData() != NULL) {
+					size_t indexBytes = (size_t)model.getNumIndices() * model.getIndexSize();
+					staging.resize(vertexBytes + indexBytes);
+					memcpy(staging.data() + vertexBytes, model.getIndexData(), indexBytes);
+				}
+				endPhase(start, "repack", faces, attributes, run, toMegabytes(staging.size()));
+			}
+		}
+	}
+
+	std::cout.rdbuf(console);
+	if (results != stdout)
+		fclose(results);
+	return 0;
+}
@@ -5,37 +5,346 @@
  */
 
 #pragma once
+#include <chrono>
+#include <memory>
+#include <string>
 #include "ModelImporter.h"
+#include "MeshCache.h"
+#include "MemoryStats.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "TangentGenerator.h"
+#include "ThreadPool.h"
+#include "VertexQuantizer.h"
+#include "Vertex.h"
 
 class ImportedModel {
 
 private:
 	int numVertices;
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> texCoords;
-	std::vector<glm::vec3> normalVecs;
-	std::vector<glm::vec3> tangents;
 
-public:
+	// Interleaved vertices, written once by the importer and moved in here
+	std::vector<Vertex> vertexData;
+
+	// Index buffer for indexed models. Only one of these is filled, depending on the index size
+	bool indexed;
+	int numIndices;
+	int indexSize;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+
+	// Index ranges of the levels of detail, full detail first. Unindexed models have one level covering all vertices
+	std::vector<MeshLod> lods;
+
+	// Material ranges of every level of detail (each level's are lods[i].numMaterialRanges from lods[i].firstMaterialRange),
+	// the material names they index ("" when the OBJ didn't name one) and the OBJ's mtllib files
+	std::vector<MeshMaterialRange> materialRanges;
+	std::vector<std::string> materialNames;
+	std::vector<std::string> materialLibraries;
+
+	glm::vec3 boundsMin, boundsMax;
+
+	// 20-byte copy of the vertices, built the first time it is asked for
+	std::vector<PackedVertex> packedData;
+	QuantizationStats quantizationStats;
+	std::string name;
+
+	// When the model came from its binary cache the data lives in the mapped file instead of the vectors above
+	std::shared_ptr<MappedFile> cacheFile;
+	MeshCacheHeader cacheHeader;
+
+	// Bytes the importer's own buffers peaked at for this model (0 when it came from the cache)
+	size_t importPeakBytes;
+
+	// Time spent generating tangents (0 when the model came from the cache)
+	double tangentMilliseconds;
+
+	// Append a level of detail starting at firstIndex in which material m has materialSizes[m] indices, in material order
+	void addLod(uint32_t firstIndex, const std::vector<size_t> & materialSizes, float error) {
+		MeshLod lod = { firstIndex, 0, error, (uint32_t)materialRanges.size(), 0 };
+		for (size_t m = 0; m < materialSizes.size(); m++) {
+			if (materialSizes[m] == 0)
+				continue;
+			MeshMaterialRange range = { firstIndex + lod.numIndices, (uint32_t)materialSizes[m], (uint32_t)m, 0 };
+			materialRanges.push_back(range);
+			lod.numIndices += range.numIndices;
+			lod.numMaterialRanges++;
+		}
+		lods.push_back(lod);
+	}
+
+	// Append up to MESH_MAX_LODS - 1 simplified versions of the full detail triangles in idx, each simplified from the one
+	// before to about half its triangles, so every level costs about half the one before it. A level's error is the one
+	// before's plus what its own step added, out of one error budget for the chain. Levels that remove less than a tenth of
+	// the triangles (faceted meshes, whose hard edges can't collapse, or the error limit) end the chain, so none is kept
+	// that costs index space without saving anything.
+	// Each material (materialSizes[m] indices, in order) is simplified on its own so no triangle changes material
+	void generateLods(const char * filePath, std::vector<unsigned int> & idx, const std::vector<size_t> & materialSizes) {
+		size_t numMaterials = materialSizes.size();
+		addLod(0, materialSizes, 0.0f);
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		const float maxError = 0.05f;
+		std::vector<unsigned int> canonical = MeshSimplifier::findCanonicalPositions(vertexData);
+
+		// levels[l][m] is material m of level l + 1
+		std::vector<std::vector<std::vector<unsigned int>>> levels;
+		std::vector<float> errors;
+		std::vector<std::vector<unsigned int>> previous(numMaterials);
+		size_t fullStart = 0;
+		for (size_t m = 0; m < numMaterials; m++) {
+			previous[m].assign(idx.begin() + fullStart, idx.begin() + fullStart + materialSizes[m]);
+			fullStart += materialSizes[m];
+		}
+		size_t previousCount = idx.size();
+		float previousError = 0.0f;
+
+		for (uint32_t level = 1; level < MESH_MAX_LODS; level++) {
+			std::vector<std::vector<unsigned int>> parts(numMaterials);
+			size_t count = 0;
+			float error = previousError;
+			for (size_t m = 0; m < numMaterials; m++) {
+				if (!previous[m].empty()) {
+					float partError = 0.0f;
+					parts[m] = MeshSimplifier::simplify(vertexData, canonical, previous[m], (previous[m].size() / 2) / 3 * 3,
+						maxError - previousError, partError);
+					error = glm::max(error, previousError + partError);
+				}
+
+				// A material that can't be simplified keeps the previous level's triangles
+				if (parts[m].empty())
+					parts[m] = previous[m];
+				count += parts[m].size();
+			}
+			if (count == 0 || count > previousCount * 9 / 10)
+				break;
+
+			levels.push_back(parts);
+			errors.push_back(error);
+			previous.swap(parts);
+			previousCount = count;
+			previousError = error;
+		}
+
+		// The levels share the vertex buffer, so only their triangle order can be improved. That doesn't change what the
+		// next level is simplified from, so it is done afterwards, a level per thread
+		ThreadPool::shared().parallelFor(levels.size(), [&](size_t begin, size_t end) {
+			for (size_t l = begin; l < end; l++) {
+				for (size_t m = 0; m < numMaterials; m++) {
+					if (!levels[l][m].empty())
+						MeshOptimizer::optimizeVertexCache(levels[l][m], vertexData.size());
+				}
+			}
+		});
+
+		for (size_t l = 0; l < levels.size(); l++) {
+			std::vector<size_t> sizes(numMaterials);
+			for (size_t m = 0; m < numMaterials; m++)
+				sizes[m] = levels[l][m].size();
+			addLod((uint32_t)idx.size(), sizes, errors[l]);
+			for (size_t m = 0; m < numMaterials; m++)
+				idx.insert(idx.end(), levels[l][m].begin(), levels[l][m].end());
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "LODs for " << filePath << ":";
+		for (size_t i = 0; i < lods.size(); i++)
+			std::cout << " " << lods[i].numIndices / 3 << " tris (error " << lods[i].error * 100.0f << "%)";
+		std::cout << " in " << ms << " ms" << std::endl;
+	}
 
-	// Create an instance of an imported model and allow it to be added to the vertex buffer object
-	ImportedModel(const char * filePath) {
+	// Parse the OBJ straight into the interleaved stream
+	void importOBJ(const char * filePath, bool buildIndices, ModelImporter::ParseMode parseMode) {
 		ModelImporter modelImporter = ModelImporter();
-		modelImporter.parseOBJ(filePath);
+		std::vector<unsigned int> idx;
+		std::vector<size_t> materialSizes;
+
+		if (parseMode == ModelImporter::PARSE_STREAM) {
+			// The original parser only produces per-attribute arrays, so pack them here. It ignores materials
+			modelImporter.parseOBJ(filePath);
+			std::vector<float> verts = modelImporter.getVertices();
+			std::vector<float> tcs = modelImporter.getTextureCoords();
+			std::vector<float> normals = modelImporter.getNormals();
+
+			vertexData.resize(modelImporter.getNumVertices());
+			for (size_t i = 0; i < vertexData.size(); i++) {
+				vertexData[i].position = glm::vec3(verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]);
+				vertexData[i].texCoord = glm::vec2(tcs[i * 2], tcs[i * 2 + 1]);
+				vertexData[i].normal = glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+				vertexData[i].tangent = glm::vec4(0.0f);
+			}
+			importPeakBytes = (verts.size() + tcs.size() + normals.size()) * 2 * sizeof(float) + vertexData.size() * sizeof(Vertex);
+			materialNames.assign(1, std::string());
+			materialSizes.assign(1, vertexData.size());
+		}
+		else {
+			modelImporter.importOBJ(filePath, buildIndices, parseMode == ModelImporter::PARSE_PARALLEL);
+			modelImporter.takeVertexStream(vertexData);
+			modelImporter.takeIndices(idx);
+			importPeakBytes = modelImporter.getPeakBytes();
+
+			// Triangles come out grouped by material; three indices (or vertices, without indices) per triangle
+			materialNames = modelImporter.getMaterialNames();
+			materialLibraries = modelImporter.getMaterialLibraries();
+			std::vector<size_t> triangles = modelImporter.getMaterialTriangles();
+			for (size_t m = 0; m < triangles.size(); m++)
+				materialSizes.push_back(triangles[m] * 3);
+		}
+
+		indexed = buildIndices && parseMode != ModelImporter::PARSE_STREAM;
+
+		// Reorder for the vertex cache, overdraw and vertex fetch, inside each material.
+		// The result is cached, so this only runs on import
+		if (indexed && !idx.empty()) {
+			VertexCacheStats before, after;
+			MeshOptimizer::optimize(vertexData, idx, materialSizes, before, after);
+			std::cout << "Optimized " << filePath << ": ACMR " << before.acmr << " -> " << after.acmr
+				<< ", ATVR " << before.atvr << " -> " << after.atvr << " (16-entry FIFO cache)" << std::endl;
+		}
+		numVertices = (int)vertexData.size();
+
+		// Tangents are generated while the indices are still 32-bit, and then cached with the rest of the mesh
+		std::chrono::high_resolution_clock::time_point tangentStart = std::chrono::high_resolution_clock::now();
+		TangentGenerator::generate(vertexData.data(), vertexData.size(), indexed ? idx.data() : NULL, idx.size());
+		tangentMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tangentStart).count();
+
+		if (indexed && !idx.empty())
+			generateLods(filePath, idx, materialSizes);
+		else
+			addLod(0, materialSizes, 0.0f);
+
+		numIndices = (int)idx.size();
+		indexSize = (numVertices <= 65536) ? 2 : 4;
+		if (indexed) {
+			if (indexSize == 2)
+				indices16.assign(idx.begin(), idx.end());
+			else
+				indices32.swap(idx);
+		}
+
+		// Axis-aligned bounds of the model
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		if (numVertices > 0) {
+			boundsMin = boundsMax = vertexData[0].position;
+			for (int i = 1; i < numVertices; i++) {
+				boundsMin = glm::min(boundsMin, vertexData[i].position);
+				boundsMax = glm::max(boundsMax, vertexData[i].position);
+			}
+		}
+	}
+
+	// Try to use the binary cache instead of parsing. Returns false if there is no usable cache
+	bool loadCache(const char * filePath, bool buildIndices) {
+		cacheFile = MeshCache::open(filePath, buildIndices, cacheHeader);
+		if (!cacheFile)
+			return false;
+
+		numVertices = (int)cacheHeader.numVertices;
+		numIndices = (int)cacheHeader.numIndices;
+		indexed = (cacheHeader.indexSize != 0);
+		indexSize = (cacheHeader.indexSize == 4) ? 4 : 2;
+		boundsMin = glm::vec3(cacheHeader.boundsMin[0], cacheHeader.boundsMin[1], cacheHeader.boundsMin[2]);
+		boundsMax = glm::vec3(cacheHeader.boundsMax[0], cacheHeader.boundsMax[1], cacheHeader.boundsMax[2]);
+		lods.assign(cacheHeader.lods, cacheHeader.lods + cacheHeader.numLods);
+
+		// Materials are small, so they are copied out of the mapping
+		const char * materials = cacheFile->getData() + cacheHeader.materialsOffset;
+		const MeshMaterialRange * ranges = (const MeshMaterialRange *)materials;
+		materialRanges.assign(ranges, ranges + cacheHeader.numMaterialRanges);
+
+		const char * strings = materials + cacheHeader.numMaterialRanges * sizeof(MeshMaterialRange);
+		const char * stringsEnd = strings + cacheHeader.materialStringsSize;
+		for (uint32_t i = 0; i < cacheHeader.numMaterialLibraries + cacheHeader.numMaterials && strings < stringsEnd; i++) {
+			std::string value(strings);
+			strings += value.size() + 1;
+			if (i < cacheHeader.numMaterialLibraries)
+				materialLibraries.push_back(value);
+			else
+				materialNames.push_back(value);
+		}
+		return true;
+	}
+
+	void writeCache(const char * filePath) {
+		if (numVertices == 0)
+			return;
+
+		MeshCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		header.numVertices = (uint32_t)numVertices;
+		header.numIndices = (uint32_t)numIndices;
+		header.indexSize = indexed ? (uint32_t)indexSize : 0;
+		header.numLods = (uint32_t)lods.size();
+		for (size_t i = 0; i < lods.size(); i++)
+			header.lods[i] = lods[i];
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = boundsMin[i];
+			header.boundsMax[i] = boundsMax[i];
+		}
+
+		header.numMaterialRanges = (uint32_t)materialRanges.size();
+		header.numMaterials = (uint32_t)materialNames.size();
+		header.numMaterialLibraries = (uint32_t)materialLibraries.size();
+		std::string strings;
+		for (size_t i = 0; i < materialLibraries.size(); i++)
+			strings.append(materialLibraries[i].c_str(), materialLibraries[i].size() + 1);
+		for (size_t i = 0; i < materialNames.size(); i++)
+			strings.append(materialNames[i].c_str(), materialNames[i].size() + 1);
+		MeshCache::write(filePath, header, getVertexStream().data, getIndexData(), materialRanges.data(), strings);
+	}
+
+public:
+
+	// An empty placeholder with nothing to draw, for a model that is still loading
+	ImportedModel() : numVertices(0), indexed(false), numIndices(0), indexSize(4), boundsMin(0.0f), boundsMax(0.0f),
+		importPeakBytes(0), tangentMilliseconds(0.0) {
+		memset(&quantizationStats, 0, sizeof(quantizationStats));
+		memset(&cacheHeader, 0, sizeof(cacheHeader));
+	}
+
+	// A model whose vertices were streamed straight into a vertex buffer (see MeshStreamer): unindexed, one level of
+	// detail, one unnamed material, and no CPU copy of the geometry
+	ImportedModel(const char * filePath, int streamedVertices, glm::vec3 streamedMin, glm::vec3 streamedMax, QuantizationStats stats)
+		: numVertices(streamedVertices), indexed(false), numIndices(0), indexSize(4), boundsMin(streamedMin), boundsMax(streamedMax),
+		quantizationStats(stats), name(filePath), importPeakBytes(0), tangentMilliseconds(0.0) {
+		memset(&cacheHeader, 0, sizeof(cacheHeader));
+		materialNames.assign(1, std::string());
+		addLod(0, std::vector<size_t>(1, (size_t)numVertices), 0.0f);
+	}
 
-		numVertices = modelImporter.getNumVertices();
-		std::vector<float> verts = modelImporter.getVertices();
-		std::vector<float> tcs = modelImporter.getTextureCoords();
-		std::vector<float> normals = modelImporter.getNormals();
+	// Create an instance of an imported model and allow it to be added to the vertex buffer object.
+	// Indexed models store each unique vertex once and are drawn with glDrawElements.
+	// With useCache, the model is read from its binary sidecar when it is up to date, and the sidecar is (re)written otherwise
+	ImportedModel(const char * filePath, bool buildIndices = true, ModelImporter::ParseMode parseMode = ModelImporter::PARSE_PARALLEL, bool useCache = true) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		importPeakBytes = 0;
+		tangentMilliseconds = 0.0;
+		name = filePath;
+		memset(&quantizationStats, 0, sizeof(quantizationStats));
 
-		// Push the vertices for the faces into the 3 main vectors
-		// 3 because the faces are all triangles
-		for (int i = 0; i < numVertices; i++) {
-			vertices.push_back(glm::vec3(verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]));
-			texCoords.push_back(glm::vec2(tcs[i * 2], tcs[i * 2 + 1]));
-			normalVecs.push_back(glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]));
-			tangents.push_back(glm::vec3(verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]));
+		if (useCache && loadCache(filePath, buildIndices)) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::cout << "Loaded " << filePath << " from its mesh cache in " << ms << " ms" << std::endl;
+			return;
 		}
+
+		importOBJ(filePath, buildIndices, parseMode);
+		std::cout << "Imported " << filePath << ": " << numVertices << " vertices, " << toMegabytes(getVertexStream().sizeInBytes())
+			<< " MB interleaved, importer peak " << toMegabytes(importPeakBytes) << " MB, tangents in " << tangentMilliseconds << " ms" << std::endl;
+
+		if (useCache)
+			writeCache(filePath);
+	}
+
+	// Drop the CPU copy of the geometry (or unmap the cache) once it lives on the GPU.
+	// Counts, bounds and index size stay valid; the data views become empty
+	void releaseCPUData() {
+		std::vector<Vertex>().swap(vertexData);
+		std::vector<PackedVertex>().swap(packedData);
+		std::vector<unsigned short>().swap(indices16);
+		std::vector<unsigned int>().swap(indices32);
+		cacheFile.reset();
 	}
 
 	// Accessor methods
@@ -43,20 +352,138 @@ public:
 		return numVertices;
 	}
 
+	// Non-owning view of the interleaved vertices, wherever they live
+	ArrayView<Vertex> getVertexStream() {
+		if (cacheFile)
+			return ArrayView<Vertex>((const Vertex *)(cacheFile->getData() + cacheHeader.verticesOffset), numVertices);
+		return ArrayView<Vertex>(vertexData.data(), vertexData.size());
+	}
+
+	// The vertices quantized to PackedVertex, relative to getBoundsMin()/getBoundsMax(). Packing happens on the first call
+	// and prints the error it introduced
+	ArrayView<PackedVertex> getPackedVertexStream() {
+		if (packedData.empty() && numVertices > 0 && !getVertexStream().empty()) {
+			quantizationStats = VertexQuantizer::pack(getVertexStream(), boundsMin, boundsMax, packedData);
+			std::cout << "Packed " << name << ": " << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " bytes per vertex, position error max "
+				<< quantizationStats.maxPositionError << " (avg " << quantizationStats.avgPositionError << "), normal error max "
+				<< quantizationStats.maxNormalError << " deg, tangent error max " << quantizationStats.maxTangentError
+				<< " deg, uv error max " << quantizationStats.maxTexCoordError << std::endl;
+		}
+		return ArrayView<PackedVertex>(packedData.data(), packedData.size());
+	}
+
+	QuantizationStats getQuantizationStats() {
+		return quantizationStats;
+	}
+
+	// Copies of the individual attributes, for code that still wants separate arrays
 	std::vector<glm::vec3> getVertices() {
-		return vertices;
+		std::vector<glm::vec3> result;
+		ArrayView<Vertex> stream = getVertexStream();
+		for (size_t i = 0; i < stream.size(); i++)
+			result.push_back(stream[i].position);
+		return result;
 	}
 
 	std::vector<glm::vec2> getTextureCoords() {
-		return texCoords;
+		std::vector<glm::vec2> result;
+		ArrayView<Vertex> stream = getVertexStream();
+		for (size_t i = 0; i < stream.size(); i++)
+			result.push_back(stream[i].texCoord);
+		return result;
 	}
 
 	std::vector<glm::vec3> getNormals() {
-		return normalVecs;
+		std::vector<glm::vec3> result;
+		ArrayView<Vertex> stream = getVertexStream();
+		for (size_t i = 0; i < stream.size(); i++)
+			result.push_back(stream[i].normal);
+		return result;
+	}
+
+	// Per-vertex tangents; w is the bitangent sign
+	std::vector<glm::vec4> getTangents() {
+		std::vector<glm::vec4> result;
+		ArrayView<Vertex> stream = getVertexStream();
+		for (size_t i = 0; i < stream.size(); i++)
+			result.push_back(stream[i].tangent);
+		return result;
+	}
+
+	bool isIndexed() {
+		return indexed;
+	}
+
+	// Indices of all levels of detail together
+	int getNumIndices() {
+		return numIndices;
+	}
+
+	// False for the empty placeholder
+	bool isLoaded() {
+		return !lods.empty();
+	}
+
+	int getNumLods() {
+		return (int)lods.size();
+	}
+
+	// Index range of level of detail i (0 = full detail)
+	MeshLod getLod(int i) {
+		return lods[i];
+	}
+
+	// Material range j of level of detail lod (j < getLod(lod).numMaterialRanges)
+	MeshMaterialRange getMaterialRange(int lod, int j) {
+		return materialRanges[lods[lod].firstMaterialRange + j];
+	}
+
+	// Material names in the OBJ ("" for faces without usemtl)
+	int getNumMaterials() {
+		return (int)materialNames.size();
+	}
+
+	std::string getMaterialName(int i) {
+		return materialNames[i];
+	}
+
+	// The OBJ's mtllib files, relative to its folder
+	std::vector<std::string> getMaterialLibraries() {
+		return materialLibraries;
+	}
+
+	// Bytes per index (2 or 4)
+	int getIndexSize() {
+		return indexSize;
+	}
+
+	// Raw index data ready for GL_ELEMENT_ARRAY_BUFFER (NULL once released)
+	const void * getIndexData() {
+		if (cacheFile)
+			return cacheFile->getData() + cacheHeader.indicesOffset;
+		if (!indices32.empty())
+			return indices32.data();
+		return indices16.empty() ? NULL : indices16.data();
+	}
+
+	glm::vec3 getBoundsMin() {
+		return boundsMin;
+	}
+
+	glm::vec3 getBoundsMax() {
+		return boundsMax;
+	}
+
+	bool isFromCache() {
+		return (bool)cacheFile;
+	}
+
+	size_t getImportPeakBytes() {
+		return importPeakBytes;
 	}
 
-	std::vector<glm::vec3> getTangents() {
-		return tangents;
+	double getTangentMilliseconds() {
+		return tangentMilliseconds;
 	}
 
 };
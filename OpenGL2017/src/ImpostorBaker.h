@@ -0,0 +1,129 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class renders a model offscreen from gridSize x gridSize directions spread over an octahedron, into an
+ *              albedo atlas and an object-space normal atlas. Far away, the model can then be drawn as one camera-facing quad
+ *              that blends the views closest to the real viewing direction (see vertImpostorShader_F.glsl)
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ShaderProgram.h"
+#include "VertexQuantizer.h"
+
+// A baked impostor: the two atlases and the bounding sphere they were rendered around
+struct Impostor {
+	GLuint albedoAtlas;
+	GLuint normalAtlas;
+	int gridSize;
+	glm::vec3 center;
+	float radius;
+};
+
+class ImpostorBaker {
+
+private:
+	static GLuint createAtlas(int size) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		// Deeper mip levels would bleed neighbouring views into each other
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
+		return texture;
+	}
+
+public:
+	// Direction (object space, from the model towards the camera) of the view stored in cell (x, y)
+	static glm::vec3 cellDirection(int x, int y, int gridSize) {
+		glm::vec2 e(((x + 0.5f) / gridSize) * 2.0f - 1.0f, ((y + 0.5f) / gridSize) * 2.0f - 1.0f);
+		return VertexQuantizer::octDecode(e);
+	}
+
+	// Up vector used to orient a view looking along direction. The impostor shader uses the same rule
+	static glm::vec3 upVector(glm::vec3 direction) {
+		return (std::fabs(direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	// Render the model around its bounds into a new impostor. bakeProgram must be in use, and drawModel must bind the
+	// model's buffers and textures and draw it. The framebuffer and viewport are reset to the window afterwards
+	static Impostor bake(const ShaderProgram & bakeProgram, glm::vec3 boundsMin, glm::vec3 boundsMax, std::function<void()> drawModel,
+		int windowWidth, int windowHeight, int gridSize = 8, int cellSize = 128) {
+		Impostor impostor;
+		impostor.gridSize = gridSize;
+		impostor.center = (boundsMin + boundsMax) * 0.5f;
+		impostor.radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+		int atlasSize = gridSize * cellSize;
+		impostor.albedoAtlas = createAtlas(atlasSize);
+		impostor.normalAtlas = createAtlas(atlasSize);
+
+		GLuint depth;
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+
+		GLuint fbo;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostor.albedoAtlas, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, impostor.normalAtlas, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+		GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cout << "Impostor framebuffer is incomplete" << std::endl;
+		}
+		else {
+			// Transparent everywhere the model doesn't cover, so the impostor can be alpha tested
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glEnable(GL_DEPTH_TEST);
+			glDisable(GL_CULL_FACE);
+
+			Uniform<glm::mat4> mvMatrix = bakeProgram.uniform<glm::mat4>("mv_matrix");
+			Uniform<glm::mat4> projMatrix = bakeProgram.uniform<glm::mat4>("proj_matrix");
+
+			// Orthographic, just big enough for the bounding sphere
+			float r = impostor.radius;
+			bakeProgram.set(projMatrix, glm::ortho(-r, r, -r, r, 0.5f * r, 3.5f * r));
+
+			for (int y = 0; y < gridSize; y++) {
+				for (int x = 0; x < gridSize; x++) {
+					glm::vec3 direction = cellDirection(x, y, gridSize);
+					glm::mat4 view = glm::lookAt(impostor.center + direction * (2.0f * r), impostor.center, upVector(direction));
+					bakeProgram.set(mvMatrix, view);
+
+					glViewport(x * cellSize, y * cellSize, cellSize, cellSize);
+					drawModel();
+				}
+			}
+
+			glBindTexture(GL_TEXTURE_2D, impostor.albedoAtlas);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glBindTexture(GL_TEXTURE_2D, impostor.normalAtlas);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &depth);
+		glViewport(0, 0, windowWidth, windowHeight);
+
+		std::cout << "Baked a " << gridSize << "x" << gridSize << " impostor (" << atlasSize << "x" << atlasSize << " atlases)" << std::endl;
+		return impostor;
+	}
+
+};
@@ -0,0 +1,304 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class reads and writes block compressed 2D textures with their mipmap chain as KTX2 files
+ *              (the Khronos container, so the cache can be inspected with the KTX tools). Files are memory mapped
+ *              and the levels are uploaded straight from the mapping. Only what TextureCache writes is read back:
+ *              BC1, BC3 or BC7, one layer, one face, no supercompression
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+
+// Where one mipmap level's blocks are
+struct KtxLevel {
+	int width, height;
+	size_t offset;
+	size_t size;
+};
+
+// A compressed texture, either read from a KTX2 file or freshly encoded
+struct CompressedTexture {
+	BlockFormat format;
+	int width, height;
+	std::vector<KtxLevel> levels;		// Level 0 (full size) first
+	std::shared_ptr<MappedFile> file;	// Levels are offsets into the mapped file...
+	std::vector<unsigned char> memory;	// ...or into this if there is no file
+
+	const unsigned char * getLevelData(size_t level) const {
+		const unsigned char * base = file ? (const unsigned char *)file->getData() : memory.data();
+		return base + levels[level].offset;
+	}
+
+	// Bytes of all levels together
+	size_t getBytes() const {
+		size_t bytes = 0;
+		for (size_t i = 0; i < levels.size(); i++)
+			bytes += levels[i].size;
+		return bytes;
+	}
+};
+
+// One key/value pair from a KTX2 file. offset is where the value starts in the file, so it can be patched in place
+struct KtxValue {
+	size_t offset;
+	std::string value;
+};
+
+class KtxFile {
+
+private:
+	static const unsigned char IDENTIFIER[12];
+
+	// Vulkan formats of the block formats
+	static const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+	static const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+	static const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+
+	// Khronos data format descriptor values
+	static const uint32_t KHR_DF_MODEL_BC1A = 128;
+	static const uint32_t KHR_DF_MODEL_BC3 = 130;
+	static const uint32_t KHR_DF_MODEL_BC7 = 134;
+	static const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+	static const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+	static const uint32_t KHR_DF_CHANNEL_COLOR = 0;
+	static const uint32_t KHR_DF_CHANNEL_ALPHA = 15;
+
+	// Sizes of the fixed parts: identifier, header, index, and one entry of the level index
+	static const size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+	static const size_t LEVEL_INDEX_ENTRY_SIZE = 3 * 8;
+
+	static uint32_t vkFormat(BlockFormat format) {
+		if (format == BLOCK_BC1)
+			return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		if (format == BLOCK_BC3)
+			return VK_FORMAT_BC3_UNORM_BLOCK;
+		return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+
+	static bool blockFormat(uint32_t vk, BlockFormat & format) {
+		if (vk == VK_FORMAT_BC1_RGB_UNORM_BLOCK)
+			format = BLOCK_BC1;
+		else if (vk == VK_FORMAT_BC3_UNORM_BLOCK)
+			format = BLOCK_BC3;
+		else if (vk == VK_FORMAT_BC7_UNORM_BLOCK)
+			format = BLOCK_BC7;
+		else
+			return false;
+		return true;
+	}
+
+	static void put32(std::vector<unsigned char> & out, uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			out.push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	static void set32(std::vector<unsigned char> & out, size_t at, uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			out[at + i] = (unsigned char)(value >> (8 * i));
+	}
+
+	static void set64(std::vector<unsigned char> & out, size_t at, uint64_t value) {
+		for (int i = 0; i < 8; i++)
+			out[at + i] = (unsigned char)(value >> (8 * i));
+	}
+
+	static uint32_t get32(const unsigned char * bytes) {
+		return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+	}
+
+	static uint64_t get64(const unsigned char * bytes) {
+		return (uint64_t)get32(bytes) | ((uint64_t)get32(bytes + 4) << 32);
+	}
+
+	static void pad(std::vector<unsigned char> & out, size_t alignment) {
+		while (out.size() % alignment != 0)
+			out.push_back(0);
+	}
+
+	// The basic data format descriptor of a block format: one sample per 64-bit half of the block
+	static void putDescriptor(std::vector<unsigned char> & out, BlockFormat format) {
+		uint32_t numSamples = (format == BLOCK_BC3) ? 2 : 1;
+		uint32_t blockBytes = (uint32_t)BlockCompressor::getBlockBytes(format);
+		uint32_t model = (format == BLOCK_BC1) ? KHR_DF_MODEL_BC1A : ((format == BLOCK_BC3) ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC7);
+
+		put32(out, 4 + 24 + 16 * numSamples);				// dfdTotalSize
+		put32(out, 0);										// vendorId 0 (Khronos), descriptorType 0 (basic)
+		put32(out, 2 | ((24 + 16 * numSamples) << 16));		// versionNumber 2, descriptorBlockSize
+		put32(out, model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+		put32(out, 3 | (3 << 8));							// 4x4x1x1 texel blocks (stored minus one)
+		put32(out, blockBytes);								// bytesPlane0
+		put32(out, 0);
+
+		if (format == BLOCK_BC3) {
+			put32(out, 0 | (63 << 16) | (KHR_DF_CHANNEL_ALPHA << 24));	// Bits 0-63: alpha
+			put32(out, 0);
+			put32(out, 0);
+			put32(out, 0xFFFFFFFF);
+		}
+		uint32_t colorOffset = (format == BLOCK_BC3) ? 64 : 0;
+		put32(out, colorOffset | ((blockBytes * 8 - 1 - colorOffset) << 16) | (KHR_DF_CHANNEL_COLOR << 24));
+		put32(out, 0);
+		put32(out, 0);
+		put32(out, 0xFFFFFFFF);
+	}
+
+public:
+	// Write texture (all its levels) and the key/value pairs to path. Values are stored as given, so strings should
+	// include their '\0'. Written under a temporary name and renamed, like the mesh cache
+	static bool write(const std::string & path, const CompressedTexture & texture, const std::map<std::string, std::string> & keyValues) {
+		std::vector<unsigned char> out(IDENTIFIER, IDENTIFIER + 12);
+		put32(out, vkFormat(texture.format));
+		put32(out, 1);							// typeSize
+		put32(out, (uint32_t)texture.width);
+		put32(out, (uint32_t)texture.height);
+		put32(out, 0);							// pixelDepth
+		put32(out, 0);							// layerCount (not an array)
+		put32(out, 1);							// faceCount
+		put32(out, (uint32_t)texture.levels.size());
+		put32(out, 0);							// supercompressionScheme
+
+		// Index, filled in once the sizes are known
+		size_t indexAt = out.size();
+		out.resize(out.size() + 4 * 4 + 2 * 8, 0);
+		size_t levelIndexAt = out.size();
+		out.resize(out.size() + texture.levels.size() * LEVEL_INDEX_ENTRY_SIZE, 0);
+
+		size_t dfdOffset = out.size();
+		putDescriptor(out, texture.format);
+		size_t dfdLength = out.size() - dfdOffset;
+
+		// std::map keeps the keys sorted, as the format asks
+		size_t kvdOffset = out.size();
+		for (std::map<std::string, std::string>::const_iterator i = keyValues.begin(); i != keyValues.end(); ++i) {
+			put32(out, (uint32_t)(i->first.size() + 1 + i->second.size()));
+			out.insert(out.end(), i->first.begin(), i->first.end());
+			out.push_back(0);
+			out.insert(out.end(), i->second.begin(), i->second.end());
+			pad(out, 4);
+		}
+		size_t kvdLength = out.size() - kvdOffset;
+
+		set32(out, indexAt, (uint32_t)dfdOffset);
+		set32(out, indexAt + 4, (uint32_t)dfdLength);
+		set32(out, indexAt + 8, (uint32_t)(keyValues.empty() ? 0 : kvdOffset));
+		set32(out, indexAt + 12, (uint32_t)kvdLength);
+
+		// Levels go smallest first, each aligned to its block size
+		size_t alignment = (size_t)BlockCompressor::getBlockBytes(texture.format);
+		for (size_t level = texture.levels.size(); level-- > 0; ) {
+			pad(out, alignment);
+			size_t entry = levelIndexAt + level * LEVEL_INDEX_ENTRY_SIZE;
+			set64(out, entry, out.size());
+			set64(out, entry + 8, texture.levels[level].size);
+			set64(out, entry + 16, texture.levels[level].size);
+			const unsigned char * data = texture.getLevelData(level);
+			out.insert(out.end(), data, data + texture.levels[level].size);
+		}
+
+		std::string tempPath = path + ".tmp";
+		std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write((const char *)out.data(), (std::streamsize)out.size());
+		file.close();
+		if (!file) {
+			std::remove(tempPath.c_str());
+			std::cout << "Could not write texture cache " << path << std::endl;
+			return false;
+		}
+
+		// rename() won't replace an existing file on Windows
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Map the KTX2 file at path into texture and read its key/value pairs. Returns false (quietly if the file doesn't
+	// exist, with the reason otherwise) if it can't be read or holds something other than a 2D BC1/BC3/BC7 texture
+	static bool read(const std::string & path, CompressedTexture & texture, std::map<std::string, KtxValue> & keyValues) {
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(path.c_str()))
+			return false;
+
+		const unsigned char * bytes = (const unsigned char *)file->getData();
+		size_t size = file->getSize();
+		if (size < HEADER_SIZE || memcmp(bytes, IDENTIFIER, 12) != 0) {
+			std::cout << "Texture cache " << path << " is not a KTX2 file" << std::endl;
+			return false;
+		}
+
+		const unsigned char * header = bytes + 12;
+		uint32_t numLevels = get32(header + 28);
+		if (!blockFormat(get32(header), texture.format) || get32(header + 16) != 0 || get32(header + 20) > 1 || get32(header + 24) != 1
+			|| numLevels == 0 || numLevels > 32 || get32(header + 32) != 0) {
+			std::cout << "Texture cache " << path << " holds a kind of texture that isn't supported" << std::endl;
+			return false;
+		}
+		texture.width = (int)get32(header + 8);
+		texture.height = (int)get32(header + 12);
+
+		// Every level has to be inside the file and exactly as big as its size says
+		if (HEADER_SIZE + numLevels * LEVEL_INDEX_ENTRY_SIZE > size) {
+			std::cout << "Texture cache " << path << " is truncated" << std::endl;
+			return false;
+		}
+		texture.levels.resize(numLevels);
+		for (uint32_t level = 0; level < numLevels; level++) {
+			const unsigned char * entry = bytes + HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+			KtxLevel & l = texture.levels[level];
+			l.width = std::max(1, texture.width >> level);
+			l.height = std::max(1, texture.height >> level);
+			uint64_t offset = get64(entry), length = get64(entry + 8);
+			if (length != BlockCompressor::getImageBytes(texture.format, l.width, l.height) || offset > size || length > size - offset) {
+				std::cout << "Texture cache " << path << " is truncated" << std::endl;
+				return false;
+			}
+			l.offset = (size_t)offset;
+			l.size = (size_t)length;
+		}
+
+		uint32_t kvdOffset = get32(bytes + 12 + 36 + 8), kvdLength = get32(bytes + 12 + 36 + 12);
+		if (kvdOffset > size || kvdLength > size - kvdOffset) {
+			std::cout << "Texture cache " << path << " is truncated" << std::endl;
+			return false;
+		}
+		keyValues.clear();
+		for (size_t at = kvdOffset; at + 4 <= (size_t)kvdOffset + kvdLength; ) {
+			uint32_t length = get32(bytes + at);
+			if (length > kvdOffset + kvdLength - at - 4)
+				break;
+			const char * pair = (const char *)bytes + at + 4;
+			const char * end = (const char *)memchr(pair, 0, length);
+			if (end != NULL) {
+				size_t keyLength = (size_t)(end - pair);
+				KtxValue value;
+				value.offset = at + 4 + keyLength + 1;
+				value.value.assign(pair + keyLength + 1, length - keyLength - 1);
+				keyValues[std::string(pair, keyLength)] = value;
+			}
+			at += 4 + ((length + 3) & ~3u);
+		}
+
+		texture.file = file;
+		texture.memory.clear();
+		return true;
+	}
+
+};
+
+// «KTX 20»\r\n\x1A\n
+const unsigned char KtxFile::IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
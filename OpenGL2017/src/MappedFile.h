@@ -0,0 +1,156 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class maps a file into memory (read-only) so it can be parsed in place without copying it
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+
+private:
+	const char * data;
+	size_t size;
+
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	// Mapped views can't be shared between two owners
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+public:
+	// Blank constructor
+	MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+		fileHandle = INVALID_HANDLE_VALUE;
+		mappingHandle = NULL;
+#else
+		fileDescriptor = -1;
+#endif
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	// Map the whole file. Returns false if the file could not be opened or mapped
+	bool open(const char * filePath) {
+		close();
+
+#ifdef _WIN32
+		fileHandle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize)) {
+			close();
+			return false;
+		}
+		size = (size_t)fileSize.QuadPart;
+
+		// Windows refuses to map empty files, but an empty file is still a valid (empty) file
+		if (size == 0)
+			return true;
+
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle == NULL) {
+			close();
+			return false;
+		}
+
+		data = (const char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL) {
+			close();
+			return false;
+		}
+#else
+		fileDescriptor = ::open(filePath, O_RDONLY);
+		if (fileDescriptor < 0)
+			return false;
+
+		struct stat fileInfo;
+		if (fstat(fileDescriptor, &fileInfo) != 0) {
+			close();
+			return false;
+		}
+		size = (size_t)fileInfo.st_size;
+
+		if (size == 0)
+			return true;
+
+		void * view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (view == MAP_FAILED) {
+			close();
+			return false;
+		}
+		data = (const char *)view;
+
+		// We read front to back, so let the kernel read ahead aggressively
+		madvise(view, size, MADV_SEQUENTIAL);
+#endif
+		return true;
+	}
+
+	// Unmap the file and release the handles
+	void close() {
+#ifdef _WIN32
+		if (data != NULL)
+			UnmapViewOfFile(data);
+		if (mappingHandle != NULL)
+			CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+		mappingHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (data != NULL)
+			munmap((void *)data, size);
+		if (fileDescriptor >= 0)
+			::close(fileDescriptor);
+		fileDescriptor = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	// Accessor methods
+	const char * getData() const {
+		return data;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+
+	bool isOpen() const {
+#ifdef _WIN32
+		return fileHandle != INVALID_HANDLE_VALUE;
+#else
+		return fileDescriptor >= 0;
+#endif
+	}
+
+};
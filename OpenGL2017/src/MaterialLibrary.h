@@ -0,0 +1,307 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps the materials of every imported model in one list. It reads the MTL files the OBJs name,
+ *              merges materials and textures that are the same across models, and remembers which layer of which
+ *              texture array each diffuse map was uploaded to, so drawing a material only changes a layer uniform
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ImportedModel.h"
+
+// A texture uploaded into one layer of a GL_TEXTURE_2D_ARRAY (array 0 if it couldn't be read)
+struct TextureLayer {
+	GLuint array;
+	int layer;
+};
+
+// Ka, Kd, Ks, Ns and map_Kd of one material
+struct Material {
+	std::string name;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float shininess;
+	std::string diffuseMap;	// Path from the working directory, "" for none
+	int diffuseTexture;		// Index into the library's textures, -1 for none
+};
+
+class MaterialLibrary {
+
+private:
+	std::vector<Material> materials;
+
+	// Every distinct diffuse map, where it was uploaded, and whether its upload has come back yet
+	std::vector<std::string> texturePaths;
+	std::vector<TextureLayer> textureLayers;
+	std::vector<bool> textureArrived;
+	size_t numTexturesRequested;
+
+	// Parsed MTL files by path, and materials that exist without one (usemtl gold)
+	std::map<std::string, std::vector<Material>> files;
+	std::map<std::string, Material> presets;
+
+	// 1x1 arrays standing in for maps that haven't loaded (grey) and for materials without one (white)
+	TextureLayer placeholderLayer;
+	TextureLayer whiteLayer;
+
+	static std::string folderOf(const std::string & path) {
+		size_t slash = path.find_last_of("/\\");
+		return (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+	}
+
+	static glm::vec4 readColor(std::istringstream & in) {
+		float r = 0.0f, g = 0.0f, b = 0.0f;
+		in >> r >> g >> b;
+		return glm::vec4(r, g, b, 1.0f);
+	}
+
+	// The rest of a line after its keyword, without surrounding blanks
+	static std::string readName(std::istringstream & in) {
+		std::string rest;
+		std::getline(in, rest);
+		size_t first = rest.find_first_not_of(" \t\r");
+		size_t last = rest.find_last_not_of(" \t\r");
+		return (first == std::string::npos) ? std::string() : rest.substr(first, last - first + 1);
+	}
+
+	static Material untextured(const std::string & name) {
+		Material material;
+		material.name = name;
+		material.ambient = glm::vec4(0.2f, 0.2f, 0.2f, 1.0f);
+		material.diffuse = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f);
+		material.specular = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		material.shininess = 0.0f;
+		material.diffuseTexture = -1;
+		return material;
+	}
+
+	// Read the materials of an MTL file (the parts we draw with). Maps are made relative to the working directory
+	static bool parseFile(const std::string & path, std::vector<Material> & out) {
+		std::ifstream fileStream(path.c_str(), std::ios::in);
+		if (!fileStream) {
+			std::cout << "Could not open material library " << path << std::endl;
+			return false;
+		}
+
+		std::string folder = folderOf(path);
+		std::string line;
+		while (std::getline(fileStream, line)) {
+			std::istringstream ss(line);
+			std::string keyword;
+			ss >> keyword;
+
+			if (keyword == "newmtl") {
+				out.push_back(untextured(readName(ss)));
+				continue;
+			}
+			if (out.empty())
+				continue;
+
+			Material & material = out.back();
+			if (keyword == "Ka") {
+				material.ambient = readColor(ss);
+			}
+			else if (keyword == "Kd") {
+				material.diffuse = readColor(ss);
+			}
+			else if (keyword == "Ks") {
+				material.specular = readColor(ss);
+			}
+			else if (keyword == "Ns") {
+				ss >> material.shininess;
+			}
+			else if (keyword == "map_Kd") {
+				// Options (-s 1 1 1, -clamp on, ...) come first and the file name last
+				std::string token, file;
+				while (ss >> token)
+					file = token;
+				if (!file.empty())
+					material.diffuseMap = folder + file;
+			}
+		}
+		return true;
+	}
+
+	static GLuint createSolidArray(unsigned char r, unsigned char g, unsigned char b) {
+		unsigned char pixel[4] = { r, g, b, 255 };
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return texture;
+	}
+
+	static bool sameColor(const glm::vec4 & a, const glm::vec4 & b) {
+		return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+	}
+
+public:
+	MaterialLibrary() : numTexturesRequested(0) {
+		placeholderLayer.array = 0;
+		placeholderLayer.layer = 0;
+		whiteLayer = placeholderLayer;
+	}
+
+	// Needs the GL context
+	void createPlaceholders() {
+		placeholderLayer.array = createSolidArray(128, 128, 128);
+		whiteLayer.array = createSolidArray(255, 255, 255);
+	}
+
+	// Index of the texture at path, added if it is new
+	int addTexture(const std::string & path) {
+		for (size_t i = 0; i < texturePaths.size(); i++) {
+			if (texturePaths[i] == path)
+				return (int)i;
+		}
+		texturePaths.push_back(path);
+		textureLayers.push_back(placeholderLayer);
+		textureArrived.push_back(false);
+		return (int)texturePaths.size() - 1;
+	}
+
+	// Index of the material, added if no material with the same name, colors and map exists yet
+	int addMaterial(Material material) {
+		material.diffuseTexture = material.diffuseMap.empty() ? -1 : addTexture(material.diffuseMap);
+		for (size_t i = 0; i < materials.size(); i++) {
+			const Material & m = materials[i];
+			if (m.name == material.name && m.diffuseTexture == material.diffuseTexture && m.shininess == material.shininess
+				&& sameColor(m.ambient, material.ambient) && sameColor(m.diffuse, material.diffuse) && sameColor(m.specular, material.specular))
+				return (int)i;
+		}
+		materials.push_back(material);
+		return (int)materials.size() - 1;
+	}
+
+	// A material with default colors and a diffuse map, for models that don't come with an MTL file
+	int addTextured(const std::string & name, const std::string & texturePath) {
+		Material material = untextured(name);
+		material.diffuse = glm::vec4(1.0f);
+		material.diffuseMap = texturePath;
+		return addMaterial(material);
+	}
+
+	// A material OBJs can use by name without an MTL file
+	void addPreset(const std::string & name, const float * ambient, const float * diffuse, const float * specular, float shininess) {
+		Material material = untextured(name);
+		material.ambient = glm::vec4(ambient[0], ambient[1], ambient[2], ambient[3]);
+		material.diffuse = glm::vec4(diffuse[0], diffuse[1], diffuse[2], diffuse[3]);
+		material.specular = glm::vec4(specular[0], specular[1], specular[2], specular[3]);
+		material.shininess = shininess;
+		presets[name] = material;
+	}
+
+	// Material indices for each of model's materials, in the model's order. Names are looked up in the model's MTL files
+	// (relative to objPath), then in the presets. Faces without a material, and names that aren't found, are drawn with
+	// fallbackTexture
+	std::vector<int> resolve(ImportedModel & model, const char * objPath, const std::string & fallbackTexture) {
+		std::string folder = folderOf(objPath);
+		std::vector<std::string> libraries = model.getMaterialLibraries();
+		for (size_t i = 0; i < libraries.size(); i++) {
+			std::string path = folder + libraries[i];
+			if (files.find(path) == files.end())
+				parseFile(path, files[path]);
+		}
+
+		std::vector<int> result;
+		for (int m = 0; m < model.getNumMaterials(); m++) {
+			std::string name = model.getMaterialName(m);
+			const Material * found = NULL;
+			for (size_t i = 0; i < libraries.size() && found == NULL && !name.empty(); i++) {
+				const std::vector<Material> & fileMaterials = files[folder + libraries[i]];
+				for (size_t j = 0; j < fileMaterials.size() && found == NULL; j++) {
+					if (fileMaterials[j].name == name)
+						found = &fileMaterials[j];
+				}
+			}
+			if (found == NULL && presets.find(name) != presets.end())
+				found = &presets[name];
+
+			if (found != NULL) {
+				result.push_back(addMaterial(*found));
+			}
+			else {
+				if (!name.empty())
+					std::cout << "Material " << name << " of " << objPath << " not found, using " << fallbackTexture << std::endl;
+				result.push_back(addTextured(name, fallbackTexture));
+			}
+		}
+		return result;
+	}
+
+	// Textures added since the last call, to be loaded in one batch
+	std::vector<int> takeNewTextures() {
+		std::vector<int> result;
+		for (size_t i = numTexturesRequested; i < texturePaths.size(); i++)
+			result.push_back((int)i);
+		numTexturesRequested = texturePaths.size();
+		return result;
+	}
+
+	std::string getTexturePath(int texture) {
+		return texturePaths[texture];
+	}
+
+	// Called once the texture has been uploaded (or failed to load, with array 0)
+	void setTextureLayer(int texture, TextureLayer layer) {
+		textureLayers[texture] = (layer.array != 0) ? layer : placeholderLayer;
+		textureArrived[texture] = true;
+	}
+
+	// Where material's diffuse map lives: the grey placeholder until it has loaded, the white layer without one
+	TextureLayer getTextureLayer(int material) {
+		if (material < 0)
+			return placeholderLayer;
+		int texture = materials[material].diffuseTexture;
+		return (texture < 0) ? whiteLayer : textureLayers[texture];
+	}
+
+	// What the diffuse map is multiplied by: Kd for materials without a map, white for the rest (exporters write
+	// Kd 0.8 next to maps that already have the color)
+	glm::vec4 getBaseColor(int material) {
+		if (material < 0 || materials[material].diffuseTexture >= 0)
+			return glm::vec4(1.0f);
+		return materials[material].diffuse;
+	}
+
+	// How blurry the material's reflections are: the GGX roughness of its Phong exponent Ns, or 0 (a mirror) without one
+	float getRoughness(int material) {
+		if (material < 0 || materials[material].shininess <= 0.0f)
+			return 0.0f;
+		return std::sqrt(2.0f / (materials[material].shininess + 2.0f));
+	}
+
+	// Whether the material's map has come back from the loader (always true without a map)
+	bool isReady(int material) {
+		if (material < 0)
+			return false;
+		int texture = materials[material].diffuseTexture;
+		return texture < 0 || textureArrived[texture];
+	}
+
+	Material getMaterial(int material) {
+		return materials[material];
+	}
+
+	int getNumMaterials() {
+		return (int)materials.size();
+	}
+
+	int getNumTextures() {
+		return (int)texturePaths.size();
+	}
+
+};
@@ -0,0 +1,67 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: Functions that report how much memory the process is using, for load-time diagnostics
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Bytes currently resident in RAM (working set)
+inline size_t getCurrentResidentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (size_t)counters.WorkingSetSize;
+	return 0;
+#else
+	long pages = 0;
+	FILE * statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+		return 0;
+	if (fscanf(statm, "%*s %ld", &pages) != 1)
+		pages = 0;
+	fclose(statm);
+	return (size_t)pages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Highest number of bytes that have been resident at once since the process started
+inline size_t getPeakResidentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (size_t)counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+inline double toMegabytes(size_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
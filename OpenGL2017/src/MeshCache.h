@@ -0,0 +1,205 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class reads and writes the binary sidecar (<file>.obj.indexed.meshcache, or .arrays.meshcache for
+ *              models drawn without indices) that lets a model skip OBJ parsing. The cache is memory mapped and its
+ *              interleaved vertex stream is handed to the GPU as it is
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "FileInfo.h"
+#include "MappedFile.h"
+#include "Vertex.h"
+
+// Most levels of detail a mesh can have, including the full detail one
+const uint32_t MESH_MAX_LODS = 4;
+
+// Index range of one level of detail inside the index stream
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	float error;					// Simplification error relative to the largest dimension of the mesh (0 for full detail)
+	uint32_t firstMaterialRange;	// This level's material ranges
+	uint32_t numMaterialRanges;
+};
+
+// Triangles of one material inside a level of detail (vertices instead of indices for models drawn without indices)
+struct MeshMaterialRange {
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	uint32_t material;				// Index into the model's material names
+	uint32_t reserved;
+};
+
+// Fixed-size header at the start of every cache file. The vertex stream and the indices follow it, each starting on a 16-byte boundary
+struct MeshCacheHeader {
+	char magic[4];					// "OGLM"
+	uint32_t version;
+	uint64_t sourceSize;			// Size, modification time and FNV-1a hash of the OBJ the cache was built from
+	int64_t sourceModified;
+	uint64_t sourceHash;
+	uint32_t numVertices;
+	uint32_t numIndices;			// All levels of detail together
+	uint32_t indexSize;				// 2 or 4, or 0 for a model drawn without indices
+	uint32_t reserved;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t vertexStride;			// sizeof(Vertex) when the cache was written
+	uint32_t reserved2;
+	uint64_t verticesOffset;		// Interleaved Vertex stream
+	uint64_t indicesOffset;			// numIndices * indexSize bytes
+	uint64_t fileSize;
+	uint32_t numLods;
+	uint32_t reserved3;
+	MeshLod lods[MESH_MAX_LODS];
+	uint32_t numMaterialRanges;		// All levels of detail together
+	uint32_t numMaterials;
+	uint32_t numMaterialLibraries;
+	uint32_t materialStringsSize;	// Library paths, then material names, each '\0'-terminated
+	uint64_t materialsOffset;		// The MeshMaterialRanges, then the strings
+};
+
+class MeshCache {
+
+private:
+	static uint64_t alignUp(uint64_t value) {
+		return (value + 15) & ~(uint64_t)15;
+	}
+
+	static void writePadding(std::ofstream & out, uint64_t & written) {
+		static const char zeros[16] = { 0 };
+		uint64_t aligned = alignUp(written);
+		out.write(zeros, (std::streamsize)(aligned - written));
+		written = aligned;
+	}
+
+public:
+	// Version 2: one interleaved vertex stream instead of separate position/texcoord/normal streams
+	// Version 3: vertices carry generated tangents
+	// Version 4: indexed meshes are stored in vertex cache / overdraw / fetch optimized order
+	// Version 5: levels of detail
+	// Version 6: material ranges and names
+	// Version 7: each level of detail simplified from the one before
+	// Version 8: seams collapse along themselves instead of being locked
+	static const uint32_t VERSION = 8;
+
+	// The sidecar sits next to the OBJ. Each layout has its own, so programs loading the same OBJ indexed and not
+	// don't keep rebuilding each other's cache
+	static std::string cachePath(const char * objPath, bool indexed) {
+		return std::string(objPath) + (indexed ? ".indexed.meshcache" : ".arrays.meshcache");
+	}
+
+	// Map the cache for objPath if it exists, matches the requested layout and is not stale. Returns NULL otherwise.
+	// A cache whose OBJ was only touched (same size and hash) is kept and its timestamp refreshed
+	static std::shared_ptr<MappedFile> open(const char * objPath, bool indexed, MeshCacheHeader & header) {
+		std::string path = cachePath(objPath, indexed);
+
+		std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+		if (!in.read((char *)&header, sizeof(header)))
+			return std::shared_ptr<MappedFile>();
+		in.close();
+
+		if (memcmp(header.magic, "OGLM", 4) != 0 || header.version != VERSION || header.vertexStride != sizeof(Vertex))
+			return std::shared_ptr<MappedFile>();
+		if ((header.indexSize != 0) != indexed || header.numLods == 0 || header.numLods > MESH_MAX_LODS || header.numMaterials == 0)
+			return std::shared_ptr<MappedFile>();
+
+		uint64_t sourceSize;
+		int64_t sourceModified;
+		if (FileInfo::getSourceInfo(objPath, sourceSize, sourceModified)) {
+			if (sourceSize != header.sourceSize) {
+				std::cout << "Mesh cache " << path << " is stale (size changed), rebuilding" << std::endl;
+				return std::shared_ptr<MappedFile>();
+			}
+			if (sourceModified != header.sourceModified) {
+				if (FileInfo::hashFile(objPath) != header.sourceHash) {
+					std::cout << "Mesh cache " << path << " is stale (contents changed), rebuilding" << std::endl;
+					return std::shared_ptr<MappedFile>();
+				}
+
+				// Same contents with a new timestamp: refresh the header so we don't hash again next time
+				header.sourceModified = sourceModified;
+				std::fstream patch(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+				patch.write((const char *)&header, sizeof(header));
+			}
+		}
+		else {
+			std::cout << "OBJ file " << objPath << " is missing, using its mesh cache as is" << std::endl;
+		}
+
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(path.c_str()) || file->getSize() != header.fileSize) {
+			std::cout << "Mesh cache " << path << " is truncated, rebuilding" << std::endl;
+			return std::shared_ptr<MappedFile>();
+		}
+		return file;
+	}
+
+	// Write the cache for objPath. header must have the vertex/index counts, levels of detail, material counts and bounds filled in;
+	// the rest is set here. materialStrings holds the library paths and material names, each followed by '\0'.
+	// The file is written under a temporary name and renamed, so a crash never leaves a half-written cache behind
+	static bool write(const char * objPath, MeshCacheHeader header, const Vertex * vertices, const void * indices,
+		const MeshMaterialRange * materialRanges, const std::string & materialStrings) {
+		memcpy(header.magic, "OGLM", 4);
+		header.version = VERSION;
+		header.reserved = 0;
+		header.reserved2 = 0;
+		header.reserved3 = 0;
+		header.vertexStride = sizeof(Vertex);
+		if (!FileInfo::getSourceInfo(objPath, header.sourceSize, header.sourceModified))
+			return false;
+		header.sourceHash = FileInfo::hashFile(objPath);
+
+		uint64_t vertexBytes = (uint64_t)header.numVertices * sizeof(Vertex);
+		header.verticesOffset = alignUp(sizeof(MeshCacheHeader));
+		header.indicesOffset = alignUp(header.verticesOffset + vertexBytes);
+		header.materialsOffset = alignUp(header.indicesOffset + (uint64_t)header.numIndices * header.indexSize);
+		header.materialStringsSize = (uint32_t)materialStrings.size();
+		header.fileSize = header.materialsOffset + (uint64_t)header.numMaterialRanges * sizeof(MeshMaterialRange) + materialStrings.size();
+
+		std::string path = cachePath(objPath, header.indexSize != 0);
+		std::string tempPath = path + ".tmp";
+		std::ofstream out(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out) {
+			std::cout << "Could not write mesh cache " << path << std::endl;
+			return false;
+		}
+
+		uint64_t written = sizeof(header);
+		out.write((const char *)&header, sizeof(header));
+		writePadding(out, written);
+		out.write((const char *)vertices, (std::streamsize)vertexBytes);
+		written += vertexBytes;
+		writePadding(out, written);
+		if (header.numIndices > 0)
+			out.write((const char *)indices, (std::streamsize)((uint64_t)header.numIndices * header.indexSize));
+		written += (uint64_t)header.numIndices * header.indexSize;
+		writePadding(out, written);
+		out.write((const char *)materialRanges, (std::streamsize)(header.numMaterialRanges * sizeof(MeshMaterialRange)));
+		out.write(materialStrings.data(), (std::streamsize)materialStrings.size());
+		out.close();
+
+		if (!out) {
+			std::remove(tempPath.c_str());
+			std::cout << "Could not write mesh cache " << path << std::endl;
+			return false;
+		}
+
+		// rename() won't replace an existing file on Windows
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+};
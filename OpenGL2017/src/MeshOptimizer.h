@@ -0,0 +1,367 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class reorders an indexed mesh for the GPU: triangles for the post-transform vertex cache (Forsyth),
+ *              then clusters of triangles to cut overdraw, then vertices in the order they are first fetched.
+ *              It also measures ACMR (cache misses per triangle) and ATVR (cache misses per vertex) so the gain can be reported
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+// Vertex cache efficiency of an index buffer. Lower is better; ATVR can't go below 1.0
+struct VertexCacheStats {
+	float acmr;		// Average cache miss ratio: transformed vertices per triangle (0.5 is ideal for a big regular grid, 3.0 is the worst)
+	float atvr;		// Average transformed vertex ratio: transformed vertices per referenced vertex
+};
+
+class MeshOptimizer {
+
+private:
+	// Size of the cache the Forsyth scores are tuned for
+	static const int FORSYTH_CACHE_SIZE = 32;
+
+	// Forsyth's score for a vertex at cache position cachePos (-1 if not cached) that still has liveTriangles to draw
+	static float vertexScore(int cachePos, unsigned int liveTriangles) {
+		if (liveTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePos >= 0) {
+			// The last triangle's vertices get a fixed score so the next triangle doesn't just reuse them all
+			if (cachePos < 3)
+				score = 0.75f;
+			else
+				score = std::pow(1.0f - (cachePos - 3) * (1.0f / (FORSYTH_CACHE_SIZE - 3)), 1.5f);
+		}
+
+		// Favor vertices with few triangles left, so they are finished off and don't have to be transformed again later
+		score += 2.0f * std::pow((float)liveTriangles, -0.5f);
+		return score;
+	}
+
+	// Normal of triangle t scaled by twice its area, and its centroid
+	static void triangleGeometry(const std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices, size_t t,
+		glm::vec3 & areaNormal, glm::vec3 & centroid) {
+		glm::vec3 p0 = vertices[indices[t * 3]].position;
+		glm::vec3 p1 = vertices[indices[t * 3 + 1]].position;
+		glm::vec3 p2 = vertices[indices[t * 3 + 2]].position;
+		areaNormal = glm::cross(p1 - p0, p2 - p0);
+		centroid = (p0 + p1 + p2) / 3.0f;
+	}
+
+	// Simulate a FIFO cache for indices [begin, end) starting empty. Returns the number of misses.
+	// timestamps must have one entry per vertex; it is reused between calls to avoid clearing it
+	static size_t simulateFIFO(const std::vector<unsigned int> & indices, size_t begin, size_t end,
+		std::vector<unsigned int> & timestamps, unsigned int & timestamp, unsigned int cacheSize) {
+		size_t misses = 0;
+		timestamp += cacheSize + 1; // Everything already in the cache is now too old to hit
+		for (size_t i = begin; i < end; i++) {
+			unsigned int v = indices[i];
+			if (timestamp - timestamps[v] > cacheSize) {
+				timestamps[v] = timestamp++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+public:
+	// ACMR/ATVR of indices drawn through a FIFO cache of cacheSize entries (16 is typical of current GPUs)
+	static VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t numVertices, unsigned int cacheSize = 16) {
+		VertexCacheStats stats = { 0.0f, 0.0f };
+		if (indices.empty() || numVertices == 0)
+			return stats;
+
+		std::vector<unsigned int> timestamps(numVertices, 0);
+		unsigned int timestamp = 0;
+		size_t misses = simulateFIFO(indices, 0, indices.size(), timestamps, timestamp, cacheSize);
+
+		size_t referenced = 0;
+		for (size_t v = 0; v < numVertices; v++) {
+			if (timestamps[v] != 0)
+				referenced++;
+		}
+
+		stats.acmr = (float)misses / (indices.size() / 3);
+		stats.atvr = (referenced > 0) ? (float)misses / referenced : 0.0f;
+		return stats;
+	}
+
+	// Reorder triangles so consecutive triangles share vertices (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+	// Each step draws the best scoring triangle touching the cache; only the vertices whose cache position changed are rescored
+	static void optimizeVertexCache(std::vector<unsigned int> & indices, size_t numVertices) {
+		size_t numTriangles = indices.size() / 3;
+		if (numTriangles == 0)
+			return;
+
+		// Triangles of each vertex, compressed: the live triangles of v are adjacency[firstTriangle[v] .. + liveTriangles[v])
+		std::vector<unsigned int> liveTriangles(numVertices, 0);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+			liveTriangles[indices[i]]++;
+
+		std::vector<unsigned int> firstTriangle(numVertices + 1, 0);
+		for (size_t v = 0; v < numVertices; v++)
+			firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+
+		std::vector<unsigned int> adjacency(numTriangles * 3);
+		std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+		std::vector<float> scores(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			scores[v] = vertexScore(-1, liveTriangles[v]);
+
+		std::vector<char> emitted(numTriangles, 0);
+		std::vector<unsigned int> result;
+		result.reserve(indices.size());
+
+		// The 3 vertices of the newest triangle go in front, so the cache can briefly hold 3 extra entries
+		unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		int cacheSize = 0;
+
+		// Start with the best triangle of the whole mesh
+		size_t nextUnemitted = 0;
+		size_t best = 0;
+		float bestScore = -1.0f;
+		for (size_t t = 0; t < numTriangles; t++) {
+			float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+			if (score > bestScore) {
+				bestScore = score;
+				best = t;
+			}
+		}
+
+		for (size_t emittedCount = 0; emittedCount < numTriangles; emittedCount++) {
+			// Dead end (nothing in the cache has triangles left): take the next triangle in the original order
+			if (bestScore < 0.0f) {
+				while (emitted[nextUnemitted])
+					nextUnemitted++;
+				best = nextUnemitted;
+			}
+
+			const unsigned int * tri = &indices[best * 3];
+			emitted[best] = 1;
+			result.push_back(tri[0]);
+			result.push_back(tri[1]);
+			result.push_back(tri[2]);
+
+			// Remove the triangle from its vertices' live lists
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = tri[c];
+				unsigned int * list = &adjacency[firstTriangle[v]];
+				for (unsigned int k = 0; k < liveTriangles[v]; k++) {
+					if (list[k] == best) {
+						list[k] = list[liveTriangles[v] - 1];
+						liveTriangles[v]--;
+						break;
+					}
+				}
+			}
+
+			// New cache: this triangle's vertices, then the old entries that aren't among them
+			int newSize = 0;
+			for (int c = 0; c < 3; c++) {
+				if (std::find(newCache, newCache + newSize, tri[c]) == newCache + newSize)
+					newCache[newSize++] = tri[c];
+			}
+			for (int k = 0; k < cacheSize; k++) {
+				if (std::find(newCache, newCache + newSize, cache[k]) == newCache + newSize)
+					newCache[newSize++] = cache[k];
+			}
+
+			// Anything pushed past the end falls out of the cache
+			for (int k = FORSYTH_CACHE_SIZE; k < newSize; k++)
+				scores[newCache[k]] = vertexScore(-1, liveTriangles[newCache[k]]);
+			cacheSize = std::min(newSize, FORSYTH_CACHE_SIZE);
+			for (int k = 0; k < cacheSize; k++) {
+				cache[k] = newCache[k];
+				scores[cache[k]] = vertexScore(k, liveTriangles[cache[k]]);
+			}
+
+			// Rescore the triangles around the cached vertices and pick the best one for the next step
+			best = 0;
+			bestScore = -1.0f;
+			for (int k = 0; k < cacheSize; k++) {
+				unsigned int v = cache[k];
+				const unsigned int * list = &adjacency[firstTriangle[v]];
+				for (unsigned int j = 0; j < liveTriangles[v]; j++) {
+					unsigned int t = list[j];
+					float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+					if (score > bestScore) {
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	// Reorder clusters of triangles so the outward-facing ones are drawn first and hide what's behind them (Sander et al., "Fast
+	// Triangle Reordering for Vertex Locality and Reduced Overdraw"). Clusters are cut wherever the cache order already restarts
+	// or where a cut costs no more than threshold times the cluster's ACMR, so the vertex cache gain is mostly kept.
+	// Call this after optimizeVertexCache
+	static void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices, float threshold = 1.05f) {
+		size_t numTriangles = indices.size() / 3;
+		if (numTriangles < 2)
+			return;
+
+		const unsigned int cacheSize = 16;
+		std::vector<unsigned int> timestamps(vertices.size(), 0);
+		unsigned int timestamp = 0;
+
+		// Hard boundaries: triangles whose three vertices all miss start a new run
+		std::vector<size_t> hardStarts;
+		timestamp += cacheSize + 1;
+		for (size_t t = 0; t < numTriangles; t++) {
+			int misses = 0;
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				if (timestamp - timestamps[v] > cacheSize) {
+					timestamps[v] = timestamp++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3)
+				hardStarts.push_back(t);
+		}
+		hardStarts.push_back(numTriangles);
+
+		// Soft boundaries inside each run, wherever the ACMR so far is already close to the run's
+		std::vector<size_t> clusterStarts;
+		for (size_t h = 0; h + 1 < hardStarts.size(); h++) {
+			size_t start = hardStarts[h];
+			size_t end = hardStarts[h + 1];
+			float runACMR = (float)simulateFIFO(indices, start * 3, end * 3, timestamps, timestamp, cacheSize) / (end - start);
+
+			size_t clusterStart = start;
+			size_t misses = 0;
+			timestamp += cacheSize + 1;
+			for (size_t t = start; t < end; t++) {
+				for (int c = 0; c < 3; c++) {
+					unsigned int v = indices[t * 3 + c];
+					if (timestamp - timestamps[v] > cacheSize) {
+						timestamps[v] = timestamp++;
+						misses++;
+					}
+				}
+
+				if ((float)misses / (t - clusterStart + 1) <= threshold * runACMR) {
+					clusterStarts.push_back(clusterStart);
+					clusterStart = t + 1;
+					misses = 0;
+					timestamp += cacheSize + 1;
+				}
+			}
+			if (clusterStart < end)
+				clusterStarts.push_back(clusterStart);
+		}
+		size_t numClusters = clusterStarts.size();
+		clusterStarts.push_back(numTriangles);
+
+		// Area-weighted centroid of the whole mesh
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t t = 0; t < numTriangles; t++) {
+			glm::vec3 areaNormal, centroid;
+			triangleGeometry(indices, vertices, t, areaNormal, centroid);
+			float area = glm::length(areaNormal);
+			meshCentroid += centroid * area;
+			meshArea += area;
+		}
+		meshCentroid = (meshArea > 0.0f) ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+		// How far each cluster faces away from the middle of the mesh. Most outward first
+		std::vector<float> keys(numClusters);
+		for (size_t k = 0; k < numClusters; k++) {
+			glm::vec3 clusterNormal(0.0f);
+			glm::vec3 clusterCentroid(0.0f);
+			float clusterArea = 0.0f;
+			for (size_t t = clusterStarts[k]; t < clusterStarts[k + 1]; t++) {
+				glm::vec3 areaNormal, centroid;
+				triangleGeometry(indices, vertices, t, areaNormal, centroid);
+				float area = glm::length(areaNormal);
+				clusterNormal += areaNormal;
+				clusterCentroid += centroid * area;
+				clusterArea += area;
+			}
+
+			float normalLength = glm::length(clusterNormal);
+			if (clusterArea <= 0.0f || normalLength <= 0.0f) {
+				keys[k] = 0.0f;
+				continue;
+			}
+			keys[k] = glm::dot(clusterCentroid / clusterArea - meshCentroid, clusterNormal / normalLength);
+		}
+
+		std::vector<size_t> order(numClusters);
+		for (size_t k = 0; k < numClusters; k++)
+			order[k] = k;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+		std::vector<unsigned int> result;
+		result.reserve(indices.size());
+		for (size_t k = 0; k < numClusters; k++) {
+			size_t cluster = order[k];
+			result.insert(result.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+		}
+		indices.swap(result);
+	}
+
+	// Renumber vertices in the order the index buffer first uses them, so vertex fetches walk memory forwards.
+	// Vertices no index refers to are dropped
+	static void optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices) {
+		const unsigned int unused = 0xFFFFFFFFu;
+		std::vector<unsigned int> remap(vertices.size(), unused);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		for (size_t i = 0; i < indices.size(); i++) {
+			unsigned int v = indices[i];
+			if (remap[v] == unused) {
+				remap[v] = (unsigned int)result.size();
+				result.push_back(vertices[v]);
+			}
+			indices[i] = remap[v];
+		}
+		vertices.swap(result);
+	}
+
+	// All three passes in order. before/after are measured with a 16-entry FIFO cache
+	static void optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, VertexCacheStats & before, VertexCacheStats & after) {
+		optimize(vertices, indices, std::vector<size_t>(1, indices.size()), before, after);
+	}
+
+	// Same, for indices made of consecutive ranges of rangeSizes indices (one per material). The triangle passes reorder
+	// each range on its own, so every range keeps its place and size
+	static void optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::vector<size_t> & rangeSizes,
+		VertexCacheStats & before, VertexCacheStats & after) {
+		before = analyzeVertexCache(indices, vertices.size());
+		if (rangeSizes.size() == 1) {
+			optimizeVertexCache(indices, vertices.size());
+			optimizeOverdraw(indices, vertices);
+		}
+		else {
+			size_t start = 0;
+			for (size_t i = 0; i < rangeSizes.size(); i++) {
+				std::vector<unsigned int> range(indices.begin() + start, indices.begin() + start + rangeSizes[i]);
+				optimizeVertexCache(range, vertices.size());
+				optimizeOverdraw(range, vertices);
+				std::copy(range.begin(), range.end(), indices.begin() + start);
+				start += rangeSizes[i];
+			}
+		}
+		optimizeVertexFetch(vertices, indices);
+		after = analyzeVertexCache(indices, vertices.size());
+	}
+
+};
@@ -0,0 +1,368 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class builds lower detail versions of an indexed mesh by quadric error edge collapse (Garland and Heckbert).
+ *              Vertices are only ever collapsed onto other existing vertices, so every level of detail shares the original
+ *              vertex buffer and only needs its own index range. Collapses move positions: every vertex (wedge) at
+ *              one moves onto the wedge it shares an edge with at the other, so UV and normal seams collapse along
+ *              themselves and keep their attributes. Border and non-manifold vertices are locked in place
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+class MeshSimplifier {
+
+private:
+	// Weighted sum of squared distances to a set of planes, as the symmetric 4x4 matrix of Garland and Heckbert
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double weight;
+
+		void clear() {
+			a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = weight = 0.0;
+		}
+
+		// Plane through p with unit normal n, weighted by w
+		void addPlane(glm::vec3 n, glm::vec3 p, double w) {
+			double a = n.x, b = n.y, c = n.z;
+			double d = -(a * p.x + b * p.y + c * p.z);
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric & q) {
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			weight += q.weight;
+		}
+
+		// Mean squared distance from p to the planes
+		double evaluate(glm::vec3 p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double result = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+				+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+				+ c2 * z * z + 2.0 * cd * z
+				+ d2;
+			return (result > 0.0 && weight > 0.0) ? result / weight : 0.0;
+		}
+	};
+
+	// Collapse of position from onto position to (canonical vertices)
+	struct Collapse {
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	// Positions that must not move, by canonical vertex: the ends of open or non-manifold edges
+	static std::vector<char> findLockedVertices(const std::vector<unsigned int> & indices, const std::vector<unsigned int> & canonical) {
+		size_t numVertices = canonical.size();
+		std::vector<char> locked(numVertices, 0);
+
+		// Every edge of a closed manifold appears twice, once in each direction. Edges are sorted by their ends, lower
+		// first, with the direction in the lowest bit (vertex numbers stay below 2^31), so each edge's uses end up side by side
+		std::vector<unsigned long long> edges;
+		edges.reserve(indices.size());
+		for (size_t t = 0; t < indices.size() / 3; t++) {
+			for (int c = 0; c < 3; c++) {
+				unsigned long long a = canonical[indices[t * 3 + c]];
+				unsigned long long b = canonical[indices[t * 3 + (c + 1) % 3]];
+				if (a < b)
+					edges.push_back((a << 32) | (b << 1));
+				else if (b < a)
+					edges.push_back((b << 32) | (a << 1) | 1);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t i = 0; i < edges.size();) {
+			unsigned long long edge = edges[i] >> 1;
+			size_t uses = 1;
+			while (i + uses < edges.size() && (edges[i + uses] >> 1) == edge)
+				uses++;
+			bool manifold = (uses == 2 && (edges[i] & 1) == 0 && (edges[i + 1] & 1) == 1);
+			if (!manifold) {
+				locked[edge >> 31] = 1;
+				locked[edge & 0x7FFFFFFFull] = 1;
+			}
+			i += uses;
+		}
+		return locked;
+	}
+
+	static glm::vec3 triangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) {
+		return glm::cross(p1 - p0, p2 - p0);
+	}
+
+public:
+	// canonical[v] = lowest numbered vertex with exactly the same position as v. Depends only on the vertices, so callers
+	// simplifying the same vertex buffer several times can find it once
+	static std::vector<unsigned int> findCanonicalPositions(const std::vector<Vertex> & vertices) {
+		std::vector<unsigned int> order(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			order[v] = (unsigned int)v;
+
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+			const glm::vec3 & pa = vertices[a].position;
+			const glm::vec3 & pb = vertices[b].position;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			if (pa.z != pb.z) return pa.z < pb.z;
+			return a < b;
+		});
+
+		std::vector<unsigned int> canonical(vertices.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			if (i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position)
+				canonical[order[i]] = canonical[order[i - 1]];
+			else
+				canonical[order[i]] = order[i];
+		}
+		return canonical;
+	}
+
+	// Simplify indices down to targetIndexCount indices or until every remaining collapse would move the surface by more than
+	// maxError (relative to the largest dimension of the mesh). The result references the same vertices.
+	// resultError is the largest error actually introduced, relative to the same size
+	static std::vector<unsigned int> simplify(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+		size_t targetIndexCount, float maxError, float & resultError) {
+		return simplify(vertices, findCanonicalPositions(vertices), indices, targetIndexCount, maxError, resultError);
+	}
+
+	// The same, with canonical from findCanonicalPositions(vertices)
+	static std::vector<unsigned int> simplify(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & canonical,
+		const std::vector<unsigned int> & indices, size_t targetIndexCount, float maxError, float & resultError) {
+		resultError = 0.0f;
+		std::vector<unsigned int> result(indices);
+		size_t numVertices = vertices.size();
+		if (result.size() <= targetIndexCount || numVertices == 0)
+			return result;
+
+		// Work in a unit-sized copy of the positions so errors mean the same thing for every mesh
+		glm::vec3 boundsMin = vertices[0].position, boundsMax = vertices[0].position;
+		for (size_t v = 1; v < numVertices; v++) {
+			boundsMin = glm::min(boundsMin, vertices[v].position);
+			boundsMax = glm::max(boundsMax, vertices[v].position);
+		}
+		glm::vec3 extent = boundsMax - boundsMin;
+		float size = std::max(extent.x, std::max(extent.y, extent.z));
+		float invSize = (size > 0.0f) ? 1.0f / size : 1.0f;
+
+		std::vector<glm::vec3> positions(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			positions[v] = (vertices[v].position - boundsMin) * invSize;
+
+		std::vector<char> locked = findLockedVertices(result, canonical);
+
+		// Vertices at each position (the wedges of a seam), found by canonical vertex
+		std::vector<unsigned int> firstWedge(numVertices + 1, 0);
+		std::vector<unsigned int> wedges(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			firstWedge[canonical[v] + 1]++;
+		for (size_t v = 0; v < numVertices; v++)
+			firstWedge[v + 1] += firstWedge[v];
+		std::vector<unsigned int> nextWedge(firstWedge.begin(), firstWedge.end() - 1);
+		for (size_t v = 0; v < numVertices; v++)
+			wedges[nextWedge[canonical[v]]++] = (unsigned int)v;
+		std::vector<unsigned int>().swap(nextWedge);
+
+		// Quadrics of the triangle planes around each position, weighted by area
+		std::vector<Quadric> quadrics(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			quadrics[v].clear();
+		for (size_t t = 0; t < result.size() / 3; t++) {
+			glm::vec3 p0 = positions[result[t * 3]];
+			glm::vec3 normal = triangleNormal(p0, positions[result[t * 3 + 1]], positions[result[t * 3 + 2]]);
+			float area = glm::length(normal);
+			if (area <= 0.0f)
+				continue;
+			for (int c = 0; c < 3; c++)
+				quadrics[canonical[result[t * 3 + c]]].addPlane(normal / area, p0, area * 0.5);
+		}
+
+		double errorLimit = (double)maxError * maxError;
+		std::vector<unsigned int> remap(numVertices);
+		std::vector<char> touched(numVertices);
+		std::vector<unsigned int> firstTriangle(numVertices + 1);
+		std::vector<unsigned int> vertexTriangles;
+		std::vector<Collapse> collapses;
+		std::vector<unsigned long long> order;
+		std::vector<unsigned int> moves;	// Pairs of wedge and the wedge it moves onto, for the collapse being checked
+
+		// Each pass collapses a batch of the cheapest independent edges, then rebuilds the index list
+		while (result.size() > targetIndexCount) {
+			size_t numTriangles = result.size() / 3;
+
+			// Triangles around each vertex
+			std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+			for (size_t i = 0; i < result.size(); i++)
+				firstTriangle[result[i] + 1]++;
+			for (size_t v = 0; v < numVertices; v++)
+				firstTriangle[v + 1] += firstTriangle[v];
+			vertexTriangles.resize(result.size());
+			std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				vertexTriangles[fill[result[i]]++] = (unsigned int)(i / 3);
+
+			// Cheapest direction of every edge that has a movable end
+			collapses.clear();
+			for (size_t t = 0; t < numTriangles; t++) {
+				for (int c = 0; c < 3; c++) {
+					unsigned int a = canonical[result[t * 3 + c]];
+					unsigned int b = canonical[result[t * 3 + (c + 1) % 3]];
+					if (a >= b)
+						continue; // Interior edges also appear reversed in the neighbouring triangle; border edges are locked anyway
+
+					Quadric q = quadrics[a];
+					q.add(quadrics[b]);
+					Collapse collapse;
+					collapse.error = -1.0;
+					if (!locked[a]) {
+						collapse.from = a;
+						collapse.to = b;
+						collapse.error = q.evaluate(positions[b]);
+					}
+					if (!locked[b]) {
+						double error = q.evaluate(positions[a]);
+						if (collapse.error < 0.0 || error < collapse.error) {
+							collapse.from = b;
+							collapse.to = a;
+							collapse.error = error;
+						}
+					}
+					if (collapse.error >= 0.0 && collapse.error <= errorLimit)
+						collapses.push_back(collapse);
+				}
+			}
+			if (collapses.empty())
+				break;
+
+			// Each collapse removes about two triangles
+			size_t goal = std::max((size_t)1, (result.size() - targetIndexCount) / 6);
+			size_t applied = 0;
+
+			// Cheapest first. Plain integers (the error's float bits, which order like the errors themselves since they are
+			// never negative, above the collapse's index) sort much quicker than the collapses
+			order.resize(collapses.size());
+			for (size_t k = 0; k < collapses.size(); k++) {
+				float error = (float)collapses[k].error;
+				uint32_t bits;
+				memcpy(&bits, &error, sizeof(bits));
+				order[k] = ((unsigned long long)bits << 32) | k;
+			}
+			std::sort(order.begin(), order.end());
+			for (size_t v = 0; v < numVertices; v++)
+				remap[v] = (unsigned int)v;
+			std::fill(touched.begin(), touched.end(), 0);
+
+			for (size_t n = 0; n < order.size() && applied < goal; n++) {
+				const Collapse & collapse = collapses[order[n] & 0xFFFFFFFFull];
+				unsigned int from = collapse.from;
+				unsigned int to = collapse.to;
+				if (touched[from] || touched[to])
+					continue;
+
+				// Each wedge at from moves onto the wedge at to that its triangles along the edge use. A wedge without one
+				// (a hard edge or UV island that doesn't reach to), or whose triangles use two, would lose its attributes,
+				// and two wedges moving onto the same one would close a seam, so those collapses are skipped
+				bool valid = true;
+				moves.clear();
+				for (unsigned int k = firstWedge[from]; k < firstWedge[from + 1] && valid; k++) {
+					unsigned int wedge = wedges[k];
+					if (firstTriangle[wedge] == firstTriangle[wedge + 1])
+						continue; // No longer used
+					unsigned int target = wedge;
+					for (unsigned int j = firstTriangle[wedge]; j < firstTriangle[wedge + 1]; j++) {
+						const unsigned int * tri = &result[vertexTriangles[j] * 3];
+						for (int c = 0; c < 3; c++) {
+							if (canonical[tri[c]] != to)
+								continue;
+							if (target != wedge && target != tri[c])
+								valid = false;
+							target = tri[c];
+						}
+					}
+					for (size_t m = 1; m < moves.size(); m += 2) {
+						if (moves[m] == target)
+							valid = false;
+					}
+					if (target == wedge)
+						valid = false;
+					moves.push_back(wedge);
+					moves.push_back(target);
+				}
+				if (!valid)
+					continue;
+
+				// Reject collapses that would fold a triangle over
+				bool flips = false;
+				for (size_t m = 0; m < moves.size() && !flips; m += 2) {
+					unsigned int wedge = moves[m];
+					for (unsigned int j = firstTriangle[wedge]; j < firstTriangle[wedge + 1] && !flips; j++) {
+						const unsigned int * tri = &result[vertexTriangles[j] * 3];
+						if (canonical[tri[0]] == to || canonical[tri[1]] == to || canonical[tri[2]] == to)
+							continue; // This one disappears
+						glm::vec3 before[3], after[3];
+						for (int c = 0; c < 3; c++) {
+							before[c] = positions[tri[c]];
+							after[c] = (tri[c] == wedge) ? positions[to] : positions[tri[c]];
+						}
+						glm::vec3 n0 = triangleNormal(before[0], before[1], before[2]);
+						glm::vec3 n1 = triangleNormal(after[0], after[1], after[2]);
+						if (glm::dot(n0, n1) < 0.25f * glm::length(n0) * glm::length(n1))
+							flips = true;
+					}
+				}
+				if (flips)
+					continue;
+
+				// The one-ring of from changes shape, so nothing else in it may move in this pass
+				for (size_t m = 0; m < moves.size(); m += 2) {
+					unsigned int wedge = moves[m];
+					for (unsigned int j = firstTriangle[wedge]; j < firstTriangle[wedge + 1]; j++) {
+						const unsigned int * tri = &result[vertexTriangles[j] * 3];
+						touched[canonical[tri[0]]] = touched[canonical[tri[1]]] = touched[canonical[tri[2]]] = 1;
+					}
+					remap[wedge] = moves[m + 1];
+				}
+				touched[to] = 1;
+
+				quadrics[to].add(quadrics[from]);
+				resultError = std::max(resultError, (float)std::sqrt(collapse.error));
+				applied++;
+			}
+			if (applied == 0)
+				break;
+
+			// Rewrite the triangles, dropping the ones that collapsed to a line
+			size_t write = 0;
+			for (size_t t = 0; t < numTriangles; t++) {
+				unsigned int i0 = remap[result[t * 3]];
+				unsigned int i1 = remap[result[t * 3 + 1]];
+				unsigned int i2 = remap[result[t * 3 + 2]];
+				if (i0 == i1 || i1 == i2 || i0 == i2)
+					continue;
+				result[write++] = i0;
+				result[write++] = i1;
+				result[write++] = i2;
+			}
+			result.resize(write);
+		}
+
+		return result;
+	}
+
+};
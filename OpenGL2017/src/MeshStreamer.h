@@ -0,0 +1,252 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class imports an OBJ straight into a vertex buffer without ever holding the whole mesh in memory.
+ *              A worker thread reads the faces a block at a time (ModelImporter::readVertices), adds tangents, packs the
+ *              vertices and writes them into a free segment of an UploadRing, while the GL thread copies filled segments
+ *              into the vertex buffer. Parsing, packing and the GPU copies overlap, and memory use is the attribute
+ *              arrays plus the ring, whatever the number of faces
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ImportedModel.h"
+#include "ModelImporter.h"
+#include "TangentGenerator.h"
+#include "ThreadPool.h"
+#include "UploadRing.h"
+#include "VertexQuantizer.h"
+
+class MeshStreamer {
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	std::string name;
+	GLuint destination;
+	bool packed;
+	size_t stride;
+	UploadRing ring;
+	ModelImporter importer;
+
+	// Handed back and forth between the worker and the GL thread, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<int> freeSegments;						// Ready to be filled by the worker
+	std::deque<std::pair<int, size_t>> filledSegments;	// (segment, bytes) waiting to be copied by the GL thread
+	bool started, scanned, workerDone, failed, cancelled;
+	size_t numVertices;
+	glm::vec3 boundsMin, boundsMax;
+	QuantizationStats stats;
+	double waitMilliseconds; // Time the worker spent waiting for the GPU to free a segment
+
+	// GL thread only
+	std::vector<int> copyingSegments; // Copied out of, waiting for their fences
+	bool allocated;
+	size_t uploadedBytes;
+	int numCopies;
+	Clock::time_point startTime;
+
+	MeshStreamer(const MeshStreamer &);
+	MeshStreamer & operator=(const MeshStreamer &);
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	void finishWork() {
+		importer.closeStream();
+		std::lock_guard<std::mutex> lock(mutex);
+		workerDone = true;
+		changed.notify_all();
+	}
+
+	// Runs on a worker
+	void work(ThreadPool & pool) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cancelled) {
+				workerDone = true;
+				changed.notify_all();
+				return;
+			}
+		}
+
+		// First pass: attributes, bounds (needed to pack) and the vertex count (needed to size the buffer)
+		bool opened = importer.openStream(name.c_str(), pool);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			scanned = true;
+			failed = !opened;
+			if (opened) {
+				numVertices = importer.getStreamVertexCount();
+				importer.getStreamBounds(boundsMin, boundsMax);
+			}
+		}
+		if (!opened) {
+			finishWork();
+			return;
+		}
+
+		// Second pass: whole triangles, one segment at a time. The vertices are built in scratch memory, since the
+		// mapped segments are write-only (and slow to read back), then written to the segment once in their final format
+		size_t capacity = ring.getSegmentSize() / stride;
+		capacity -= capacity % 3;
+		std::vector<Vertex> scratch(capacity);
+		size_t packedSoFar = 0;
+
+		while (true) {
+			int segment;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				Clock::time_point waitStart = Clock::now();
+				changed.wait(lock, [this] { return cancelled || !freeSegments.empty(); });
+				waitMilliseconds += millisecondsSince(waitStart);
+				if (cancelled)
+					break;
+				segment = freeSegments.front();
+				freeSegments.pop_front();
+			}
+
+			size_t count = importer.readVertices(scratch.data(), capacity);
+			if (count == 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				freeSegments.push_back(segment);
+				break;
+			}
+
+			// Streamed corners are never shared, so every triangle gets its own tangent
+			TangentGenerator::generate(scratch.data(), count, NULL, count, pool);
+
+			char * out = ring.getSegment(segment);
+			if (packed) {
+				QuantizationStats blockStats = VertexQuantizer::pack(ArrayView<Vertex>(scratch.data(), count), boundsMin, boundsMax, (PackedVertex *)out);
+				stats = VertexQuantizer::merge(stats, packedSoFar, blockStats, count);
+				packedSoFar += count;
+			}
+			else {
+				memcpy(out, scratch.data(), count * sizeof(Vertex));
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			filledSegments.push_back(std::make_pair(segment, count * stride));
+			changed.notify_all();
+		}
+
+		finishWork();
+	}
+
+public:
+	// Stream filePath into vertexBuffer (created by the caller) as PackedVertex or Vertex records. Must be created on the GL
+	// thread. The ring has numSegments segments of segmentBytes each
+	MeshStreamer(const char * filePath, GLuint vertexBuffer, bool packVertices, size_t segmentBytes = 4 << 20, int numSegments = 3)
+		: name(filePath), destination(vertexBuffer), packed(packVertices), stride(packVertices ? sizeof(PackedVertex) : sizeof(Vertex)),
+		ring(segmentBytes, numSegments), started(false), scanned(false), workerDone(false), failed(false), cancelled(false),
+		numVertices(0), boundsMin(0.0f), boundsMax(0.0f), waitMilliseconds(0.0), allocated(false), uploadedBytes(0), numCopies(0) {
+		memset(&stats, 0, sizeof(stats));
+		for (int i = 0; i < numSegments; i++)
+			freeSegments.push_back(i);
+	}
+
+	// Stops the worker. The ring's GL objects are only freed by pump(), on the GL thread
+	~MeshStreamer() {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!started)
+			return;
+		cancelled = true;
+		changed.notify_all();
+		changed.wait(lock, [this] { return workerDone; });
+	}
+
+	void start(ThreadPool & pool = ThreadPool::shared()) {
+		startTime = Clock::now();
+		started = true;
+		pool.submit([this, &pool]() {
+			work(pool);
+		});
+	}
+
+	// Copy whatever the worker has filled into the vertex buffer and recycle segments the GPU is done with. Call on the
+	// GL thread until it returns true: all vertices are on their way to the buffer (or the file couldn't be read)
+	bool pump() {
+		std::deque<std::pair<int, size_t>> filled;
+		bool done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!scanned)
+				return false;
+			filled.swap(filledSegments);
+			done = workerDone;
+		}
+		if (failed) {
+			if (done)
+				ring.release();
+			return done;
+		}
+
+		if (!allocated) {
+			glBindBuffer(GL_ARRAY_BUFFER, destination);
+			glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(numVertices * stride), NULL, GL_STATIC_DRAW);
+			allocated = true;
+		}
+
+		// Commands are ordered, so draws issued after these copies see the vertices without waiting on anything
+		for (size_t i = 0; i < filled.size(); i++) {
+			ring.copyToBuffer(filled[i].first, filled[i].second, destination, uploadedBytes);
+			uploadedBytes += filled[i].second;
+			numCopies++;
+			copyingSegments.push_back(filled[i].first);
+		}
+
+		// Segments whose copies have finished can be filled again
+		std::vector<int> freed;
+		for (size_t i = 0; i < copyingSegments.size(); ) {
+			if (ring.isSegmentFree(copyingSegments[i])) {
+				freed.push_back(copyingSegments[i]);
+				copyingSegments.erase(copyingSegments.begin() + i);
+			}
+			else {
+				i++;
+			}
+		}
+		if (!freed.empty()) {
+			std::lock_guard<std::mutex> lock(mutex);
+			freeSegments.insert(freeSegments.end(), freed.begin(), freed.end());
+			changed.notify_all();
+		}
+
+		// The worker may have filled more segments since the swap above
+		if (done) {
+			std::lock_guard<std::mutex> lock(mutex);
+			done = filledSegments.empty();
+		}
+		if (done) {
+			std::cout << "Streamed " << name << ": " << numVertices << " vertices, " << toMegabytes(uploadedBytes) << " MB in " << numCopies
+				<< " copies through " << ring.getNumSegments() << " x " << toMegabytes(ring.getSegmentSize()) << " MB "
+				<< (ring.isPersistent() ? "persistently mapped segments" : "staging segments (glBufferSubData)") << ", parser waited "
+				<< waitMilliseconds << " ms for the GPU, " << millisecondsSince(startTime) << " ms in total" << std::endl;
+			ring.release();
+		}
+		return done;
+	}
+
+	bool hasFailed() {
+		return failed;
+	}
+
+	// Description of the streamed model (counts and bounds only; its vertices live in the vertex buffer)
+	ImportedModel getModel() {
+		return ImportedModel(name.c_str(), (int)numVertices, boundsMin, boundsMax, stats);
+	}
+
+};
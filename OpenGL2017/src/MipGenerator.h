@@ -0,0 +1,182 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class builds the mipmap chain of an RGBA8 image on the CPU, so textures can be uploaded (and
+ *              compressed) with every level instead of none. Each level is the 2x2 box average of the one above it.
+ *              Color images are averaged in linear light (sRGB decoded, averaged, encoded again) so their mipmaps
+ *              don't darken; data like normal maps is averaged as it is. The first pass also flips the image
+ *              bottom to top, the way OpenGL wants it, while it copies level 0. Rows are split across the thread
+ *              pool. Data images are averaged with SSE2 where the compiler targets it; color images go through
+ *              lookup tables one channel at a time, since SSE2 has no gather to vectorize them with
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// One level of a mipmap chain
+struct MipLevel {
+	int width, height;
+	std::vector<unsigned char> pixels; // RGBA8, tightly packed
+};
+
+class MipGenerator {
+
+private:
+	// Entries in the linear to sRGB table. Fine enough that the steepest part of the curve (near black) stays below one
+	// step of the 8-bit result
+	static const int LINEAR_STEPS = 8192;
+
+	// sRGB byte -> linear [0, 1], and linear * (LINEAR_STEPS - 1) -> sRGB byte
+	struct Tables {
+		float toLinear[256];
+		unsigned char toSrgb[LINEAR_STEPS];
+
+		Tables() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < LINEAR_STEPS; i++) {
+				float l = i / (float)(LINEAR_STEPS - 1);
+				float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (unsigned char)std::min(255.0f, c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	static const Tables & tables() {
+		static const Tables instance;
+		return instance;
+	}
+
+	// Rows handed to one worker at a time, so small levels aren't split into tasks smaller than their overhead
+	static const size_t ROWS_PER_TASK = 16;
+
+	// Average the 2x2 pixels p00, p01 (one row) and p10, p11 (the next) of a color image in linear light
+	static void averageSrgb(const unsigned char * p00, const unsigned char * p01, const unsigned char * p10, const unsigned char * p11,
+		unsigned char * out, const Tables & t) {
+		for (int c = 0; c < 3; c++) {
+			float sum = t.toLinear[p00[c]] + t.toLinear[p01[c]] + t.toLinear[p10[c]] + t.toLinear[p11[c]];
+			out[c] = t.toSrgb[(int)(sum * (LINEAR_STEPS - 1) * 0.25f + 0.5f)];
+		}
+		out[3] = (unsigned char)((p00[3] + p01[3] + p10[3] + p11[3] + 2) >> 2);
+	}
+
+	// Average one row of output from source rows row0 and row1. color selects linear light averaging
+	static void downsampleRow(const unsigned char * row0, const unsigned char * row1, int sourceWidth, unsigned char * out, int width,
+		bool color, const Tables & t) {
+		int x = 0;
+#ifdef MIP_GENERATOR_SSE2
+		if (!color) {
+			// Two output pixels from four source pixels of each row: widen to 16 bits, add the rows, add neighbouring
+			// pixels, round and narrow again
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+			for (; x + 1 < width && 2 * x + 3 < sourceWidth; x += 2) {
+				__m128i a = _mm_loadu_si128((const __m128i *)(row0 + 8 * x));
+				__m128i b = _mm_loadu_si128((const __m128i *)(row1 + 8 * x));
+				__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+				high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+				__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(low, high), two), 2);
+				_mm_storel_epi64((__m128i *)(out + 4 * x), _mm_packus_epi16(sum, zero));
+			}
+		}
+#endif
+		// Whatever is left. The last column of an odd width (like the last row of an odd height) is dropped, as in a
+		// plain 2x2 box filter; only a source 1 pixel wide or high reads its one column or row twice
+		for (; x < width; x++) {
+			const unsigned char * p00 = row0 + 4 * std::min(2 * x, sourceWidth - 1);
+			const unsigned char * p01 = row0 + 4 * std::min(2 * x + 1, sourceWidth - 1);
+			const unsigned char * p10 = row1 + 4 * std::min(2 * x, sourceWidth - 1);
+			const unsigned char * p11 = row1 + 4 * std::min(2 * x + 1, sourceWidth - 1);
+			if (color) {
+				averageSrgb(p00, p01, p10, p11, out + 4 * x, t);
+			}
+			else {
+				for (int c = 0; c < 4; c++)
+					out[4 * x + c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+			}
+		}
+	}
+
+	// Fill target (half of source, rounded down, at least 1) from the sourceWidth x sourceHeight pixels at source, dropping
+	// the last row and column of odd sizes. With flip, source is top to bottom and target comes out bottom to top. level0,
+	// if given, gets source's rows (flipped the same way) as they are read
+	static void downsample(const unsigned char * source, int sourceWidth, int sourceHeight, MipLevel & target, bool flip,
+		MipLevel * level0, bool color, ThreadPool & pool) {
+		const Tables & t = tables();
+		size_t rowBytes = (size_t)sourceWidth * 4;
+
+		// Row k of the image as it should end up
+		auto sourceRow = [&](int k) {
+			k = std::min(k, sourceHeight - 1);
+			return source + (size_t)(flip ? sourceHeight - 1 - k : k) * rowBytes;
+		};
+
+		pool.parallelFor((size_t)target.height, [&](size_t begin, size_t end) {
+			for (int y = (int)begin; y < (int)end; y++) {
+				downsampleRow(sourceRow(2 * y), sourceRow(2 * y + 1), sourceWidth, target.pixels.data() + (size_t)y * target.width * 4,
+					target.width, color, t);
+
+				// Rows 2y and 2y + 1, and the last row of an odd height, which no output row averages
+				if (level0 != NULL) {
+					int last = (y + 1 == target.height) ? sourceHeight - 1 : std::min(2 * y + 1, sourceHeight - 1);
+					for (int k = 2 * y; k <= last; k++)
+						memcpy(level0->pixels.data() + k * rowBytes, sourceRow(k), rowBytes);
+				}
+			}
+		}, ROWS_PER_TASK);
+	}
+
+public:
+	// Levels in a full chain down to 1x1, including the full size image
+	static int getNumLevels(int width, int height) {
+		int levels = 1;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	// The whole chain of a width x height RGBA8 image, level 0 (a copy of the image) first. With flipY the image's rows
+	// are top to bottom, as decoded, and every level comes out bottom to top. color averages RGB in linear light;
+	// leave it off for images that hold data rather than colors, like normal maps
+	static std::vector<MipLevel> generate(const unsigned char * rgba, int width, int height, bool flipY, bool color,
+		ThreadPool & pool = ThreadPool::shared()) {
+		std::vector<MipLevel> levels(getNumLevels(width, height));
+		levels[0].width = width;
+		levels[0].height = height;
+		levels[0].pixels.resize((size_t)width * height * 4);
+		if (levels.size() == 1) {
+			memcpy(levels[0].pixels.data(), rgba, 4);
+			return levels;
+		}
+
+		// Level 1 is read straight from the image, copying (and flipping) it into level 0 on the way
+		for (size_t i = 1; i < levels.size(); i++) {
+			levels[i].width = std::max(1, levels[i - 1].width / 2);
+			levels[i].height = std::max(1, levels[i - 1].height / 2);
+			levels[i].pixels.resize((size_t)levels[i].width * levels[i].height * 4);
+			if (i == 1)
+				downsample(rgba, width, height, levels[1], flipY, &levels[0], color, pool);
+			else
+				downsample(levels[i - 1].pixels.data(), levels[i - 1].width, levels[i - 1].height, levels[i], false, NULL, color, pool);
+		}
+		return levels;
+	}
+
+};
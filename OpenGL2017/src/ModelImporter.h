@@ -9,7 +9,18 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
 #include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Vertex.h"
 
 class ModelImporter {
 
@@ -23,6 +34,611 @@ private:
 	std::vector<float> normals;
 	std::vector<float> tangent;
 
+	// "usemtl name": the faces from firstTriangle on use material name
+	struct MaterialSwitch {
+		size_t firstTriangle;
+		std::string name;
+	};
+
+	// mtllib and usemtl lines, in file order
+	struct ObjMaterials {
+		std::vector<std::string> libraries;
+		std::vector<MaterialSwitch> switches;
+	};
+
+	// Attributes and face references found in one line-aligned piece of the file
+	struct ObjChunk {
+		const char * begin;
+		const char * end;
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> nrms;
+		std::vector<int> refs;
+		ObjMaterials materials;
+	};
+
+	// Zero-based (v, vt, vn) references for every triangle corner, -1 where the face omits one
+	std::vector<int> faceRefs;
+
+	// A chunk doesn't know how many attributes the chunks before it have, so it stores a relative (negative) reference as
+	// RELATIVE_INDEX plus the index among its own attributes (which may be below 0), and mergeChunks makes it absolute
+	static const int RELATIVE_INDEX = -(1 << 30);
+
+	// Material libraries and switches of the last read, and once the faces are grouped by material, the material names
+	// (in order of first use, "" for faces before any usemtl) and how many triangles each one has
+	ObjMaterials objMaterials;
+	std::vector<std::string> materialNames;
+	std::vector<size_t> materialTriangles;
+
+	// Triangle list into the unique vertices when the mesh was indexed
+	std::vector<unsigned int> indices;
+	bool indexed = false;
+
+	// Interleaved output of importOBJ
+	std::vector<Vertex> vertexStream;
+
+	// Largest amount of memory held by this importer's own buffers during the last import
+	size_t peakBytes = 0;
+
+	// Throughput of the last mapped parse, in MB/s
+	double parseThroughput = 0.0;
+
+	// Streaming import (openStream/readVertices): the mapped file, how far the faces have been read, and the
+	// triangles of the current face line that haven't been handed out yet
+	std::unique_ptr<MappedFile> streamFile;
+	const char * streamCursor = NULL;
+	std::vector<int> streamRefs;
+	size_t streamRefPosition = 0;
+	size_t streamTriangles = 0;
+	size_t streamCounts[3] = { 0, 0, 0 };	// v, vt and vn lines before streamCursor, for relative references
+
+	static bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static const char * skipBlanks(const char * p, const char * end) {
+		while (p < end && isBlank(*p))
+			p++;
+		return p;
+	}
+
+	// Returns a pointer to the first character of the next line
+	static const char * skipLine(const char * p, const char * end) {
+		const char * newline = (const char *)memchr(p, '\n', end - p);
+		return (newline == NULL) ? end : newline + 1;
+	}
+
+	// Whether the line at p starts with keyword followed by a blank
+	static bool startsWith(const char * p, const char * lineEnd, const char * keyword, size_t length) {
+		return (size_t)(lineEnd - p) > length && memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+	}
+
+	// The rest of the line after p, without surrounding blanks (names and paths may contain spaces)
+	static std::string restOfLine(const char * p, const char * lineEnd) {
+		p = skipBlanks(p, lineEnd);
+		const char * last = lineEnd;
+		while (last > p && (isBlank(last[-1]) || last[-1] == '\n'))
+			last--;
+		return std::string(p, last);
+	}
+
+	// Parse a float in place. Short numbers (what exporters write) are converted exactly in float arithmetic,
+	// anything longer falls back to strtof on a stack copy so the result matches the stream parser bit for bit
+	static const char * parseFloat(const char * p, const char * end, float & out) {
+		static const float powersOf10[11] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+		p = skipBlanks(p, end);
+		const char * start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool sawDigit = false;
+
+		while (p < end && *p >= '0' && *p <= '9') {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0)
+				digits++;
+			sawDigit = true;
+			p++;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && *p >= '0' && *p <= '9') {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0)
+					digits++;
+				exponent--;
+				sawDigit = true;
+				p++;
+			}
+		}
+		if (!sawDigit) {
+			out = 0.0f;
+			return p;
+		}
+
+		bool hasExponentPart = (p < end && (*p == 'e' || *p == 'E'));
+		if (!hasExponentPart && digits <= 7 && exponent >= -10) {
+			// Both operands are exact floats, so a single multiply/divide is correctly rounded
+			float value = (float)mantissa;
+			value = (exponent < 0) ? value / powersOf10[-exponent] : value;
+			out = negative ? -value : value;
+			return p;
+		}
+
+		// Slow path: long mantissas and exponents
+		if (hasExponentPart) {
+			p++;
+			if (p < end && (*p == '-' || *p == '+'))
+				p++;
+			while (p < end && *p >= '0' && *p <= '9')
+				p++;
+		}
+		char buffer[64];
+		size_t length = (size_t)(p - start);
+		if (length >= sizeof(buffer))
+			length = sizeof(buffer) - 1;
+		memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		out = strtof(buffer, NULL);
+		return p;
+	}
+
+	// Parse a one-based OBJ index and convert it to zero-based. A negative index counts back from the end of the count
+	// attributes read so far; with relativeBase (RELATIVE_INDEX) it is stored for mergeChunks instead. Anything missing
+	// or pointing before the first attribute becomes -1
+	static const char * parseIndex(const char * p, const char * end, size_t count, int relativeBase, int & out) {
+		int value = 0;
+		bool sawDigit = false;
+		bool negative = false;
+		if (p < end && *p == '-') {
+			negative = true;
+			p++;
+		}
+		while (p < end && *p >= '0' && *p <= '9') {
+			value = value * 10 + (*p - '0');
+			sawDigit = true;
+			p++;
+		}
+		if (!sawDigit || value == 0)
+			out = -1;
+		else if (!negative)
+			out = value - 1;
+		else if (relativeBase != 0)
+			out = relativeBase + (int)count - value;
+		else
+			out = ((size_t)value <= count) ? (int)count - value : -1;
+		return p;
+	}
+
+	// Parse one "v/vt/vn" face corner (vt and vn are optional). counts are the v, vt and vn lines read so far
+	static const char * parseCorner(const char * p, const char * end, const size_t * counts, int relativeBase, int * ref) {
+		p = parseIndex(p, end, counts[0], relativeBase, ref[0]);
+		ref[1] = -1;
+		ref[2] = -1;
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p != '/')
+				p = parseIndex(p, end, counts[1], relativeBase, ref[1]);
+			if (p < end && *p == '/')
+				p = parseIndex(p + 1, end, counts[2], relativeBase, ref[2]);
+		}
+		return p;
+	}
+
+	// Tokenize a block of OBJ text in place. Polygons with more than 3 corners are split into a triangle fan.
+	// Material switches are numbered by the block's own triangles.
+	// Relative references are resolved against the block's own attributes, offset by relativeBase (0 for a whole file).
+	// With countOnly, faces are only counted into numTriangles and refs is just scratch space
+	static void parseBlock(const char * p, const char * end,
+		std::vector<float> & positions, std::vector<float> & uvs, std::vector<float> & nrms, std::vector<int> & refs,
+		ObjMaterials & materials, int relativeBase, size_t * countOnly = NULL) {
+		float x, y, z;
+		while (p < end) {
+			const char * lineEnd = skipLine(p, end);
+			p = skipBlanks(p, lineEnd);
+
+			if (lineEnd - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+				p = parseFloat(p + 1, lineEnd, x);
+				p = parseFloat(p, lineEnd, y);
+				p = parseFloat(p, lineEnd, z);
+				positions.push_back(x);
+				positions.push_back(y);
+				positions.push_back(z);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 't') {
+				p = parseFloat(p + 2, lineEnd, x);
+				p = parseFloat(p, lineEnd, y);
+				uvs.push_back(x);
+				uvs.push_back(y);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 'n') {
+				p = parseFloat(p + 2, lineEnd, x);
+				p = parseFloat(p, lineEnd, y);
+				p = parseFloat(p, lineEnd, z);
+				nrms.push_back(x);
+				nrms.push_back(y);
+				nrms.push_back(z);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+				size_t counts[3] = { positions.size() / 3, uvs.size() / 2, nrms.size() / 3 };
+				parseFace(p + 1, lineEnd, counts, relativeBase, refs);
+				if (countOnly != NULL) {
+					*countOnly += refs.size() / 9;
+					refs.clear();
+				}
+			}
+			else if (startsWith(p, lineEnd, "usemtl", 6)) {
+				MaterialSwitch change = { (countOnly != NULL) ? *countOnly : refs.size() / 9, restOfLine(p + 6, lineEnd) };
+				materials.switches.push_back(change);
+			}
+			else if (startsWith(p, lineEnd, "mtllib", 6)) {
+				materials.libraries.push_back(restOfLine(p + 6, lineEnd));
+			}
+			p = lineEnd;
+		}
+	}
+
+	// Append the (v, vt, vn) references of one face line (after the "f") as a triangle fan. Returns the number of corners
+	static int parseFace(const char * p, const char * lineEnd, const size_t * counts, int relativeBase, std::vector<int> & refs) {
+		int first[3], previous[3], current[3];
+		int corners = 0;
+		while (true) {
+			p = skipBlanks(p, lineEnd);
+			if (p >= lineEnd || *p == '\n' || *p == '#')
+				break;
+			const char * cornerStart = p;
+			p = parseCorner(p, lineEnd, counts, relativeBase, current);
+			if (p == cornerStart)
+				break; // Not a corner, stop before we loop forever
+
+			if (corners == 0) {
+				memcpy(first, current, sizeof(first));
+			}
+			else if (corners >= 2) {
+				refs.insert(refs.end(), first, first + 3);
+				refs.insert(refs.end(), previous, previous + 3);
+				refs.insert(refs.end(), current, current + 3);
+			}
+			memcpy(previous, current, sizeof(previous));
+			corners++;
+		}
+		return corners;
+	}
+
+	// Expand the face references into the per-corner output arrays (same layout parseOBJ produces)
+	void expandFaces() {
+		size_t numCorners = faceRefs.size() / 3;
+		triangleVerts.resize(numCorners * 3);
+		textureCoords.resize(numCorners * 2);
+		normals.resize(numCorners * 3);
+		expandCorners(0, numCorners);
+	}
+
+	// Same as expandFaces, but every corner is independent so the work is split across the pool
+	void expandFacesParallel(ThreadPool & pool) {
+		size_t numCorners = faceRefs.size() / 3;
+		triangleVerts.resize(numCorners * 3);
+		textureCoords.resize(numCorners * 2);
+		normals.resize(numCorners * 3);
+		pool.parallelFor(numCorners, [this](size_t begin, size_t end) {
+			expandCorners(begin, end);
+		}, 4096);
+	}
+
+	// Find the unique (v, vt, vn) triples and fill indices with one entry per corner pointing at them.
+	// Unique vertices are chained per position index, so a lookup only compares the few vertices sharing a position
+	void deduplicateCorners(std::vector<int> & uniqueRefs) {
+		size_t numCorners = faceRefs.size() / 3;
+		size_t numPositions = vertVals.size() / 3;
+
+		// Bucket numPositions collects corners whose position reference is missing or out of range
+		std::vector<int> firstInBucket(numPositions + 1, -1);
+		std::vector<int> nextInBucket;
+		uniqueRefs.clear();
+		nextInBucket.reserve(numCorners / 4);
+		uniqueRefs.reserve(numCorners / 4 * 3);
+		indices.resize(numCorners);
+
+		for (size_t i = 0; i < numCorners; i++) {
+			const int * ref = &faceRefs[i * 3];
+			size_t bucket = (ref[0] >= 0 && (size_t)ref[0] < numPositions) ? (size_t)ref[0] : numPositions;
+
+			int found = firstInBucket[bucket];
+			while (found >= 0 && (uniqueRefs[found * 3] != ref[0] || uniqueRefs[found * 3 + 1] != ref[1] || uniqueRefs[found * 3 + 2] != ref[2]))
+				found = nextInBucket[found];
+
+			if (found < 0) {
+				found = (int)nextInBucket.size();
+				uniqueRefs.insert(uniqueRefs.end(), ref, ref + 3);
+				nextInBucket.push_back(firstInBucket[bucket]);
+				firstInBucket[bucket] = found;
+			}
+			indices[i] = (unsigned int)found;
+		}
+		indexed = true;
+
+		notePeak(byteSize(firstInBucket) + byteSize(nextInBucket) + byteSize(uniqueRefs) + byteSize(indices)
+			+ byteSize(vertVals) + byteSize(stVals) + byteSize(nrmVals) + byteSize(faceRefs));
+
+		size_t numUnique = uniqueRefs.size() / 3;
+		std::cout << "Indexed " << numCorners << " corners into " << numUnique << " unique vertices ("
+			<< (numUnique > 0 ? (double)numCorners / numUnique : 0.0) << "x fewer, "
+			<< ((numUnique <= 65536) ? 16 : 32) << "-bit indices)" << std::endl;
+	}
+
+	// Reorder the triangles so each material's faces are one contiguous range, keeping their order within a material.
+	// Fills materialNames and materialTriangles; a file without usemtl is one range of material ""
+	void groupByMaterial() {
+		size_t numTriangles = faceRefs.size() / 9;
+		const std::vector<MaterialSwitch> & switches = objMaterials.switches;
+		materialNames.clear();
+		materialTriangles.clear();
+
+		// Run i is the faces between switch i - 1 and switch i. Materials are numbered in order of first use
+		std::map<std::string, int> ids;
+		std::vector<int> runMaterial(switches.size() + 1, -1);
+		std::vector<size_t> runBegin(switches.size() + 1), runEnd(switches.size() + 1);
+		for (size_t i = 0; i <= switches.size(); i++) {
+			runBegin[i] = (i == 0) ? 0 : std::min(switches[i - 1].firstTriangle, numTriangles);
+			runEnd[i] = (i == switches.size()) ? numTriangles : std::min(switches[i].firstTriangle, numTriangles);
+			if (runEnd[i] <= runBegin[i])
+				continue; // No faces use it
+
+			std::string name = (i == 0) ? std::string() : switches[i - 1].name;
+			std::map<std::string, int>::iterator found = ids.find(name);
+			if (found == ids.end()) {
+				found = ids.insert(std::make_pair(name, (int)materialNames.size())).first;
+				materialNames.push_back(name);
+				materialTriangles.push_back(0);
+			}
+			runMaterial[i] = found->second;
+			materialTriangles[found->second] += runEnd[i] - runBegin[i];
+		}
+
+		if (materialNames.empty()) {
+			materialNames.push_back(std::string());
+			materialTriangles.push_back(0);
+		}
+		if (materialNames.size() == 1)
+			return; // Already one range
+
+		// Counting sort of the runs into their material's slot
+		std::vector<size_t> next(materialNames.size(), 0);
+		for (size_t m = 1; m < materialNames.size(); m++)
+			next[m] = next[m - 1] + materialTriangles[m - 1];
+
+		std::vector<int> sorted(faceRefs.size());
+		for (size_t i = 0; i <= switches.size(); i++) {
+			if (runMaterial[i] < 0)
+				continue;
+			size_t & slot = next[runMaterial[i]];
+			std::copy(faceRefs.begin() + runBegin[i] * 9, faceRefs.begin() + runEnd[i] * 9, sorted.begin() + slot * 9);
+			slot += runEnd[i] - runBegin[i];
+		}
+		notePeak(byteSize(sorted) + byteSize(faceRefs) + byteSize(vertVals) + byteSize(stVals) + byteSize(nrmVals));
+		faceRefs.swap(sorted);
+
+		std::cout << "Grouped " << numTriangles << " triangles into " << materialNames.size() << " material ranges" << std::endl;
+	}
+
+	// Build one vertex per unique (v, vt, vn) triple and an index per corner, instead of one vertex per corner
+	void buildIndexedMesh() {
+		std::vector<int> uniqueRefs;
+		deduplicateCorners(uniqueRefs);
+
+		// Expand the unique triples the same way the corners would have been
+		faceRefs.swap(uniqueRefs);
+		expandFaces();
+		faceRefs.swap(uniqueRefs);
+	}
+
+	// Write count interleaved vertices, one per (v, vt, vn) triple in refs. Out-of-range references produce zeros
+	void writeVertices(const int * refs, size_t count, Vertex * out) {
+		size_t numPositions = vertVals.size() / 3;
+		size_t numUVs = stVals.size() / 2;
+		size_t numNormals = nrmVals.size() / 3;
+
+		for (size_t i = 0; i < count; i++) {
+			const int * ref = &refs[i * 3];
+			Vertex & vertex = out[i];
+
+			if (ref[0] >= 0 && (size_t)ref[0] < numPositions)
+				vertex.position = glm::vec3(vertVals[ref[0] * 3], vertVals[ref[0] * 3 + 1], vertVals[ref[0] * 3 + 2]);
+			else
+				vertex.position = glm::vec3(0.0f);
+
+			if (ref[1] >= 0 && (size_t)ref[1] < numUVs)
+				vertex.texCoord = glm::vec2(stVals[ref[1] * 2], stVals[ref[1] * 2 + 1]);
+			else
+				vertex.texCoord = glm::vec2(0.0f);
+
+			if (ref[2] >= 0 && (size_t)ref[2] < numNormals)
+				vertex.normal = glm::vec3(nrmVals[ref[2] * 3], nrmVals[ref[2] * 3 + 1], nrmVals[ref[2] * 3 + 2]);
+			else
+				vertex.normal = glm::vec3(0.0f);
+
+			// Filled in by TangentGenerator once the whole mesh is known
+			vertex.tangent = glm::vec4(0.0f);
+		}
+	}
+
+	template <typename T>
+	static size_t byteSize(const std::vector<T> & v) {
+		return v.capacity() * sizeof(T);
+	}
+
+	void notePeak(size_t bytes) {
+		if (bytes > peakBytes)
+			peakBytes = bytes;
+	}
+
+	// Tokenize the whole mapped file into vertVals/stVals/nrmVals/faceRefs, on the pool or on this thread.
+	// With countOnly, the faces are counted into it instead of being stored
+	void readOBJ(const MappedFile & file, bool parallel, ThreadPool & pool, size_t * countOnly = NULL) {
+		objMaterials = ObjMaterials();
+		if (!parallel) {
+			parseBlock(file.getData(), file.getData() + file.getSize(), vertVals, stVals, nrmVals, faceRefs, objMaterials, 0, countOnly);
+			notePeak(byteSize(vertVals) + byteSize(stVals) + byteSize(nrmVals) + byteSize(faceRefs));
+			return;
+		}
+
+		// Chunks of at least 1 MB, a few per thread so uneven lines balance out
+		const size_t minChunkSize = 1 << 20;
+		size_t numChunks = pool.getNumThreads() * 4;
+		if (numChunks > file.getSize() / minChunkSize)
+			numChunks = file.getSize() / minChunkSize;
+		if (numChunks == 0)
+			numChunks = 1;
+
+		std::vector<ObjChunk> chunks;
+		splitIntoChunks(file.getData(), file.getSize(), numChunks, chunks);
+
+		std::vector<size_t> chunkTriangles(chunks.size(), 0);
+		pool.parallelFor(chunks.size(), [&chunks, &chunkTriangles, countOnly](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				ObjChunk & chunk = chunks[i];
+				parseBlock(chunk.begin, chunk.end, chunk.positions, chunk.uvs, chunk.nrms, chunk.refs, chunk.materials,
+					RELATIVE_INDEX, (countOnly != NULL) ? &chunkTriangles[i] : NULL);
+			}
+		});
+		if (countOnly != NULL) {
+			for (size_t i = 0; i < chunks.size(); i++)
+				*countOnly += chunkTriangles[i];
+		}
+
+		// While merging, both the chunks and the merged arrays are alive
+		size_t chunkBytes = 0;
+		for (size_t i = 0; i < chunks.size(); i++)
+			chunkBytes += byteSize(chunks[i].positions) + byteSize(chunks[i].uvs) + byteSize(chunks[i].nrms) + byteSize(chunks[i].refs);
+		mergeChunks(chunks, pool, (countOnly != NULL) ? chunkTriangles.data() : NULL);
+		notePeak(chunkBytes + byteSize(vertVals) + byteSize(stVals) + byteSize(nrmVals) + byteSize(faceRefs));
+	}
+
+	// Split [data, data + size) into pieces that each end right after a newline
+	static void splitIntoChunks(const char * data, size_t size, size_t numChunks, std::vector<ObjChunk> & chunks) {
+		const char * end = data + size;
+		const char * begin = data;
+		for (size_t i = 1; i <= numChunks && begin < end; i++) {
+			const char * split = (i == numChunks) ? end : data + size * i / numChunks;
+			if (split < begin)
+				split = begin;
+			if (split < end)
+				split = skipLine(split, end);
+
+			ObjChunk chunk;
+			chunk.begin = begin;
+			chunk.end = split;
+			chunks.push_back(std::move(chunk));
+			begin = split;
+		}
+	}
+
+	// Append the chunks' attributes and references to the member arrays, each chunk copying into its own slot.
+	// countTriangles has each chunk's triangle count when the faces were only counted
+	void mergeChunks(std::vector<ObjChunk> & chunks, ThreadPool & pool, const size_t * countTriangles = NULL) {
+		std::vector<size_t> positionStart(chunks.size() + 1, 0);
+		std::vector<size_t> uvStart(chunks.size() + 1, 0);
+		std::vector<size_t> nrmStart(chunks.size() + 1, 0);
+		std::vector<size_t> refStart(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); i++) {
+			positionStart[i + 1] = positionStart[i] + chunks[i].positions.size();
+			uvStart[i + 1] = uvStart[i] + chunks[i].uvs.size();
+			nrmStart[i + 1] = nrmStart[i] + chunks[i].nrms.size();
+			refStart[i + 1] = refStart[i] + chunks[i].refs.size();
+		}
+
+		// Material lines are few, so they are merged here. Switches are renumbered from chunk to file triangles
+		// (refs hold 9 ints per triangle; faces aren't stored when only counting, so use the counts instead)
+		size_t trianglesBefore = 0;
+		for (size_t i = 0; i < chunks.size(); i++) {
+			ObjMaterials & materials = chunks[i].materials;
+			objMaterials.libraries.insert(objMaterials.libraries.end(), materials.libraries.begin(), materials.libraries.end());
+			for (size_t j = 0; j < materials.switches.size(); j++) {
+				MaterialSwitch change = materials.switches[j];
+				change.firstTriangle += (countTriangles != NULL) ? trianglesBefore : refStart[i] / 9;
+				objMaterials.switches.push_back(change);
+			}
+			if (countTriangles != NULL)
+				trianglesBefore += countTriangles[i];
+		}
+
+		vertVals.resize(positionStart.back());
+		stVals.resize(uvStart.back());
+		nrmVals.resize(nrmStart.back());
+		faceRefs.resize(refStart.back());
+
+		pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				ObjChunk & chunk = chunks[i];
+				std::copy(chunk.positions.begin(), chunk.positions.end(), vertVals.begin() + positionStart[i]);
+				std::copy(chunk.uvs.begin(), chunk.uvs.end(), stVals.begin() + uvStart[i]);
+				std::copy(chunk.nrms.begin(), chunk.nrms.end(), nrmVals.begin() + nrmStart[i]);
+				std::copy(chunk.refs.begin(), chunk.refs.end(), faceRefs.begin() + refStart[i]);
+
+				// Relative references count from the first v, vt and vn of this chunk
+				size_t attributeStart[3] = { positionStart[i] / 3, uvStart[i] / 2, nrmStart[i] / 3 };
+				for (size_t j = refStart[i]; j < refStart[i + 1]; j++) {
+					int & ref = faceRefs[j];
+					if (ref < -1) {
+						long long absolute = (long long)ref - RELATIVE_INDEX + (long long)attributeStart[j % 3];
+						ref = (absolute >= 0) ? (int)absolute : -1;
+					}
+				}
+
+				// Free the chunk's memory as soon as it has been merged
+				std::vector<float>().swap(chunk.positions);
+				std::vector<float>().swap(chunk.uvs);
+				std::vector<float>().swap(chunk.nrms);
+				std::vector<int>().swap(chunk.refs);
+			}
+		});
+	}
+
+	// Expand corners [begin, end). Out-of-range references produce zeros instead of reading out of bounds
+	void expandCorners(size_t begin, size_t end) {
+		size_t numPositions = vertVals.size() / 3;
+		size_t numUVs = stVals.size() / 2;
+		size_t numNormals = nrmVals.size() / 3;
+
+		for (size_t i = begin; i < end; i++) {
+			const int * ref = &faceRefs[i * 3];
+			float * pos = &triangleVerts[i * 3];
+			float * uv = &textureCoords[i * 2];
+			float * nrm = &normals[i * 3];
+
+			if (ref[0] >= 0 && (size_t)ref[0] < numPositions)
+				memcpy(pos, &vertVals[ref[0] * 3], 3 * sizeof(float));
+			else
+				pos[0] = pos[1] = pos[2] = 0.0f;
+
+			if (ref[1] >= 0 && (size_t)ref[1] < numUVs)
+				memcpy(uv, &stVals[ref[1] * 2], 2 * sizeof(float));
+			else
+				uv[0] = uv[1] = 0.0f;
+
+			if (ref[2] >= 0 && (size_t)ref[2] < numNormals)
+				memcpy(nrm, &nrmVals[ref[2] * 3], 3 * sizeof(float));
+			else
+				nrm[0] = nrm[1] = nrm[2] = 0.0f;
+		}
+	}
+
+	void reportThroughput(const char * filePath, size_t bytes, std::chrono::high_resolution_clock::time_point start) {
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		double megabytes = bytes / (1024.0 * 1024.0);
+		parseThroughput = (seconds > 0.0) ? megabytes / seconds : 0.0;
+		std::cout << "Parsed " << filePath << ": " << megabytes << " MB in " << seconds * 1000.0 << " ms ("
+			<< parseThroughput << " MB/s)" << std::endl;
+	}
+
 public:
 	// Blank constructor
 	ModelImporter() {}
@@ -97,9 +713,221 @@ public:
 		}
 	}
 
+	// Parse the OBJ file by mapping it into memory and tokenizing it in place (no per-line allocations).
+	// Produces the same vertices, texture coordinates and normals as parseOBJ
+	// Pass buildIndices = true to get unique vertices plus an index buffer instead of one vertex per corner
+	bool parseOBJMapped(const char * filePath, bool buildIndices = false) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		MappedFile file;
+		if (!file.open(filePath)) {
+			std::cout << "Could not open OBJ file " << filePath << std::endl;
+			return false;
+		}
+
+		readOBJ(file, false, ThreadPool::shared());
+		if (buildIndices)
+			buildIndexedMesh();
+		else
+			expandFaces();
+
+		reportThroughput(filePath, file.getSize(), start);
+		return true;
+	}
+
+	// Parse the OBJ file on all cores. The mapped file is split into line-aligned chunks that are tokenized in
+	// parallel, then the face references are resolved against the merged attributes in a second parallel pass.
+	// Face references are absolute indices, so the output is identical to parseOBJMapped
+	bool parseOBJParallel(const char * filePath, bool buildIndices = false, ThreadPool & pool = ThreadPool::shared()) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		MappedFile file;
+		if (!file.open(filePath)) {
+			std::cout << "Could not open OBJ file " << filePath << std::endl;
+			return false;
+		}
+
+		readOBJ(file, true, pool);
+		if (buildIndices)
+			buildIndexedMesh(); // Deduplication is order dependent, so it stays serial
+		else
+			expandFacesParallel(pool);
+
+		reportThroughput(filePath, file.getSize(), start);
+		return true;
+	}
+
+	// Parse the OBJ file straight into the interleaved vertex stream (plus indices when buildIndices is set).
+	// This skips the per-attribute output arrays entirely: each vertex is written exactly once, and the parsed
+	// attributes are freed before returning. Collect the result with takeVertexStream/takeIndices.
+	// Triangles come out grouped by material (see getMaterialNames/getMaterialTriangles)
+	bool importOBJ(const char * filePath, bool buildIndices, bool parallel = true, ThreadPool & pool = ThreadPool::shared()) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		peakBytes = 0;
+
+		MappedFile file;
+		if (!file.open(filePath)) {
+			std::cout << "Could not open OBJ file " << filePath << std::endl;
+			return false;
+		}
+		readOBJ(file, parallel, pool);
+		groupByMaterial();
+
+		// Unindexed models get one vertex per corner, indexed ones one per unique triple
+		std::vector<int> uniqueRefs;
+		if (buildIndices)
+			deduplicateCorners(uniqueRefs);
+		const std::vector<int> & refs = buildIndices ? uniqueRefs : faceRefs;
+
+		vertexStream.resize(refs.size() / 3);
+		Vertex * out = vertexStream.data();
+		if (parallel) {
+			pool.parallelFor(vertexStream.size(), [this, &refs, out](size_t begin, size_t end) {
+				writeVertices(&refs[begin * 3], end - begin, out + begin);
+			}, 4096);
+		}
+		else {
+			writeVertices(refs.data(), vertexStream.size(), out);
+		}
+		notePeak(byteSize(vertexStream) + byteSize(indices) + byteSize(uniqueRefs)
+			+ byteSize(vertVals) + byteSize(stVals) + byteSize(nrmVals) + byteSize(faceRefs));
+
+		// The parsed attributes aren't needed any more
+		std::vector<float>().swap(vertVals);
+		std::vector<float>().swap(stVals);
+		std::vector<float>().swap(nrmVals);
+		std::vector<int>().swap(faceRefs);
+
+		reportThroughput(filePath, file.getSize(), start);
+		return true;
+	}
+
+	// Start a streaming import. The attributes (v, vt, vn) are read and kept and the triangles are counted, but no face
+	// data is stored. readVertices() then turns the faces into vertices a block at a time, so apart from the attribute
+	// arrays, memory use is whatever the caller's blocks are, however many faces the file has.
+	// Faces stay in file order, so usemtl is ignored and the stream is one material
+	bool openStream(const char * filePath, ThreadPool & pool = ThreadPool::shared()) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		peakBytes = 0;
+
+		streamFile.reset(new MappedFile());
+		if (!streamFile->open(filePath)) {
+			std::cout << "Could not open OBJ file " << filePath << std::endl;
+			streamFile.reset();
+			return false;
+		}
+
+		streamTriangles = 0;
+		streamCounts[0] = streamCounts[1] = streamCounts[2] = 0;
+		readOBJ(*streamFile, true, pool, &streamTriangles);
+		streamCursor = streamFile->getData();
+		streamRefs.clear();
+		streamRefPosition = 0;
+
+		reportThroughput(filePath, streamFile->getSize(), start);
+		return true;
+	}
+
+	// Number of vertices the stream will produce (one per triangle corner)
+	size_t getStreamVertexCount() {
+		return streamTriangles * 3;
+	}
+
+	// Bounds of every position in the file (a superset of the positions faces use)
+	void getStreamBounds(glm::vec3 & boundsMin, glm::vec3 & boundsMax) {
+		boundsMin = boundsMax = glm::vec3(0.0f);
+		for (size_t i = 0; i + 2 < vertVals.size(); i += 3) {
+			glm::vec3 position(vertVals[i], vertVals[i + 1], vertVals[i + 2]);
+			boundsMin = (i == 0) ? position : glm::min(boundsMin, position);
+			boundsMax = (i == 0) ? position : glm::max(boundsMax, position);
+		}
+	}
+
+	// Write the next whole triangles of the stream into out, one vertex per corner, up to capacity vertices.
+	// Returns how many vertices were written (a multiple of 3), 0 once every face has been read
+	size_t readVertices(Vertex * out, size_t capacity) {
+		if (!streamFile)
+			return 0;
+		capacity -= capacity % 3;
+		const char * end = streamFile->getData() + streamFile->getSize();
+
+		size_t written = 0;
+		while (written < capacity) {
+			// Hand out what is left of the current face line first
+			if (streamRefPosition < streamRefs.size()) {
+				size_t count = std::min((streamRefs.size() - streamRefPosition) / 3, capacity - written);
+				writeVertices(&streamRefs[streamRefPosition], count, out + written);
+				streamRefPosition += count * 3;
+				written += count;
+				continue;
+			}
+			if (streamCursor >= end)
+				break;
+
+			streamRefs.clear();
+			streamRefPosition = 0;
+			const char * lineEnd = skipLine(streamCursor, end);
+			const char * p = skipBlanks(streamCursor, lineEnd);
+			if (lineEnd - p >= 2 && p[0] == 'f' && isBlank(p[1]))
+				parseFace(p + 1, lineEnd, streamCounts, 0, streamRefs);
+			else if (lineEnd - p >= 2 && p[0] == 'v' && isBlank(p[1]))
+				streamCounts[0]++;
+			else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 't')
+				streamCounts[1]++;
+			else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 'n')
+				streamCounts[2]++;
+			streamCursor = lineEnd;
+		}
+		return written;
+	}
+
+	// Unmap the streamed file and free the attributes
+	void closeStream() {
+		streamFile.reset();
+		streamCursor = NULL;
+		std::vector<int>().swap(streamRefs);
+		std::vector<float>().swap(vertVals);
+		std::vector<float>().swap(stVals);
+		std::vector<float>().swap(nrmVals);
+	}
+
+	// Hand the interleaved stream / index list over to the caller without copying
+	void takeVertexStream(std::vector<Vertex> & out) {
+		out.swap(vertexStream);
+		std::vector<Vertex>().swap(vertexStream);
+	}
+
+	void takeIndices(std::vector<unsigned int> & out) {
+		out.swap(indices);
+		std::vector<unsigned int>().swap(indices);
+	}
+
+	// Parse with the chosen strategy. The stream parser is the original one and never builds indices
+	enum ParseMode { PARSE_STREAM, PARSE_MAPPED, PARSE_PARALLEL };
+
+	bool parse(const char * filePath, ParseMode mode, bool buildIndices = false) {
+		switch (mode) {
+		case PARSE_STREAM:
+			parseOBJ(filePath);
+			return true;
+		case PARSE_MAPPED:
+			return parseOBJMapped(filePath, buildIndices);
+		default:
+			return parseOBJParallel(filePath, buildIndices);
+		}
+	}
+
 	// Accessor Methods
+	double getParseThroughput() {
+		return parseThroughput;
+	}
+
+	size_t getPeakBytes() {
+		return peakBytes;
+	}
+
 	int getNumVertices() {
-		return (triangleVerts.size() / 3);
+		return vertexStream.empty() ? (int)(triangleVerts.size() / 3) : (int)vertexStream.size();
 	}
 
 	std::vector<float> getVertices() {
@@ -114,4 +942,31 @@ public:
 		return normals;
 	}
 
+	bool isIndexed() {
+		return indexed;
+	}
+
+	// mtllib files named by the last import, as written in the OBJ (relative to its folder)
+	std::vector<std::string> getMaterialLibraries() {
+		return objMaterials.libraries;
+	}
+
+	// Materials of the last importOBJ in output order, and the number of triangles of each
+	std::vector<std::string> getMaterialNames() {
+		return materialNames;
+	}
+
+	std::vector<size_t> getMaterialTriangles() {
+		return materialTriangles;
+	}
+
+	std::vector<unsigned int> getIndices() {
+		return indices;
+	}
+
+	// Bytes per index the mesh needs: 16-bit indices whenever every vertex fits
+	int getIndexSize() {
+		return (getNumVertices() <= 65536) ? 2 : 4;
+	}
+
 };
@@ -0,0 +1,200 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class writes synthetic OBJ files of any size for benchmarking the importer. The mesh is a wavy
+ *              grid, so neighbouring faces share corners the way exported models do, and the output is the same
+ *              every time for the same settings
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+class ObjGenerator {
+
+private:
+	// Buffered text output with fixed-point float formatting (printf would dominate the time for big files)
+	class Writer {
+	private:
+		FILE * file;
+		std::vector<char> buffer;
+		size_t used;
+
+	public:
+		explicit Writer(FILE * out) : file(out), buffer(1 << 20), used(0) {}
+
+		~Writer() {
+			flush();
+		}
+
+		void flush() {
+			if (used > 0)
+				fwrite(buffer.data(), 1, used, file);
+			used = 0;
+		}
+
+		void text(const char * s) {
+			size_t length = strlen(s);
+			if (used + length > buffer.size())
+				flush();
+			memcpy(buffer.data() + used, s, length);
+			used += length;
+		}
+
+		void integer(unsigned long long value) {
+			char digits[24];
+			int count = 0;
+			do {
+				digits[count++] = (char)('0' + value % 10);
+				value /= 10;
+			} while (value > 0);
+
+			if (used + count > buffer.size())
+				flush();
+			while (count > 0)
+				buffer[used++] = digits[--count];
+		}
+
+		// Six decimal places, like "%.6f"
+		void decimal(float value) {
+			long long fixed = (long long)std::floor(std::fabs((double)value) * 1000000.0 + 0.5);
+			if (value < 0.0f && fixed != 0)
+				text("-");
+			integer((unsigned long long)(fixed / 1000000));
+
+			char fraction[8] = { '.', '0', '0', '0', '0', '0', '0', '\0' };
+			long long remainder = fixed % 1000000;
+			for (int i = 6; i >= 1; i--) {
+				fraction[i] = (char)('0' + remainder % 10);
+				remainder /= 10;
+			}
+			text(fraction);
+		}
+	};
+
+	// Height of the grid at (x, y), and its normal
+	static float height(float x, float y) {
+		return 0.1f * std::sin(x * 6.0f) * std::cos(y * 5.0f);
+	}
+
+	static void normal(float x, float y, float & nx, float & ny, float & nz) {
+		float dx = 0.6f * std::cos(x * 6.0f) * std::cos(y * 5.0f);
+		float dy = -0.5f * std::sin(x * 6.0f) * std::sin(y * 5.0f);
+		float length = std::sqrt(dx * dx + dy * dy + 1.0f);
+		nx = -dx / length;
+		ny = -dy / length;
+		nz = 1.0f / length;
+	}
+
+	// One face corner. Attributes share the vertex's index
+	static void corner(Writer & out, unsigned long long index, bool withTexCoords, bool withNormals) {
+		out.text(" ");
+		out.integer(index);
+		if (withTexCoords || withNormals) {
+			out.text("/");
+			if (withTexCoords)
+				out.integer(index);
+			if (withNormals) {
+				out.text("/");
+				out.integer(index);
+			}
+		}
+	}
+
+public:
+	// Write an OBJ with exactly numFaces triangles, with or without vt and vn lines. Returns false if the file
+	// can't be written
+	static bool write(const char * filePath, unsigned long long numFaces, bool withTexCoords, bool withNormals) {
+		FILE * file = fopen(filePath, "wb");
+		if (file == NULL)
+			return false;
+
+		// Smallest near-square grid of quads (2 triangles each) with enough faces
+		unsigned long long numQuads = (numFaces + 1) / 2;
+		unsigned long long columns = (unsigned long long)std::ceil(std::sqrt((double)numQuads));
+		if (columns == 0)
+			columns = 1;
+		unsigned long long rows = (numQuads + columns - 1) / columns;
+		if (rows == 0)
+			rows = 1;
+
+		{
+			Writer out(file);
+			out.text("# Synthetic grid: ");
+			out.integer(numFaces);
+			out.text(" faces\n");
+
+			for (unsigned long long r = 0; r <= rows; r++) {
+				for (unsigned long long c = 0; c <= columns; c++) {
+					float u = (float)c / columns;
+					float v = (float)r / rows;
+					float x = u * 2.0f - 1.0f;
+					float y = v * 2.0f - 1.0f;
+
+					out.text("v ");
+					out.decimal(x);
+					out.text(" ");
+					out.decimal(height(x, y));
+					out.text(" ");
+					out.decimal(-y);
+					out.text("\n");
+
+					if (withTexCoords) {
+						out.text("vt ");
+						out.decimal(u);
+						out.text(" ");
+						out.decimal(v);
+						out.text("\n");
+					}
+
+					if (withNormals) {
+						// The grid lies in x/-z with height along y
+						float nx, ny, nz;
+						normal(x, y, nx, ny, nz);
+						out.text("vn ");
+						out.decimal(nx);
+						out.text(" ");
+						out.decimal(nz);
+						out.text(" ");
+						out.decimal(-ny);
+						out.text("\n");
+					}
+				}
+			}
+
+			// Counter-clockwise seen from +y
+			unsigned long long written = 0;
+			for (unsigned long long r = 0; r < rows && written < numFaces; r++) {
+				for (unsigned long long c = 0; c < columns && written < numFaces; c++) {
+					unsigned long long i00 = r * (columns + 1) + c + 1; // OBJ indices are one-based
+					unsigned long long i10 = i00 + 1;
+					unsigned long long i01 = i00 + columns + 1;
+					unsigned long long i11 = i01 + 1;
+
+					out.text("f");
+					corner(out, i00, withTexCoords, withNormals);
+					corner(out, i10, withTexCoords, withNormals);
+					corner(out, i11, withTexCoords, withNormals);
+					out.text("\n");
+					written++;
+
+					if (written < numFaces) {
+						out.text("f");
+						corner(out, i00, withTexCoords, withNormals);
+						corner(out, i11, withTexCoords, withNormals);
+						corner(out, i01, withTexCoords, withNormals);
+						out.text("\n");
+						written++;
+					}
+				}
+			}
+		}
+
+		bool ok = (ferror(file) == 0);
+		return (fclose(file) == 0) && ok;
+	}
+
+};
@@ -0,0 +1,208 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class reads a scene file: the sky, the meshes the scene uses and the nodes that place them. Nodes
+ *              come out in one flat array with every parent before its children, so a single pass over it can
+ *              build the transforms and draw. A line per keyword, like OBJ and MTL files:
+ *
+ *                sky <cube map folder>
+ *                mesh <name> <obj> <fallback texture> [impostor]     drawn with the texture if the OBJ names no material
+ *                plane <name> <half size> <texture> <normal map>     a flat square, normal mapped
+ *                node <name> [parent]                                the lines below describe it, up to the next node
+ *                  draw <mesh> [fac]                                 fac mixes sky reflection (0) and texture (1)
+ *                  translate <x> <y> <z>
+ *                  rotate <degrees> <x> <y> <z>
+ *                  scale <s> | scale <x> <y> <z>
+ *                  animate <name>                                    a transform the program computes every frame
+ *
+ *              A node's transform is its translate/rotate/scale/animate lines multiplied in order. Names of
+ *              animations are collected for the program to supply; a parent has to be declared before its children
+ */
+
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// A mesh nodes can draw: an OBJ, or a generated plane
+struct SceneMesh {
+	std::string name;
+	std::string path;				// OBJ file, "" for a plane
+	std::string texture;			// Fallback texture of an OBJ, the texture of a plane
+	std::string normalMap;			// Planes only
+	float planeSize;				// Half the side of a plane
+	bool impostor;					// Drawn as an impostor when far away
+};
+
+struct SceneNode {
+	std::string name;
+	int parent;						// Index of an earlier node, -1 for none (the view)
+	int mesh;						// Index into meshes, -1 for a node that only places its children
+	float fac;
+	glm::mat4 beforeAnimation;		// The transform is beforeAnimation * animation * afterAnimation
+	int animation;					// Index into animations, -1 for a static node
+	glm::mat4 afterAnimation;
+};
+
+class Scene {
+
+private:
+	static bool fail(const std::string & path, int line, const std::string & message) {
+		std::cout << path << ":" << line << ": " << message << std::endl;
+		return false;
+	}
+
+	template <typename T> static int findByName(const std::vector<T> & list, const std::string & name) {
+		for (size_t i = 0; i < list.size(); i++) {
+			if (list[i].name == name)
+				return (int)i;
+		}
+		return -1;
+	}
+
+public:
+	std::string skyPath;
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneNode> nodes;			// Parents before children
+	std::vector<std::string> animations;	// Names of the animations nodes use
+
+	int findMesh(const std::string & name) const {
+		return findByName(meshes, name);
+	}
+
+	int findNode(const std::string & name) const {
+		return findByName(nodes, name);
+	}
+
+	int findAnimation(const std::string & name) const {
+		for (size_t i = 0; i < animations.size(); i++) {
+			if (animations[i] == name)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	// Read the scene at path into out. Problems are reported with their line, and nothing is kept if there is one
+	static bool load(const std::string & path, Scene & out) {
+		std::ifstream fileStream(path.c_str(), std::ios::in);
+		if (!fileStream)
+			return fail(path, 0, "could not open scene");
+
+		Scene scene;
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(fileStream, line)) {
+			lineNumber++;
+			std::istringstream ss(line);
+			std::string keyword;
+			if (!(ss >> keyword) || keyword[0] == '#')
+				continue;
+
+			if (keyword == "sky") {
+				ss >> scene.skyPath;
+			}
+			else if (keyword == "mesh" || keyword == "plane") {
+				SceneMesh mesh;
+				mesh.planeSize = 0.0f;
+				mesh.impostor = false;
+				if (keyword == "mesh") {
+					std::string option;
+					if (!(ss >> mesh.name >> mesh.path >> mesh.texture))
+						return fail(path, lineNumber, "expected mesh <name> <obj> <fallback texture>");
+					while (ss >> option) {
+						if (option == "impostor")
+							mesh.impostor = true;
+						else
+							return fail(path, lineNumber, "unknown mesh option " + option);
+					}
+				}
+				else if (!(ss >> mesh.name >> mesh.planeSize >> mesh.texture >> mesh.normalMap)) {
+					return fail(path, lineNumber, "expected plane <name> <half size> <texture> <normal map>");
+				}
+				if (scene.findMesh(mesh.name) >= 0)
+					return fail(path, lineNumber, "mesh " + mesh.name + " is declared twice");
+				scene.meshes.push_back(mesh);
+			}
+			else if (keyword == "node") {
+				SceneNode node;
+				std::string parent;
+				if (!(ss >> node.name))
+					return fail(path, lineNumber, "expected node <name> [parent]");
+				node.parent = -1;
+				if (ss >> parent) {
+					node.parent = scene.findNode(parent);
+					if (node.parent < 0)
+						return fail(path, lineNumber, "parent " + parent + " has to be declared before " + node.name);
+				}
+				node.mesh = -1;
+				node.fac = 1.0f;
+				node.beforeAnimation = glm::mat4(1.0f);
+				node.animation = -1;
+				node.afterAnimation = glm::mat4(1.0f);
+				scene.nodes.push_back(node);
+			}
+			else {
+				if (scene.nodes.empty())
+					return fail(path, lineNumber, keyword + " has to follow a node");
+
+				SceneNode & node = scene.nodes.back();
+				glm::mat4 & transform = (node.animation >= 0) ? node.afterAnimation : node.beforeAnimation;
+				if (keyword == "draw") {
+					std::string mesh;
+					ss >> mesh;
+					float fac = 1.0f;
+					node.mesh = scene.findMesh(mesh);
+					if (node.mesh < 0)
+						return fail(path, lineNumber, "no mesh called " + mesh);
+					if (ss >> fac)
+						node.fac = fac;
+				}
+				else if (keyword == "translate") {
+					glm::vec3 offset(0.0f);
+					if (!(ss >> offset.x >> offset.y >> offset.z))
+						return fail(path, lineNumber, "expected translate <x> <y> <z>");
+					transform = glm::translate(transform, offset);
+				}
+				else if (keyword == "rotate") {
+					float degrees = 0.0f;
+					glm::vec3 axis(0.0f);
+					if (!(ss >> degrees >> axis.x >> axis.y >> axis.z))
+						return fail(path, lineNumber, "expected rotate <degrees> <x> <y> <z>");
+					transform = glm::rotate(transform, glm::radians(degrees), axis);
+				}
+				else if (keyword == "scale") {
+					glm::vec3 factors(1.0f);
+					if (!(ss >> factors.x))
+						return fail(path, lineNumber, "expected scale <s> or scale <x> <y> <z>");
+					if (!(ss >> factors.y >> factors.z))
+						factors = glm::vec3(factors.x);
+					transform = glm::scale(transform, factors);
+				}
+				else if (keyword == "animate") {
+					std::string name;
+					if (!(ss >> name))
+						return fail(path, lineNumber, "expected animate <name>");
+					if (node.animation >= 0)
+						return fail(path, lineNumber, "node " + node.name + " already has an animation");
+					node.animation = scene.findAnimation(name);
+					if (node.animation < 0) {
+						node.animation = (int)scene.animations.size();
+						scene.animations.push_back(name);
+					}
+				}
+				else {
+					return fail(path, lineNumber, "unknown keyword " + keyword);
+				}
+			}
+		}
+
+		out = scene;
+		return true;
+	}
+
+};
@@ -0,0 +1,95 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: The uniform blocks the scene's shaders share, as C++ structs laid out like std140 lays out the blocks
+ *              in res/shaders/include/frame.glsl and material.glsl. FrameBlock holds what changes once a frame
+ *              (matrices, lights, sky light) and MaterialBlock what a material draws with. registerBlocks() gives
+ *              ShaderProgram their binding points and layouts, so a program whose blocks disagree with these structs
+ *              is caught as soon as it links
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+
+// PositionalLight in frame.glsl
+struct LightUniforms {
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	glm::vec3 position;
+	float padding;
+	glm::vec3 direction;
+	float cutoff;
+};
+
+// FrameBlock in frame.glsl
+struct FrameUniforms {
+	glm::mat4 projection;			// proj_matrix
+	glm::mat4 view;					// v_matrix
+	glm::mat4 environment;			// env_matrix: view space to world space directions, in its upper 3x3
+	glm::vec4 globalAmbient;
+	LightUniforms light;
+	glm::vec4 skyIrradiance[9];		// Spherical harmonics from EnvironmentMap, in xyz
+};
+
+// MaterialBlock in material.glsl
+struct MaterialUniforms {
+	glm::vec4 ambient;				// material.ambient ... material.shininess
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float shininess;
+	float padding[3];
+	glm::vec4 baseColor;
+	float roughness;
+	int texLayer;
+	float padding2[2];
+};
+
+class SceneUniforms {
+
+public:
+	static const GLuint FRAME_BINDING = 0;
+	static const GLuint MATERIAL_BINDING = 1;
+
+	// Before any program using the blocks is built
+	static void registerBlocks() {
+		UniformBlockLayout frame;
+		frame.name = "FrameBlock";
+		frame.binding = FRAME_BINDING;
+		frame.size = sizeof(FrameUniforms);
+		frame.members = {
+			{ "proj_matrix", offsetof(FrameUniforms, projection) },
+			{ "v_matrix", offsetof(FrameUniforms, view) },
+			{ "env_matrix", offsetof(FrameUniforms, environment) },
+			{ "globalAmbient", offsetof(FrameUniforms, globalAmbient) },
+			{ "light.ambient", offsetof(FrameUniforms, light) + offsetof(LightUniforms, ambient) },
+			{ "light.diffuse", offsetof(FrameUniforms, light) + offsetof(LightUniforms, diffuse) },
+			{ "light.specular", offsetof(FrameUniforms, light) + offsetof(LightUniforms, specular) },
+			{ "light.position", offsetof(FrameUniforms, light) + offsetof(LightUniforms, position) },
+			{ "light.direction", offsetof(FrameUniforms, light) + offsetof(LightUniforms, direction) },
+			{ "light.cutoff", offsetof(FrameUniforms, light) + offsetof(LightUniforms, cutoff) },
+			{ "skyIrradiance", offsetof(FrameUniforms, skyIrradiance) }
+		};
+		ShaderProgram::registerBlock(frame);
+
+		UniformBlockLayout material;
+		material.name = "MaterialBlock";
+		material.binding = MATERIAL_BINDING;
+		material.size = sizeof(MaterialUniforms);
+		material.members = {
+			{ "material.ambient", offsetof(MaterialUniforms, ambient) },
+			{ "material.diffuse", offsetof(MaterialUniforms, diffuse) },
+			{ "material.specular", offsetof(MaterialUniforms, specular) },
+			{ "material.shininess", offsetof(MaterialUniforms, shininess) },
+			{ "baseColor", offsetof(MaterialUniforms, baseColor) },
+			{ "roughness", offsetof(MaterialUniforms, roughness) },
+			{ "texLayer", offsetof(MaterialUniforms, texLayer) }
+		};
+		ShaderProgram::registerBlock(material);
+	}
+
+};
@@ -0,0 +1,174 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps linked shader programs on disk (glGetProgramBinary) so later runs can skip compiling
+ *              and linking. Each vertex/fragment file pair has one cache file next to the shaders. It is only used when
+ *              the hash of the exact sources handed to the compiler and the driver's vendor, renderer and version all
+ *              match, and the driver may still reject it, in which case the program is compiled as usual
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Fixed-size header at the start of every program cache file. The binary follows it
+struct ShaderCacheHeader {
+	char magic[4];			// "OGLP"
+	uint32_t version;
+	uint64_t key;			// ShaderCache::key() of the sources and driver the binary was built from
+	uint32_t binaryFormat;	// As returned by glGetProgramBinary
+	uint32_t binarySize;
+};
+
+class ShaderCache {
+
+private:
+	// 64-bit FNV-1a, continued from hash
+	static uint64_t hashBytes(const char * bytes, size_t size, uint64_t hash) {
+		for (size_t i = 0; i < size; i++) {
+			hash ^= (unsigned char)bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static uint64_t hashString(const std::string & s, uint64_t hash) {
+		// The terminator keeps ("ab", "c") and ("a", "bc") apart
+		return hashBytes(s.c_str(), s.size() + 1, hash);
+	}
+
+	static std::string glString(GLenum name) {
+		const GLubyte * value = glGetString(name);
+		return (value == NULL) ? std::string() : std::string((const char *)value);
+	}
+
+	static std::string baseName(const std::string & path) {
+		size_t slash = path.find_last_of("/\\");
+		std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+		size_t dot = name.find_last_of('.');
+		return (dot == std::string::npos) ? name : name.substr(0, dot);
+	}
+
+public:
+	// Version 1: first version
+	static const uint32_t VERSION = 1;
+
+	// Whether the driver can hand out program binaries at all
+	static bool isSupported() {
+		if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+			return false;
+		GLint numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		return numFormats > 0;
+	}
+
+	// Cache file for a permutation (sections and #defines) of the program built from vertexPath and fragmentPath:
+	// res/shaders/vertShader_F+fragShader_F.<hash of permutation>.progcache
+	static std::string cachePath(const std::string & vertexPath, const std::string & fragmentPath, const std::string & permutation) {
+		size_t slash = vertexPath.find_last_of("/\\");
+		std::string folder = (slash == std::string::npos) ? std::string() : vertexPath.substr(0, slash + 1);
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), ".%08x", (unsigned int)hashString(permutation, 14695981039346656037ULL));
+		return folder + baseName(vertexPath) + "+" + baseName(fragmentPath) + suffix + ".progcache";
+	}
+
+	// Hash of the sources exactly as they are compiled, and of the driver (binaries are only valid on the driver that made them)
+	static uint64_t key(const std::string & vertexSource, const std::string & fragmentSource) {
+		uint64_t hash = 14695981039346656037ULL;
+		hash = hashString(vertexSource, hash);
+		hash = hashString(fragmentSource, hash);
+		hash = hashString(glString(GL_VENDOR), hash);
+		hash = hashString(glString(GL_RENDERER), hash);
+		hash = hashString(glString(GL_VERSION), hash);
+		return hash;
+	}
+
+	// Create a program from the cache at path if it was built for key and the driver accepts it. Returns 0 otherwise,
+	// after printing why
+	static GLuint load(const std::string & path, uint64_t expectedKey) {
+		if (!isSupported())
+			return 0;
+
+		std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+		ShaderCacheHeader header;
+		if (!in.read((char *)&header, sizeof(header))) {
+			std::cout << "Shader cache miss for " << path << " (no cache yet)" << std::endl;
+			return 0;
+		}
+		if (memcmp(header.magic, "OGLP", 4) != 0 || header.version != VERSION || header.key != expectedKey) {
+			std::cout << "Shader cache miss for " << path << " (sources or driver changed)" << std::endl;
+			return 0;
+		}
+
+		std::vector<char> binary(header.binarySize);
+		if (!in.read(binary.data(), (std::streamsize)binary.size())) {
+			std::cout << "Shader cache miss for " << path << " (truncated)" << std::endl;
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked != 1) {
+			std::cout << "Shader cache miss for " << path << " (binary rejected by the driver)" << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	// Store the linked program under key. The program should have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	// Written under a temporary name and renamed, like the mesh cache
+	static bool save(const std::string & path, uint64_t programKey, GLuint program) {
+		if (!isSupported())
+			return false;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return false;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		GLsizei written = 0;
+		glGetProgramBinary(program, length, &written, &format, binary.data());
+		if (written <= 0)
+			return false;
+
+		ShaderCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "OGLP", 4);
+		header.version = VERSION;
+		header.key = programKey;
+		header.binaryFormat = (uint32_t)format;
+		header.binarySize = (uint32_t)written;
+
+		std::string tempPath = path + ".tmp";
+		std::ofstream out(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write((const char *)&header, sizeof(header));
+		out.write(binary.data(), written);
+		out.close();
+		if (!out) {
+			std::remove(tempPath.c_str());
+			std::cout << "Could not write shader cache " << path << std::endl;
+			return false;
+		}
+
+		// rename() won't replace an existing file on Windows
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+};
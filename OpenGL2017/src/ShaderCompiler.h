@@ -0,0 +1,258 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class compiles and links shader programs without waiting for them. Programs are submitted in a
+ *              batch, so the driver can work on all of them at once (on its own threads with
+ *              GL_KHR_parallel_shader_compile), and poll() picks up the ones that are done, using GL_COMPLETION_STATUS_KHR
+ *              so asking never blocks. Without the extension, poll() finishes one program per call instead, to spread the
+ *              stalls over several frames. Linked programs go through ShaderCache like createShaderProgram's, and
+ *              are handed out wrapped in a ShaderProgram, which reads their uniforms and binds their blocks as they link
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <GLFW\glfw3.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ShaderCache.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderProgram.h"
+
+// From GL_KHR_parallel_shader_compile (same values as the ARB version), for GLEW builds that predate it
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+class ShaderCompiler {
+
+public:
+	enum Status { COMPILING, READY, FAILED };
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef void (APIENTRY * MaxShaderCompilerThreadsProc)(GLuint count);
+
+	struct Job {
+		std::string name;
+		PreprocessedShader vertex, fragment;
+		GLuint vertexShader, fragmentShader, program;
+		std::string cacheFile;
+		uint64_t cacheKey;
+		Status status;
+		Clock::time_point submitted;
+		std::shared_ptr<ShaderProgram> linked;	// Once it is READY
+	};
+
+	std::vector<Job> jobs;
+	int numCompiling;
+	bool parallel;	// Whether the driver can say when a program is done without blocking
+	bool checkedExtension;
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	static void printShaderLog(GLuint shader) {
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		if (length > 1) {
+			std::vector<char> log(length);
+			glGetShaderInfoLog(shader, length, NULL, log.data());
+			std::cout << "Shader Info Log: " << log.data() << std::endl;
+		}
+	}
+
+	static void printProgramLog(GLuint program) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		if (length > 1) {
+			std::vector<char> log(length);
+			glGetProgramInfoLog(program, length, NULL, log.data());
+			std::cout << "Program Info Log: " << log.data() << std::endl;
+		}
+	}
+
+	// Look for the extension once there is a context, and let the driver use as many threads as it likes
+	void checkExtension() {
+		if (checkedExtension)
+			return;
+		checkedExtension = true;
+
+		MaxShaderCompilerThreadsProc maxThreads = NULL;
+		if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+			maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+			maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+		parallel = (maxThreads != NULL);
+		if (parallel)
+			maxThreads(0xFFFFFFFF);
+		std::cout << "Parallel shader compilation " << (parallel ? "available" : "not available, finishing one program per poll") << std::endl;
+	}
+
+	bool isComplete(const Job & job) {
+		if (!parallel)
+			return true;
+		GLint complete = 0;
+		glGetProgramiv(job.program, GL_COMPLETION_STATUS_KHR, &complete);
+		return complete != 0;
+	}
+
+	// Check the link of a job whose program is done (blocks if it isn't) and report it
+	void complete(Job & job) {
+		GLint linked = 0;
+		glGetProgramiv(job.program, GL_LINK_STATUS, &linked);
+
+		if (linked != 1) {
+			GLint compiled = 0;
+			glGetShaderiv(job.vertexShader, GL_COMPILE_STATUS, &compiled);
+			if (compiled != 1) {
+				std::cout << job.name << ": vertex compilation failed" << std::endl;
+				printShaderLog(job.vertexShader);
+				ShaderPreprocessor::printFiles(job.vertex);
+			}
+			glGetShaderiv(job.fragmentShader, GL_COMPILE_STATUS, &compiled);
+			if (compiled != 1) {
+				std::cout << job.name << ": fragment compilation failed" << std::endl;
+				printShaderLog(job.fragmentShader);
+				ShaderPreprocessor::printFiles(job.fragment);
+			}
+			std::cout << job.name << ": linking failed" << std::endl;
+			printProgramLog(job.program);
+			glDeleteProgram(job.program);
+			job.program = 0;
+			job.status = FAILED;
+		}
+		else {
+			std::cout << job.name << " compiled and linked, ready " << millisecondsSince(job.submitted) << " ms after it was submitted" << std::endl;
+			ShaderCache::save(job.cacheFile, job.cacheKey, job.program);
+			glDetachShader(job.program, job.vertexShader);
+			glDetachShader(job.program, job.fragmentShader);
+			job.linked = std::make_shared<ShaderProgram>(job.program, job.name, job.vertex.source + job.fragment.source);
+			job.status = READY;
+		}
+
+		glDeleteShader(job.vertexShader);
+		glDeleteShader(job.fragmentShader);
+		job.vertexShader = job.fragmentShader = 0;
+		job.vertex.source.clear();
+		job.fragment.source.clear();
+		numCompiling--;
+	}
+
+	ShaderCompiler(const ShaderCompiler &);
+	ShaderCompiler & operator=(const ShaderCompiler &);
+
+public:
+	ShaderCompiler() : numCompiling(0), parallel(false), checkedExtension(false) {}
+
+	// Start building a program (needs the GL context). Returns its handle. Programs found in the program cache are ready
+	// straight away; the rest are compiled and linked in the background
+	int submit(const ShaderSource & vertexSource, const ShaderSource & fragmentSource) {
+		checkExtension();
+
+		Job job;
+		job.name = vertexSource.describe() + " and " + fragmentSource.describe();
+		job.vertex = ShaderPreprocessor::process(vertexSource);
+		job.fragment = ShaderPreprocessor::process(fragmentSource);
+		job.vertexShader = job.fragmentShader = 0;
+		job.submitted = Clock::now();
+
+		// Reuse the program linked by an earlier run if the sources and driver are unchanged
+		job.cacheFile = ShaderCache::cachePath(vertexSource.path, fragmentSource.path, job.name);
+		job.cacheKey = ShaderCache::key(job.vertex.source, job.fragment.source);
+		job.program = ShaderCache::load(job.cacheFile, job.cacheKey);
+		if (job.program != 0) {
+			std::cout << "Shader cache hit for " << job.cacheFile << ", loaded in " << millisecondsSince(job.submitted) << " ms" << std::endl;
+			job.linked = std::make_shared<ShaderProgram>(job.program, job.name, job.vertex.source + job.fragment.source);
+			job.status = READY;
+			job.vertex.source.clear();
+			job.fragment.source.clear();
+			jobs.push_back(job);
+			return (int)jobs.size() - 1;
+		}
+
+		if (!job.vertex.ok || !job.fragment.ok) {
+			std::cout << job.name << ": could not read the sources" << std::endl;
+			job.status = FAILED;
+			jobs.push_back(job);
+			return (int)jobs.size() - 1;
+		}
+
+		// Compile and link without asking how it went: any query before the driver is done would wait for it
+		const char * vertexText = job.vertex.source.c_str();
+		const char * fragmentText = job.fragment.source.c_str();
+		job.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+		job.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(job.vertexShader, 1, &vertexText, NULL);
+		glShaderSource(job.fragmentShader, 1, &fragmentText, NULL);
+		glCompileShader(job.vertexShader);
+		glCompileShader(job.fragmentShader);
+
+		job.program = glCreateProgram();
+		glAttachShader(job.program, job.vertexShader);
+		glAttachShader(job.program, job.fragmentShader);
+		if (ShaderCache::isSupported())
+			glProgramParameteri(job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(job.program);
+
+		job.status = COMPILING;
+		jobs.push_back(job);
+		numCompiling++;
+		return (int)jobs.size() - 1;
+	}
+
+	// Pick up programs the driver has finished. Never blocks with the extension; without it, finishes the oldest program.
+	// Returns how many programs are still compiling
+	int poll() {
+		for (size_t i = 0; i < jobs.size() && numCompiling > 0; i++) {
+			if (jobs[i].status != COMPILING)
+				continue;
+			if (isComplete(jobs[i])) {
+				complete(jobs[i]);
+				if (!parallel)
+					break;
+			}
+		}
+		return numCompiling;
+	}
+
+	// Wait for every submitted program (startup, where blocking is fine)
+	void finishAll() {
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (jobs[i].status == COMPILING)
+				complete(jobs[i]);
+		}
+	}
+
+	// Wait for one program
+	void finish(int handle) {
+		if (jobs[handle].status == COMPILING)
+			complete(jobs[handle]);
+	}
+
+	Status getStatus(int handle) {
+		return jobs[handle].status;
+	}
+
+	// The linked program, or 0 while it is compiling or if it failed
+	GLuint getProgram(int handle) {
+		return (jobs[handle].status == READY) ? jobs[handle].program : 0;
+	}
+
+	// The linked program with its uniforms and blocks, or NULL while it is compiling or if it failed
+	const ShaderProgram * getShaderProgram(int handle) {
+		return (jobs[handle].status == READY) ? jobs[handle].linked.get() : NULL;
+	}
+
+	int getNumCompiling() {
+		return numCompiling;
+	}
+
+};
@@ -0,0 +1,87 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class builds each specialized version (permutation) of a shader program the first time it is asked
+ *              for and hands out the same program afterwards. Permutations are told apart by their files, sections and
+ *              #defines, so a renderer can pick a program per material without branching on uniforms in the shader.
+ *              New permutations compile in the background (ShaderCompiler); until one is ready the fallback program
+ *              is handed out instead, so adding a variant never stalls a frame
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include "ShaderCompiler.h"
+#include "ShaderPreprocessor.h"
+
+class ShaderPermutations {
+
+private:
+	ShaderCompiler & compiler;
+	const ShaderProgram * fallback;
+	std::map<std::string, int> programs; // Compiler handle of each permutation
+
+	ShaderPermutations(const ShaderPermutations &);
+	ShaderPermutations & operator=(const ShaderPermutations &);
+
+	int find(const ShaderSource & vertex, const ShaderSource & fragment) {
+		std::string key = vertex.describe() + " + " + fragment.describe();
+		std::map<std::string, int>::iterator found = programs.find(key);
+		if (found != programs.end())
+			return found->second;
+
+		int handle = compiler.submit(vertex, fragment);
+		programs[key] = handle;
+		std::cout << "Shader permutation " << programs.size() << ": " << key << std::endl;
+		return handle;
+	}
+
+public:
+	// Permutations are built by compiler, whose poll() has to be called (every frame) for them to become ready
+	ShaderPermutations(ShaderCompiler & shaderCompiler) : compiler(shaderCompiler), fallback(NULL) {}
+
+	// Handed out for permutations that are still compiling or failed to: something that draws the same surfaces
+	// acceptably, like the permutation without any #defines
+	void setFallback(const ShaderProgram * program) {
+		fallback = program;
+	}
+
+	// Start building a permutation ahead of its first use. The handle returned gets it back with get(handle), which
+	// (unlike getting it by its sources) builds no strings, for looking it up every time something is drawn
+	int request(const ShaderSource & vertex, const ShaderSource & fragment) {
+		return find(vertex, fragment);
+	}
+
+	// The program for this pair of sources, or the fallback while it is compiling (NULL without one). With wait, the
+	// permutation is finished first (for startup)
+	const ShaderProgram * get(const ShaderSource & vertex, const ShaderSource & fragment, bool wait = false) {
+		int handle = find(vertex, fragment);
+		if (wait)
+			compiler.finish(handle);
+		const ShaderProgram * program = compiler.getShaderProgram(handle);
+		return (program != NULL) ? program : fallback;
+	}
+
+	// The program of a handle from request(), or the fallback while it is compiling
+	const ShaderProgram * get(int handle) {
+		const ShaderProgram * program = compiler.getShaderProgram(handle);
+		return (program != NULL) ? program : fallback;
+	}
+
+	int getNumPrograms() {
+		return (int)programs.size();
+	}
+
+	// Needs the GL context
+	void deleteAll() {
+		for (std::map<std::string, int>::iterator i = programs.begin(); i != programs.end(); ++i) {
+			compiler.finish(i->second);
+			glDeleteProgram(compiler.getProgram(i->second));
+		}
+		programs.clear();
+	}
+
+};
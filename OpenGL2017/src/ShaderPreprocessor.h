@@ -0,0 +1,235 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class turns a shader file into the source handed to the compiler. A file can hold several named
+ *              sections between "#sof <name>" and "#eof" markers (a file without markers is one section),
+ *              #include "file" pastes in another file relative to the including one, and #defines given by the
+ *              caller are inserted after #version so one file can be built into several specialized programs
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Which part of which file to build, and the #defines to build it with ("NAME" or "NAME VALUE")
+struct ShaderSource {
+	std::string path;
+	std::string section; // "" for the first section
+	std::vector<std::string> defines;
+
+	ShaderSource(const char * filePath, const std::string & sectionName = "", const std::vector<std::string> & defineList = std::vector<std::string>())
+		: path(filePath), section(sectionName), defines(defineList) {
+		// The order defines are given in doesn't change the program
+		std::sort(defines.begin(), defines.end());
+		defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+	}
+
+	// res/shaders/fragShader_F.glsl:unlit[NORMAL_MAP,PURE_DIFFUSE]
+	std::string describe() const {
+		std::string result = path;
+		if (!section.empty())
+			result += ":" + section;
+		if (!defines.empty()) {
+			result += "[";
+			for (size_t i = 0; i < defines.size(); i++)
+				result += (i == 0 ? "" : ",") + defines[i];
+			result += "]";
+		}
+		return result;
+	}
+};
+
+// The preprocessed source and the files that went into it. #line directives number the files by their index in files,
+// so "0(12)" in a compile log is line 12 of files[0]
+struct PreprocessedShader {
+	std::string source;
+	std::vector<std::string> files;
+	bool ok;
+};
+
+class ShaderPreprocessor {
+
+private:
+	// Nested includes deeper than this are taken to be a cycle
+	static const int MAX_INCLUDE_DEPTH = 16;
+
+	static std::string folderOf(const std::string & path) {
+		size_t slash = path.find_last_of("/\\");
+		return (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+	}
+
+	static std::string trim(const std::string & s) {
+		size_t first = s.find_first_not_of(" \t\r");
+		size_t last = s.find_last_not_of(" \t\r");
+		return (first == std::string::npos) ? std::string() : s.substr(first, last - first + 1);
+	}
+
+	// The directive of a line ("#sof", "#include", ...) and what follows it, or false if it isn't a directive
+	static bool directive(const std::string & line, std::string & name, std::string & argument) {
+		std::string text = trim(line);
+		if (text.empty() || text[0] != '#')
+			return false;
+		size_t end = text.find_first_of(" \t", 1);
+		name = text.substr(0, end);
+		argument = (end == std::string::npos) ? std::string() : trim(text.substr(end));
+		return true;
+	}
+
+	static bool readLines(const std::string & path, std::vector<std::string> & lines) {
+		std::ifstream fileStream(path.c_str(), std::ios::in);
+		if (!fileStream)
+			return false;
+		std::string line;
+		while (std::getline(fileStream, line))
+			lines.push_back(line);
+		return true;
+	}
+
+	// The lines of section name ("" for the first) and the file line number of the first. A file without any #sof is one
+	// unnamed section. Returns false (and prints the sections there are) if the section doesn't exist
+	static bool findSection(const std::vector<std::string> & lines, const std::string & name, const std::string & path,
+		std::vector<std::string> & section, int & firstLine) {
+		std::vector<std::string> names;
+		bool anyMarker = false;
+		for (size_t i = 0; i < lines.size(); i++) {
+			std::string directiveName, argument;
+			if (!directive(lines[i], directiveName, argument) || directiveName != "#sof")
+				continue;
+
+			anyMarker = true;
+			names.push_back(argument);
+			if (!name.empty() && argument != name)
+				continue;
+
+			// A missing #eof ends the section at the end of the file
+			size_t j = i + 1;
+			while (j < lines.size() && !(directive(lines[j], directiveName, argument) && directiveName == "#eof"))
+				j++;
+			if (j == lines.size())
+				std::cout << "Shader " << path << ": no #eof after #sof " << name << ", reading to the end of the file" << std::endl;
+			section.assign(lines.begin() + i + 1, lines.begin() + j);
+			firstLine = (int)i + 2;
+			return true;
+		}
+
+		if (!anyMarker && name.empty()) {
+			section = lines;
+			firstLine = 1;
+			return true;
+		}
+
+		std::cout << "Shader " << path << " has no section \"" << name << "\" (sections:";
+		for (size_t i = 0; i < names.size(); i++)
+			std::cout << " \"" << names[i] << "\"";
+		std::cout << ")" << std::endl;
+		return false;
+	}
+
+	// Append section (from file number fileIndex, starting at file line firstLine) to result, expanding its #includes.
+	// defines go after the #version line of the top-level file
+	static bool expand(const std::vector<std::string> & section, int firstLine, const std::string & path, int fileIndex, int depth,
+		const std::vector<std::string> * defines, std::set<std::string> & included, PreprocessedShader & result) {
+		std::ostringstream out;
+		for (size_t i = 0; i < section.size(); i++) {
+			int lineNumber = firstLine + (int)i;
+			std::string name, argument;
+			bool isDirective = directive(section[i], name, argument);
+
+			if (isDirective && name == "#version") {
+				out << section[i] << "\n";
+				if (defines != NULL) {
+					for (size_t d = 0; d < defines->size(); d++)
+						out << "#define " << (*defines)[d] << "\n";
+				}
+				out << "#line " << (lineNumber + 1) << " " << fileIndex << "\n";
+				defines = NULL;
+				continue;
+			}
+
+			if (isDirective && name == "#include") {
+				// #include "file", relative to this file. Each file is pasted once, later includes of it are skipped
+				size_t open = argument.find('"');
+				size_t close = argument.find('"', open + 1);
+				if (open == std::string::npos || close == std::string::npos) {
+					std::cout << "Shader " << path << "(" << lineNumber << "): expected a file name in quotes after #include" << std::endl;
+					return false;
+				}
+				std::string includePath = folderOf(path) + argument.substr(open + 1, close - open - 1);
+				if (included.count(includePath) != 0)
+					continue;
+				included.insert(includePath);
+				if (depth >= MAX_INCLUDE_DEPTH) {
+					std::cout << "Shader " << path << "(" << lineNumber << "): includes nested too deep at " << includePath << std::endl;
+					return false;
+				}
+
+				std::vector<std::string> includeLines, includeSection;
+				int includeFirstLine = 1;
+				if (!readLines(includePath, includeLines)) {
+					std::cout << "Shader " << path << "(" << lineNumber << "): could not open " << includePath << std::endl;
+					return false;
+				}
+				if (!findSection(includeLines, "", includePath, includeSection, includeFirstLine))
+					return false;
+
+				int includeIndex = (int)result.files.size();
+				result.files.push_back(includePath);
+				result.source += out.str();
+				out.str("");
+				result.source += "#line " + std::to_string(includeFirstLine) + " " + std::to_string(includeIndex) + "\n";
+				if (!expand(includeSection, includeFirstLine, includePath, includeIndex, depth + 1, NULL, included, result))
+					return false;
+				out << "#line " << (lineNumber + 1) << " " << fileIndex << "\n";
+				continue;
+			}
+
+			out << section[i] << "\n";
+		}
+		result.source += out.str();
+
+		// A top-level file without #version still gets its defines, in front
+		if (defines != NULL && !defines->empty()) {
+			std::string prefix;
+			for (size_t d = 0; d < defines->size(); d++)
+				prefix += "#define " + (*defines)[d] + "\n";
+			result.source = prefix + "#line " + std::to_string(firstLine) + " " + std::to_string(fileIndex) + "\n" + result.source;
+		}
+		return true;
+	}
+
+public:
+	// Build the source of shader. On failure (missing file or section, bad #include) the reason is printed and ok is false
+	static PreprocessedShader process(const ShaderSource & shader) {
+		PreprocessedShader result;
+		result.ok = false;
+
+		std::vector<std::string> lines, section;
+		int firstLine = 1;
+		if (!readLines(shader.path, lines)) {
+			std::cout << "Could not open shader " << shader.path << std::endl;
+			return result;
+		}
+		if (!findSection(lines, shader.section, shader.path, section, firstLine))
+			return result;
+
+		std::set<std::string> included;
+		result.files.push_back(shader.path);
+		result.ok = expand(section, firstLine, shader.path, 0, 0, &shader.defines, included, result);
+		if (!result.ok)
+			result.source.clear();
+		return result;
+	}
+
+	// Which file each source string number in a compile log stands for
+	static void printFiles(const PreprocessedShader & shader) {
+		for (size_t i = 0; i < shader.files.size(); i++)
+			std::cout << "  " << i << " = " << shader.files[i] << std::endl;
+	}
+
+};
@@ -0,0 +1,266 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class wraps a linked shader program with what the driver says it uses: its active uniforms (location
+ *              and type) and uniform blocks, read once when it links. Uniforms are found by name into typed handles
+ *              (Uniform<T>) that are set without asking GL anything, and every block is bound to the binding point
+ *              registered for it (registerBlock) after checking its std140 layout against the C++ struct that fills
+ *              it. A name the program's sources never declare, a handle of the wrong type or a block layout that
+ *              disagrees is a bug in the program, so it is reported and the program stops right there
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// The GL type a uniform needs to be set from T, and how to set it
+template <typename T> struct UniformType;
+
+template <> struct UniformType<int> {
+	static GLenum type() { return GL_INT; }
+	static void set(GLuint program, GLint location, const int & value) { glProgramUniform1i(program, location, value); }
+};
+
+template <> struct UniformType<float> {
+	static GLenum type() { return GL_FLOAT; }
+	static void set(GLuint program, GLint location, const float & value) { glProgramUniform1f(program, location, value); }
+};
+
+template <> struct UniformType<glm::vec3> {
+	static GLenum type() { return GL_FLOAT_VEC3; }
+	static void set(GLuint program, GLint location, const glm::vec3 & value) { glProgramUniform3fv(program, location, 1, glm::value_ptr(value)); }
+};
+
+template <> struct UniformType<glm::vec4> {
+	static GLenum type() { return GL_FLOAT_VEC4; }
+	static void set(GLuint program, GLint location, const glm::vec4 & value) { glProgramUniform4fv(program, location, 1, glm::value_ptr(value)); }
+};
+
+template <> struct UniformType<glm::mat3> {
+	static GLenum type() { return GL_FLOAT_MAT3; }
+	static void set(GLuint program, GLint location, const glm::mat3 & value) { glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, glm::value_ptr(value)); }
+};
+
+template <> struct UniformType<glm::mat4> {
+	static GLenum type() { return GL_FLOAT_MAT4; }
+	static void set(GLuint program, GLint location, const glm::mat4 & value) { glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, glm::value_ptr(value)); }
+};
+
+// A uniform of one program, found by ShaderProgram::uniform(). Uniforms the compiler dropped from that program (declared
+// but unused, as in some permutations) have location -1, and setting them does nothing
+template <typename T> struct Uniform {
+	GLint location;
+
+	Uniform() : location(-1) {}
+};
+
+// A member of a uniform block and where the C++ struct filling the block keeps it
+struct UniformBlockMember {
+	std::string name;	// As GL names it: "proj_matrix", "light.ambient", "skyIrradiance" (arrays without [0])
+	GLint offset;
+};
+
+// A uniform block programs may use: the binding point its buffer goes to, and the layout of the C++ struct behind it
+struct UniformBlockLayout {
+	std::string name;
+	GLuint binding;
+	GLint size;
+	std::vector<UniformBlockMember> members;
+};
+
+class ShaderProgram {
+
+private:
+	struct ActiveUniform {
+		GLint location;
+		GLenum type;
+	};
+
+	GLuint program;
+	std::string name;
+	std::map<std::string, ActiveUniform> uniforms;
+	std::map<std::string, std::string> blockMembers;	// Block each block member belongs to
+	std::set<std::string> identifiers;					// Every identifier in the sources, empty if they aren't known
+
+	static std::vector<UniformBlockLayout> & layouts() {
+		static std::vector<UniformBlockLayout> instance;
+		return instance;
+	}
+
+	static void fail(const std::string & message) {
+		std::cout << "error: " << message << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// "skyIrradiance[0]" -> "skyIrradiance", the way arrays are looked up
+	static std::string withoutIndex(const std::string & uniformName) {
+		size_t length = uniformName.size();
+		if (length > 3 && uniformName.compare(length - 3, 3, "[0]") == 0)
+			return uniformName.substr(0, length - 3);
+		return uniformName;
+	}
+
+	// "light.ambient" -> "light": the name the sources declare
+	static std::string declaredName(const std::string & uniformName) {
+		return uniformName.substr(0, uniformName.find_first_of(".["));
+	}
+
+	static std::set<std::string> findIdentifiers(const std::string & source) {
+		std::set<std::string> result;
+		size_t i = 0;
+		while (i < source.size()) {
+			if (isalpha((unsigned char)source[i]) || source[i] == '_') {
+				size_t start = i;
+				while (i < source.size() && (isalnum((unsigned char)source[i]) || source[i] == '_'))
+					i++;
+				result.insert(source.substr(start, i - start));
+			}
+			else {
+				i++;
+			}
+		}
+		return result;
+	}
+
+	// Record the uniforms outside blocks, and the offsets of those inside them (by block index)
+	void readUniforms(std::map<GLint, std::vector<UniformBlockMember>> & blockOffsets) {
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> buffer(maxLength + 1);
+
+		for (GLuint i = 0; i < (GLuint)count; i++) {
+			GLint size = 0, block = -1;
+			GLenum type = 0;
+			GLsizei length = 0;
+			glGetActiveUniform(program, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+			std::string uniformName = withoutIndex(std::string(buffer.data(), length));
+
+			glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &block);
+			if (block >= 0) {
+				UniformBlockMember member = { uniformName, 0 };
+				glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_OFFSET, &member.offset);
+				blockOffsets[block].push_back(member);
+				continue;
+			}
+
+			ActiveUniform uniform = { glGetUniformLocation(program, buffer.data()), type };
+			uniforms[uniformName] = uniform;
+		}
+	}
+
+	// Check every block against its registered layout and bind it to its binding point
+	void bindBlocks(const std::map<GLint, std::vector<UniformBlockMember>> & blockOffsets) {
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+		std::vector<char> buffer(maxLength + 1);
+
+		for (GLuint i = 0; i < (GLuint)count; i++) {
+			GLsizei length = 0;
+			glGetActiveUniformBlockName(program, i, (GLsizei)buffer.size(), &length, buffer.data());
+			std::string blockName(buffer.data(), length);
+			const UniformBlockLayout * layout = findBlock(blockName);
+			if (layout == NULL)
+				fail(name + " uses uniform block " + blockName + ", which has no registered layout");
+
+			GLint size = 0;
+			glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+			if (size > layout->size)
+				fail(name + ": uniform block " + blockName + " takes " + std::to_string(size) + " bytes, its struct only "
+					+ std::to_string(layout->size));
+
+			std::map<GLint, std::vector<UniformBlockMember>>::const_iterator members = blockOffsets.find((GLint)i);
+			for (size_t m = 0; members != blockOffsets.end() && m < members->second.size(); m++) {
+				const UniformBlockMember & member = members->second[m];
+				const UniformBlockMember * expected = NULL;
+				for (size_t e = 0; e < layout->members.size() && expected == NULL; e++) {
+					if (layout->members[e].name == member.name)
+						expected = &layout->members[e];
+				}
+				if (expected == NULL)
+					fail(name + ": " + member.name + " of uniform block " + blockName + " is not in its struct");
+				if (expected->offset != member.offset)
+					fail(name + ": " + member.name + " of uniform block " + blockName + " is at byte " + std::to_string(member.offset)
+						+ " (std140), its struct has it at " + std::to_string(expected->offset));
+				blockMembers[member.name] = blockName;
+			}
+
+			glUniformBlockBinding(program, i, layout->binding);
+		}
+	}
+
+public:
+	// Make a block's layout known to every program linked afterwards (before any program using it is submitted)
+	static void registerBlock(const UniformBlockLayout & layout) {
+		for (size_t i = 0; i < layouts().size(); i++) {
+			if (layouts()[i].name == layout.name) {
+				layouts()[i] = layout;
+				return;
+			}
+		}
+		layouts().push_back(layout);
+	}
+
+	static const UniformBlockLayout * findBlock(const std::string & blockName) {
+		for (size_t i = 0; i < layouts().size(); i++) {
+			if (layouts()[i].name == blockName)
+				return &layouts()[i];
+		}
+		return NULL;
+	}
+
+	ShaderProgram() : program(0) {}
+
+	// Read what linkedProgram uses (needs the GL context, and the link to be done). source is the text it was built from,
+	// to tell uniforms the compiler dropped from names nobody declared; without it every missing name is an error
+	ShaderProgram(GLuint linkedProgram, const std::string & programName, const std::string & source = std::string())
+		: program(linkedProgram), name(programName), identifiers(findIdentifiers(source)) {
+		std::map<GLint, std::vector<UniformBlockMember>> blockOffsets;
+		readUniforms(blockOffsets);
+		bindBlocks(blockOffsets);
+	}
+
+	GLuint getId() const {
+		return program;
+	}
+
+	const std::string & getName() const {
+		return name;
+	}
+
+	// Handle to the uniform called uniformName, which has to be of type T
+	template <typename T> Uniform<T> uniform(const std::string & uniformName) const {
+		Uniform<T> handle;
+		std::map<std::string, ActiveUniform>::const_iterator found = uniforms.find(uniformName);
+		if (found != uniforms.end()) {
+			if (found->second.type != UniformType<T>::type())
+				fail(name + ": uniform " + uniformName + " is set from the wrong type");
+			handle.location = found->second.location;
+			return handle;
+		}
+
+		std::map<std::string, std::string>::const_iterator member = blockMembers.find(uniformName);
+		if (member != blockMembers.end())
+			fail(name + ": " + uniformName + " is part of uniform block " + member->second + ", set it through its buffer");
+		if (identifiers.find(declaredName(uniformName)) == identifiers.end())
+			fail(name + " has no uniform " + uniformName);
+		return handle;
+	}
+
+	template <typename T> void set(const Uniform<T> & uniform, const T & value) const {
+		if (uniform.location >= 0)
+			UniformType<T>::set(program, uniform.location, value);
+	}
+
+};
@@ -0,0 +1,116 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class generates per-vertex tangents (xyz) and bitangent signs (w) for normal mapping.
+ *              Triangles are processed in parallel, and each vertex gathers the tangents of the triangles
+ *              around it, so no two threads ever write to the same vertex
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+class TangentGenerator {
+
+private:
+	// Any unit vector perpendicular to n, for vertices whose UVs don't define a direction
+	static glm::vec3 perpendicular(glm::vec3 n) {
+		glm::vec3 axis = (std::fabs(n.x) < 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		return glm::normalize(glm::cross(n, axis));
+	}
+
+public:
+	// Fill in vertices[i].tangent. indices may be NULL, in which case every 3 consecutive vertices form a triangle
+	static void generate(Vertex * vertices, size_t numVertices, const unsigned int * indices, size_t numIndices,
+		ThreadPool & pool = ThreadPool::shared()) {
+		size_t numTriangles = (indices != NULL) ? numIndices / 3 : numVertices / 3;
+		if (numVertices == 0)
+			return;
+
+		// Corner c of triangle t
+		#define TRIANGLE_CORNER(t, c) ((indices != NULL) ? (size_t)indices[(t) * 3 + (c)] : (t) * 3 + (c))
+
+		// Pass 1: tangent and bitangent of every triangle (not normalized, so bigger triangles weigh more)
+		std::vector<glm::vec3> triTangents(numTriangles);
+		std::vector<glm::vec3> triBitangents(numTriangles);
+		pool.parallelFor(numTriangles, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				size_t i0 = TRIANGLE_CORNER(t, 0);
+				size_t i1 = TRIANGLE_CORNER(t, 1);
+				size_t i2 = TRIANGLE_CORNER(t, 2);
+				if (i0 >= numVertices || i1 >= numVertices || i2 >= numVertices) {
+					triTangents[t] = triBitangents[t] = glm::vec3(0.0f);
+					continue;
+				}
+
+				glm::vec3 edge1 = vertices[i1].position - vertices[i0].position;
+				glm::vec3 edge2 = vertices[i2].position - vertices[i0].position;
+				glm::vec2 duv1 = vertices[i1].texCoord - vertices[i0].texCoord;
+				glm::vec2 duv2 = vertices[i2].texCoord - vertices[i0].texCoord;
+
+				// Solve edge = du * T + dv * B for both edges. Degenerate UVs contribute nothing
+				float det = duv1.x * duv2.y - duv2.x * duv1.y;
+				if (std::fabs(det) < 1e-12f) {
+					triTangents[t] = triBitangents[t] = glm::vec3(0.0f);
+					continue;
+				}
+				float r = 1.0f / det;
+				triTangents[t] = (edge1 * duv2.y - edge2 * duv1.y) * r;
+				triBitangents[t] = (edge2 * duv1.x - edge1 * duv2.x) * r;
+			}
+		}, 1024);
+
+		// Which triangles touch each vertex (compressed: the triangles of vertex v are in
+		// vertexTriangles[firstTriangle[v] .. firstTriangle[v + 1]) )
+		std::vector<unsigned int> firstTriangle(numVertices + 1, 0);
+		for (size_t t = 0; t < numTriangles; t++) {
+			for (int c = 0; c < 3; c++) {
+				size_t v = TRIANGLE_CORNER(t, c);
+				if (v < numVertices)
+					firstTriangle[v + 1]++;
+			}
+		}
+		for (size_t v = 0; v < numVertices; v++)
+			firstTriangle[v + 1] += firstTriangle[v];
+
+		std::vector<unsigned int> vertexTriangles(firstTriangle[numVertices]);
+		std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t t = 0; t < numTriangles; t++) {
+			for (int c = 0; c < 3; c++) {
+				size_t v = TRIANGLE_CORNER(t, c);
+				if (v < numVertices)
+					vertexTriangles[fill[v]++] = (unsigned int)t;
+			}
+		}
+		#undef TRIANGLE_CORNER
+
+		// Pass 2: each vertex sums its triangles and orthogonalizes against its normal (Gram-Schmidt)
+		pool.parallelFor(numVertices, [&](size_t begin, size_t end) {
+			for (size_t v = begin; v < end; v++) {
+				glm::vec3 tangent(0.0f);
+				glm::vec3 bitangent(0.0f);
+				for (unsigned int k = firstTriangle[v]; k < firstTriangle[v + 1]; k++) {
+					tangent += triTangents[vertexTriangles[k]];
+					bitangent += triBitangents[vertexTriangles[k]];
+				}
+
+				glm::vec3 n = vertices[v].normal;
+				float nLength = glm::length(n);
+				n = (nLength > 1e-12f) ? n / nLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+				glm::vec3 t = tangent - n * glm::dot(n, tangent);
+				float tLength = glm::length(t);
+				t = (tLength > 1e-12f) ? t / tLength : perpendicular(n);
+
+				// w tells the shader whether the UVs are mirrored: B = cross(N, T) * w
+				float w = (glm::dot(glm::cross(n, t), bitangent) < 0.0f) ? -1.0f : 1.0f;
+				vertices[v].tangent = glm::vec4(t, w);
+			}
+		}, 4096);
+	}
+
+};
@@ -0,0 +1,217 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps a block compressed copy of every texture, with its whole mipmap chain, in a KTX2 file
+ *              next to the image (<image>.ktx2). The first run compresses the levels MipGenerator made (BlockCompressor)
+ *              and writes the file; later runs map it and upload the blocks as they are. Like the mesh cache, a copy
+ *              is rebuilt when its image changes and kept when the image was only touched
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockCompressor.h"
+#include "FileInfo.h"
+#include "KtxFile.h"
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+// How textures are stored on the GPU
+enum TextureCompression {
+	TEXTURE_UNCOMPRESSED,	// RGBA8 as decoded, no cache
+	TEXTURE_BC1_BC3,		// BC1 for opaque images, BC3 for images with alpha
+	TEXTURE_BC7				// BC7 for every image
+};
+
+class TextureCache {
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// What the copy was built from, stored as the value of sourceKey()
+	struct SourceStamp {
+		uint64_t size;
+		int64_t modified;
+		uint64_t hash;
+		uint32_t version;
+		uint32_t color;		// Whether the mipmaps were averaged as colors (in linear light) or as data
+	};
+
+	static const char * sourceKey() {
+		return "OGLScene.source";
+	}
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	static double toMegabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	static bool isOpaque(const unsigned char * rgba, int width, int height) {
+		size_t numPixels = (size_t)width * height;
+		for (size_t i = 0; i < numPixels; i++) {
+			if (rgba[i * 4 + 3] != 255)
+				return false;
+		}
+		return true;
+	}
+
+public:
+	// Version 1: first version
+	// Version 2: color mipmaps averaged in linear light
+	static const uint32_t VERSION = 2;
+
+	// The smallest compression the driver can sample (needs the GL context)
+	static TextureCompression bestSupported() {
+		if (GLEW_EXT_texture_compression_s3tc)
+			return TEXTURE_BC1_BC3;
+		if (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc)
+			return TEXTURE_BC7;
+		return TEXTURE_UNCOMPRESSED;
+	}
+
+	static const char * getName(TextureCompression compression) {
+		static const char * names[3] = { "uncompressed", "BC1/BC3", "BC7" };
+		return names[compression];
+	}
+
+	// The KTX2 file sits next to the image
+	static std::string cachePath(const std::string & imagePath) {
+		return imagePath + ".ktx2";
+	}
+
+	// Whether a copy in format can be used when textures are compressed with compression
+	static bool accepts(TextureCompression compression, BlockFormat format) {
+		if (compression == TEXTURE_BC1_BC3)
+			return format == BLOCK_BC1 || format == BLOCK_BC3;
+		return compression == TEXTURE_BC7 && format == BLOCK_BC7;
+	}
+
+	// Map the copy of imagePath if it exists, is in a format compression accepts, had its mipmaps made the same way
+	// (color) and is not stale. Returns NULL otherwise, after printing why
+	static std::shared_ptr<CompressedTexture> open(const std::string & imagePath, TextureCompression compression, bool color) {
+		Clock::time_point start = Clock::now();
+		std::string path = cachePath(imagePath);
+
+		std::shared_ptr<CompressedTexture> texture = std::make_shared<CompressedTexture>();
+		std::map<std::string, KtxValue> keyValues;
+		if (!KtxFile::read(path, *texture, keyValues)) {
+			std::cout << "Texture cache miss for " << path << " (no cache yet)" << std::endl;
+			return std::shared_ptr<CompressedTexture>();
+		}
+		if (!accepts(compression, texture->format)) {
+			std::cout << "Texture cache miss for " << path << " (stored as " << BlockCompressor::getName(texture->format)
+				<< ", textures are " << getName(compression) << ")" << std::endl;
+			return std::shared_ptr<CompressedTexture>();
+		}
+
+		std::map<std::string, KtxValue>::iterator found = keyValues.find(sourceKey());
+		SourceStamp stamp;
+		if (found == keyValues.end() || found->second.value.size() != sizeof(stamp)) {
+			std::cout << "Texture cache miss for " << path << " (not written by this program)" << std::endl;
+			return std::shared_ptr<CompressedTexture>();
+		}
+		memcpy(&stamp, found->second.value.data(), sizeof(stamp));
+		if (stamp.version != VERSION) {
+			std::cout << "Texture cache miss for " << path << " (older version)" << std::endl;
+			return std::shared_ptr<CompressedTexture>();
+		}
+		if ((stamp.color != 0) != color) {
+			std::cout << "Texture cache miss for " << path << " (mipmaps made as " << (color ? "data" : "colors") << ")" << std::endl;
+			return std::shared_ptr<CompressedTexture>();
+		}
+
+		uint64_t sourceSize;
+		int64_t sourceModified;
+		if (FileInfo::getSourceInfo(imagePath.c_str(), sourceSize, sourceModified)) {
+			if (sourceSize != stamp.size) {
+				std::cout << "Texture cache " << path << " is stale (size changed), rebuilding" << std::endl;
+				return std::shared_ptr<CompressedTexture>();
+			}
+			if (sourceModified != stamp.modified) {
+				if (FileInfo::hashFile(imagePath.c_str()) != stamp.hash) {
+					std::cout << "Texture cache " << path << " is stale (contents changed), rebuilding" << std::endl;
+					return std::shared_ptr<CompressedTexture>();
+				}
+
+				// Same contents with a new timestamp: refresh the stamp so we don't hash again next time
+				stamp.modified = sourceModified;
+				std::fstream patch(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+				patch.seekp((std::streamoff)found->second.offset);
+				patch.write((const char *)&stamp, sizeof(stamp));
+			}
+		}
+		else {
+			std::cout << "Image file " << imagePath << " is missing, using its texture cache as is" << std::endl;
+		}
+
+		std::cout << "Texture cache hit for " << path << " (" << BlockCompressor::getName(texture->format) << ", "
+			<< texture->width << "x" << texture->height << ", " << texture->levels.size() << " levels, "
+			<< toMegabytes(texture->getBytes()) << " MB), read in " << millisecondsSince(start) << " ms" << std::endl;
+		return texture;
+	}
+
+	// Compress levels (MipGenerator::generate of the image decoded from imagePath, rows bottom to top) and store the
+	// result as imagePath's copy. The texture is returned even if it couldn't be stored
+	static std::shared_ptr<CompressedTexture> build(const std::string & imagePath, const std::vector<MipLevel> & levels, bool color,
+		TextureCompression compression, ThreadPool & pool = ThreadPool::shared()) {
+		Clock::time_point start = Clock::now();
+		int width = levels[0].width, height = levels[0].height;
+		std::shared_ptr<CompressedTexture> texture = std::make_shared<CompressedTexture>();
+		if (compression == TEXTURE_BC7)
+			texture->format = BLOCK_BC7;
+		else
+			texture->format = isOpaque(levels[0].pixels.data(), width, height) ? BLOCK_BC1 : BLOCK_BC3;
+		texture->width = width;
+		texture->height = height;
+
+		texture->levels.resize(levels.size());
+		size_t offset = 0;
+		for (size_t level = 0; level < levels.size(); level++) {
+			KtxLevel & l = texture->levels[level];
+			l.width = levels[level].width;
+			l.height = levels[level].height;
+			l.offset = offset;
+			l.size = BlockCompressor::getImageBytes(texture->format, l.width, l.height);
+			offset += l.size;
+		}
+
+		texture->memory.resize(offset);
+		for (size_t level = 0; level < levels.size(); level++) {
+			const KtxLevel & l = texture->levels[level];
+			BlockCompressor::compress(levels[level].pixels.data(), l.width, l.height, texture->format, texture->memory.data() + l.offset, pool);
+		}
+
+		// The rows are stored bottom to top (KTXorientation "ru")
+		SourceStamp stamp;
+		memset(&stamp, 0, sizeof(stamp));
+		stamp.version = VERSION;
+		stamp.color = color ? 1 : 0;
+		bool stamped = FileInfo::getSourceInfo(imagePath.c_str(), stamp.size, stamp.modified);
+		stamp.hash = FileInfo::hashFile(imagePath.c_str());
+
+		std::map<std::string, std::string> keyValues;
+		keyValues["KTXorientation"] = std::string("ru", 3);
+		keyValues["KTXwriter"] = std::string("OGLScene TextureCache", 22);
+		keyValues[sourceKey()] = std::string((const char *)&stamp, sizeof(stamp));
+		std::string path = cachePath(imagePath);
+		bool stored = stamped && KtxFile::write(path, *texture, keyValues);
+
+		std::cout << "Compressed " << imagePath << " to " << BlockCompressor::getName(texture->format) << " with "
+			<< texture->levels.size() << " levels in " << millisecondsSince(start) << " ms (" << toMegabytes((size_t)width * height * 4)
+			<< " MB as RGBA8 -> " << toMegabytes(texture->getBytes()) << " MB)" << (stored ? ", cached in " + path : std::string()) << std::endl;
+		return texture;
+	}
+
+};
@@ -0,0 +1,150 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps a set of worker threads alive so loading code can split work across all cores
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex queueMutex;
+	std::condition_variable wakeUp;
+	bool stopping;
+
+	// Bookkeeping for one parallelFor call. Shared so that helper tasks which start late can still check it safely
+	struct RangeJob {
+		std::atomic<size_t> nextRange;
+		std::atomic<size_t> rangesDone;
+		size_t numRanges;
+		size_t count;
+		std::function<void(size_t, size_t)> body;
+		std::mutex doneMutex;
+		std::condition_variable doneSignal;
+	};
+
+	// Claim ranges until none are left. Returns once this thread has nothing more to take
+	static void runRanges(RangeJob & job) {
+		while (true) {
+			size_t range = job.nextRange.fetch_add(1);
+			if (range >= job.numRanges)
+				return;
+
+			size_t begin = job.count * range / job.numRanges;
+			size_t end = job.count * (range + 1) / job.numRanges;
+			job.body(begin, end);
+
+			if (job.rangesDone.fetch_add(1) + 1 == job.numRanges) {
+				std::lock_guard<std::mutex> lock(job.doneMutex);
+				job.doneSignal.notify_all();
+			}
+		}
+	}
+
+	void workerLoop() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool & operator=(const ThreadPool &);
+
+public:
+	// Start numThreads workers (0 means one per hardware thread)
+	explicit ThreadPool(unsigned int numThreads = 0) : stopping(false) {
+		if (numThreads == 0)
+			numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0)
+			numThreads = 1;
+
+		for (unsigned int i = 0; i < numThreads; i++)
+			workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+
+	// Finish the queued tasks and join the workers
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		wakeUp.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	// Queue a task to run on one of the workers
+	void submit(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			tasks.push_back(std::move(task));
+		}
+		wakeUp.notify_one();
+	}
+
+	// Call body(begin, end) over [0, count) split into contiguous ranges, and wait for all of them.
+	// The calling thread works on ranges too, so this is safe to call from inside a pool task
+	void parallelFor(size_t count, std::function<void(size_t, size_t)> body, size_t minRangeSize = 1) {
+		if (count == 0)
+			return;
+		if (minRangeSize == 0)
+			minRangeSize = 1;
+
+		// A few ranges per thread evens out uneven work without much scheduling overhead
+		size_t numRanges = workers.size() * 4;
+		if (numRanges > count / minRangeSize)
+			numRanges = count / minRangeSize;
+		if (numRanges <= 1) {
+			body(0, count);
+			return;
+		}
+
+		std::shared_ptr<RangeJob> job = std::make_shared<RangeJob>();
+		job->nextRange = 0;
+		job->rangesDone = 0;
+		job->numRanges = numRanges;
+		job->count = count;
+		job->body = std::move(body);
+
+		size_t helpers = (numRanges - 1 < workers.size()) ? numRanges - 1 : workers.size();
+		for (size_t i = 0; i < helpers; i++)
+			submit([job] { runRanges(*job); });
+
+		runRanges(*job);
+
+		std::unique_lock<std::mutex> lock(job->doneMutex);
+		job->doneSignal.wait(lock, [&job] { return job->rangesDone.load() == job->numRanges; });
+	}
+
+	unsigned int getNumThreads() {
+		return (unsigned int)workers.size();
+	}
+
+	// One pool shared by everything that loads assets
+	static ThreadPool & shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+};
@@ -0,0 +1,229 @@
+/**
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This program benchmarks the scene's transform pass. It builds a synthetic hierarchy (every node draws,
+ *              a few are animated) and times a frame's matrices two ways: the full rebuild final.cpp used to do (every
+ *              node's model-view matrix from its parent's, and a 4x4 inverse for its normal matrix) and
+ *              TransformHierarchy, which only recomputes the animated nodes and what hangs below them. Both end with a
+ *              model-view and normal matrix per node, as drawing needs them. Every measurement is printed as one line
+ *              of JSON, with the largest difference between the two ways' matrices
+ *
+ * Usage: TransformBenchmark [--nodes 100,1000,10000,...] [--animated FRACTION] [--fanout N] [--frames N] [--runs N]
+ *                           [--out FILE]
+ *
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "TransformHierarchy.h"
+
+/*************************************************   Synthetic scene  ********************************************/
+
+// A node the way Scene describes it: a static transform, or one an animation changes every frame
+struct BenchmarkNode {
+	int parent;
+	glm::mat4 beforeAnimation;
+	bool animated;
+};
+
+// Settings of the benchmark
+std::vector<int> nodeCounts;
+double animatedFraction = 0.01;
+int fanout = 4;
+int numFrames = 100;
+int numRuns = 3;
+FILE * results = stdout;
+
+// Node i hangs below node (i - 1) / fanout, so parents come first. Transforms mix rotations, translations and
+// (sometimes non-uniform) scales
+std::vector<BenchmarkNode> buildScene(int numNodes) {
+	std::vector<BenchmarkNode> nodes(numNodes);
+	int animatedStride = (animatedFraction > 0.0) ? glm::max((int)(1.0 / animatedFraction), 1) : numNodes + 1;
+	for (int i = 0; i < numNodes; i++) {
+		BenchmarkNode & node = nodes[i];
+		node.parent = (i == 0) ? -1 : (i - 1) / fanout;
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 7) - 3.0f, 0.5f, (float)(i % 5) - 2.0f));
+		transform = glm::rotate(transform, 0.1f * (float)i, glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f * (float)(i % 3))));
+		if (i % 3 == 0)
+			transform = glm::scale(transform, glm::vec3(1.0f + 0.01f * (float)(i % 4)));
+		else if (i % 3 == 1)
+			transform = glm::scale(transform, glm::vec3(1.0f, 1.0f + 0.01f * (float)(i % 5), 1.0f));
+		node.beforeAnimation = transform;
+		node.animated = (i % animatedStride == animatedStride / 2);
+	}
+	return nodes;
+}
+
+glm::mat4 animate(double time) {
+	return glm::rotate(glm::mat4(1.0f), (float)time, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// The camera moves every frame, as it does while flying around
+glm::mat4 viewAt(double time) {
+	glm::vec3 position((float)std::sin(time) * 20.0f, 5.0f, (float)std::cos(time) * 20.0f);
+	return glm::lookAt(position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+/*************************************************   The two ways  ********************************************/
+
+// What final.cpp did before TransformHierarchy
+void fullRebuild(const std::vector<BenchmarkNode> & nodes, const glm::mat4 & vMat, double time,
+	std::vector<glm::mat4> & mvMatrices, std::vector<glm::mat4> & nrmMatrices) {
+	glm::mat4 animation = animate(time);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const BenchmarkNode & node = nodes[i];
+		glm::mat4 local = node.animated ? node.beforeAnimation * animation : node.beforeAnimation;
+		mvMatrices[i] = ((node.parent >= 0) ? mvMatrices[node.parent] : vMat) * local;
+		nrmMatrices[i] = glm::transpose(glm::inverse(mvMatrices[i]));
+	}
+}
+
+// What final.cpp does now
+void incrementalUpdate(const std::vector<BenchmarkNode> & nodes, const std::vector<int> & animatedNodes, TransformHierarchy & hierarchy,
+	const glm::mat4 & vMat, double time, std::vector<glm::mat4> & mvMatrices, std::vector<glm::mat4> & nrmMatrices) {
+	glm::mat4 animation = animate(time);
+	for (size_t n = 0; n < animatedNodes.size(); n++)
+		hierarchy.setLocal(animatedNodes[n], nodes[animatedNodes[n]].beforeAnimation * animation);
+	hierarchy.update();
+
+	glm::mat3 viewRotation = glm::mat3(vMat);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		TransformHierarchy::multiply(vMat, hierarchy.getWorld((int)i), mvMatrices[i]);
+		nrmMatrices[i] = glm::mat4(viewRotation * hierarchy.getNormalMatrix((int)i));
+	}
+}
+
+// Largest difference between the upper 3x4 of two sets of matrices, relative to the largest entry
+double largestDifference(const std::vector<glm::mat4> & a, const std::vector<glm::mat4> & b) {
+	double largest = 0.0;
+	for (size_t i = 0; i < a.size(); i++) {
+		double scale = 1.0;
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 3; r++)
+				scale = glm::max(scale, (double)std::fabs(a[i][c][r]));
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 3; r++)
+				largest = glm::max(largest, std::fabs((double)a[i][c][r] - (double)b[i][c][r]) / scale);
+	}
+	return largest;
+}
+
+void printResult(const char * phase, int numNodes, int numAnimated, int recomputed, int run, double ms, double difference) {
+	fprintf(results, "{\"phase\": \"%s\", \"nodes\": %d, \"animated\": %d, \"fanout\": %d, \"recomputed_per_frame\": %d, "
+		"\"run\": %d, \"frames\": %d, \"ms_per_frame\": %.4f, \"us_per_node\": %.4f, \"max_difference\": %.3g}\n",
+		phase, numNodes, numAnimated, fanout, recomputed, run, numFrames, ms / numFrames, ms * 1000.0 / numFrames / numNodes,
+		difference);
+	fflush(results);
+}
+
+// Split "a,b,c"
+std::vector<std::string> splitList(const char * list) {
+	std::vector<std::string> items;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+bool parseArguments(int argc, char ** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "--nodes" && hasValue) {
+			nodeCounts.clear();
+			std::vector<std::string> items = splitList(argv[++i]);
+			for (size_t k = 0; k < items.size(); k++)
+				nodeCounts.push_back(atoi(items[k].c_str()));
+		}
+		else if (arg == "--animated" && hasValue) {
+			animatedFraction = atof(argv[++i]);
+		}
+		else if (arg == "--fanout" && hasValue) {
+			fanout = glm::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--frames" && hasValue) {
+			numFrames = glm::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--runs" && hasValue) {
+			numRuns = atoi(argv[++i]);
+		}
+		else if (arg == "--out" && hasValue) {
+			results = fopen(argv[++i], "w");
+			if (results == NULL) {
+				std::cerr << "Could not open " << argv[i] << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char ** argv) {
+	int defaultNodes[4] = { 100, 1000, 10000, 100000 };
+	nodeCounts.assign(defaultNodes, defaultNodes + 4);
+
+	if (!parseArguments(argc, argv)) {
+		std::cerr << "Usage: TransformBenchmark [--nodes 100,1000,10000,...] [--animated FRACTION] [--fanout N] [--frames N]"
+			<< " [--runs N] [--out FILE]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	for (size_t c = 0; c < nodeCounts.size(); c++) {
+		int numNodes = nodeCounts[c];
+		if (numNodes <= 0)
+			continue;
+		std::vector<BenchmarkNode> nodes = buildScene(numNodes);
+
+		TransformHierarchy hierarchy;
+		std::vector<int> animatedNodes;
+		for (int i = 0; i < numNodes; i++) {
+			hierarchy.addNode(nodes[i].parent, nodes[i].beforeAnimation);
+			if (nodes[i].animated)
+				animatedNodes.push_back(i);
+		}
+		hierarchy.update(); // The first frame computes everything, like the first frame of the program
+
+		std::vector<glm::mat4> fullMv(numNodes), fullNrm(numNodes), incrementalMv(numNodes), incrementalNrm(numNodes);
+		for (int run = 0; run < numRuns; run++) {
+			std::cerr << "Updating " << numNodes << " nodes (run " << run + 1 << " of " << numRuns << ")" << std::endl;
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < numFrames; frame++) {
+				double time = frame / 60.0;
+				fullRebuild(nodes, viewAt(time), time, fullMv, fullNrm);
+			}
+			double fullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			int recomputed = 0;
+			start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < numFrames; frame++) {
+				double time = frame / 60.0;
+				incrementalUpdate(nodes, animatedNodes, hierarchy, viewAt(time), time, incrementalMv, incrementalNrm);
+			}
+			double incrementalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			for (int i = 0; i < numNodes; i++)
+				recomputed += hierarchy.changed(i) ? 1 : 0;
+
+			// Both ended on the same frame, so their matrices should agree up to rounding
+			printResult("full", numNodes, (int)animatedNodes.size(), numNodes, run, fullMs, 0.0);
+			printResult("incremental", numNodes, (int)animatedNodes.size(), recomputed, run, incrementalMs,
+				glm::max(largestDifference(fullMv, incrementalMv), largestDifference(fullNrm, incrementalNrm)));
+		}
+	}
+
+	if (results != stdout)
+		fclose(results);
+	return 0;
+}
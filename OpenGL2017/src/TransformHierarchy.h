@@ -0,0 +1,158 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps the transforms of a hierarchy of nodes, stored flat with every parent before its
+ *              children (like Scene's nodes), and rebuilds only what changed. Each node has its local transform, its
+ *              world transform (the parent's world times the local) and the normal matrix of that world transform.
+ *              setLocal() marks a node dirty, and update() recomputes the dirty nodes and everything below them in one
+ *              pass; the rest keep what they had, so a static part of the scene costs nothing after the first frame.
+ *              Normal matrices are the inverse transpose of the upper 3x3 only, built from three cross products, and
+ *              not even that where the transform is a rotation times a uniform scale. Matrix products use SSE2 where
+ *              the compiler targets it
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TRANSFORM_HIERARCHY_SSE2
+#include <emmintrin.h>
+#endif
+
+class TransformHierarchy {
+
+private:
+	// Bits of flags
+	static const unsigned char DIRTY = 1;			// The local transform changed since the last update()
+	static const unsigned char CONFORMAL = 2;		// The local's 3x3 is a rotation (or reflection) times a uniform scale
+	static const unsigned char CONFORMAL_WORLD = 4;	// So are the locals of all its ancestors, and so the world's 3x3
+	static const unsigned char CHANGED = 8;			// Recomputed by the last update()
+
+	std::vector<int> parents;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<glm::mat3> normals;
+	std::vector<unsigned char> flags;
+
+	static bool isConformal(const glm::mat4 & m) {
+		glm::vec3 x = glm::vec3(m[0]), y = glm::vec3(m[1]), z = glm::vec3(m[2]);
+		float xx = glm::dot(x, x);
+		float tolerance = 1e-5f * xx;
+		return std::fabs(glm::dot(x, y)) <= tolerance && std::fabs(glm::dot(y, z)) <= tolerance && std::fabs(glm::dot(z, x)) <= tolerance
+			&& std::fabs(glm::dot(y, y) - xx) <= tolerance && std::fabs(glm::dot(z, z) - xx) <= tolerance;
+	}
+
+	// Inverse transpose of the upper 3x3 of m. For s * R that is R / s, which is m / s^2; otherwise its columns are the
+	// cross products of m's columns over the determinant
+	static glm::mat3 normalMatrix(const glm::mat4 & m, bool conformal) {
+		glm::vec3 x = glm::vec3(m[0]), y = glm::vec3(m[1]), z = glm::vec3(m[2]);
+		if (conformal) {
+			float scaleSquared = glm::dot(x, x);
+			return (scaleSquared > 0.0f) ? glm::mat3(x, y, z) * (1.0f / scaleSquared) : glm::mat3(x, y, z);
+		}
+
+		glm::vec3 yz = glm::cross(y, z);
+		float determinant = glm::dot(x, yz);
+		glm::mat3 cofactors(yz, glm::cross(z, x), glm::cross(x, y));
+		return (determinant != 0.0f) ? cofactors * (1.0f / determinant) : cofactors;
+	}
+
+public:
+	// out = a * b. out may be a or b
+	static void multiply(const glm::mat4 & a, const glm::mat4 & b, glm::mat4 & out) {
+#ifdef TRANSFORM_HIERARCHY_SSE2
+		const float * pa = &a[0][0];
+		const float * pb = &b[0][0];
+		float * po = &out[0][0];
+		__m128 a0 = _mm_loadu_ps(pa), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+		__m128 columns[4] = { _mm_loadu_ps(pb), _mm_loadu_ps(pb + 4), _mm_loadu_ps(pb + 8), _mm_loadu_ps(pb + 12) };
+
+		// Column c of the product is a's columns weighted by the entries of b's column c
+		for (int c = 0; c < 4; c++) {
+			__m128 column = columns[c];
+			__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+			result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(po + 4 * c, result);
+		}
+#else
+		out = a * b;
+#endif
+	}
+
+	// Add a node under parent (an earlier node, -1 for none) and return its index. It is computed at the next update()
+	int addNode(int parent, const glm::mat4 & local) {
+		parents.push_back(parent);
+		locals.push_back(local);
+		worlds.push_back(local);
+		normals.push_back(glm::mat3(1.0f));
+		flags.push_back((unsigned char)(DIRTY | (isConformal(local) ? CONFORMAL : 0)));
+		return (int)parents.size() - 1;
+	}
+
+	void clear() {
+		parents.clear();
+		locals.clear();
+		worlds.clear();
+		normals.clear();
+		flags.clear();
+	}
+
+	size_t size() const {
+		return parents.size();
+	}
+
+	void setLocal(int node, const glm::mat4 & local) {
+		locals[node] = local;
+		flags[node] = (unsigned char)((flags[node] & ~CONFORMAL) | DIRTY | (isConformal(local) ? CONFORMAL : 0));
+	}
+
+	const glm::mat4 & getLocal(int node) const {
+		return locals[node];
+	}
+
+	// Model space to world space, as of the last update()
+	const glm::mat4 & getWorld(int node) const {
+		return worlds[node];
+	}
+
+	// Inverse transpose of the world transform's upper 3x3, for normals
+	const glm::mat3 & getNormalMatrix(int node) const {
+		return normals[node];
+	}
+
+	// Whether the last update() recomputed node
+	bool changed(int node) const {
+		return (flags[node] & CHANGED) != 0;
+	}
+
+	// Recompute the world and normal matrices of dirty nodes and their descendants. Returns how many were recomputed
+	int update() {
+		int recomputed = 0;
+		for (size_t i = 0; i < parents.size(); i++) {
+			int parent = parents[i];
+			unsigned char nodeFlags = flags[i];
+			bool parentChanged = parent >= 0 && (flags[parent] & CHANGED);
+			if (!(nodeFlags & DIRTY) && !parentChanged) {
+				flags[i] = (unsigned char)(nodeFlags & ~CHANGED);
+				continue;
+			}
+
+			bool conformal = (nodeFlags & CONFORMAL) && (parent < 0 || (flags[parent] & CONFORMAL_WORLD));
+			if (parent >= 0)
+				multiply(worlds[parent], locals[i], worlds[i]);
+			else
+				worlds[i] = locals[i];
+			normals[i] = normalMatrix(worlds[i], conformal);
+			flags[i] = (unsigned char)((nodeFlags & CONFORMAL) | CHANGED | (conformal ? CONFORMAL_WORLD : 0));
+			recomputed++;
+		}
+		return recomputed;
+	}
+
+};
@@ -0,0 +1,79 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class keeps a uniform buffer of one or more copies of a std140 struct (see SceneUniforms.h). The
+ *              copies are filled on the CPU and sent in one upload, and each sits at an offset glBindBufferRange
+ *              accepts, so switching a block between them (one per material) is a single bind
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <vector>
+#include "GLState.h"
+
+template <typename T> class UniformBuffer {
+
+private:
+	GLuint buffer;
+	GLuint binding;
+	size_t stride;			// sizeof(T) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	size_t count;
+	size_t capacity;		// Copies the GL buffer has room for
+	std::vector<unsigned char> staging;
+
+	UniformBuffer(const UniformBuffer &);
+	UniformBuffer & operator=(const UniformBuffer &);
+
+public:
+	UniformBuffer() : buffer(0), binding(0), stride(0), count(0), capacity(0) {}
+
+	// Create the buffer for blocks bound to bindingPoint, with room for numCopies (needs the GL context)
+	void create(GLuint bindingPoint, size_t numCopies = 1) {
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		binding = bindingPoint;
+		stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+		glGenBuffers(1, &buffer);
+		resize(numCopies);
+	}
+
+	// Change the number of copies. The GL buffer grows at the next upload
+	void resize(size_t numCopies) {
+		count = numCopies;
+		if (staging.size() < count * stride)
+			staging.resize(count * stride, 0);
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	// Copy i on the CPU side, sent with the next upload()
+	T & operator[](size_t i) {
+		return *(T *)(staging.data() + i * stride);
+	}
+
+	// Send every copy to the GPU
+	void upload() {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		if (count > capacity) {
+			capacity = count;
+			glBufferData(GL_UNIFORM_BUFFER, capacity * stride, staging.data(), GL_DYNAMIC_DRAW);
+		}
+		else {
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, count * stride, staging.data());
+		}
+	}
+
+	// Point the block's binding point at copy i, through state so binding the copy that is already there costs nothing
+	void bind(GLState & state, size_t i = 0) {
+		state.bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, i * stride, sizeof(T));
+	}
+
+	// The same for code that doesn't keep a GLState
+	void bind(size_t i = 0) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, i * stride, sizeof(T));
+	}
+
+};
@@ -0,0 +1,112 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class is a ring of staging segments in one persistently mapped buffer. Any thread can fill a
+ *              segment through its pointer; the GL thread then copies it into a real buffer on the GPU and fences it,
+ *              and the segment can be filled again once the fence has passed. Without GL_ARB_buffer_storage the
+ *              segments are plain memory uploaded with glBufferSubData
+ */
+
+#pragma once
+
+#include <GL\glew.h>
+#include <vector>
+
+class UploadRing {
+
+private:
+	GLuint buffer;
+	char * mapped;
+	std::vector<char> fallback;
+	size_t segmentSize;
+	int numSegments;
+
+	// Fence after the last copy out of each segment (0 when the GPU isn't reading it)
+	std::vector<GLsync> fences;
+
+	UploadRing(const UploadRing &);
+	UploadRing & operator=(const UploadRing &);
+
+public:
+	// Must be created on the GL thread
+	UploadRing(size_t bytesPerSegment, int segments) : buffer(0), mapped(NULL), segmentSize(bytesPerSegment), numSegments(segments),
+		fences(segments, (GLsync)0) {
+		if (GLEW_ARB_buffer_storage) {
+			// Coherent, so writes from any thread are visible to copies issued after them
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glBufferStorage(GL_COPY_READ_BUFFER, (GLsizeiptr)(segmentSize * numSegments), NULL, flags);
+			mapped = (char *)glMapBufferRange(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(segmentSize * numSegments), flags);
+		}
+		if (mapped == NULL) {
+			if (buffer != 0)
+				glDeleteBuffers(1, &buffer);
+			buffer = 0;
+			fallback.resize(segmentSize * numSegments);
+		}
+	}
+
+	// Free the buffer and fences. Not done in a destructor, since it has to run on the GL thread
+	void release() {
+		for (int i = 0; i < numSegments; i++) {
+			if (fences[i] != 0)
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (buffer != 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = 0;
+		mapped = NULL;
+		std::vector<char>().swap(fallback);
+	}
+
+	// Where segment i can be written
+	char * getSegment(int i) {
+		return (mapped != NULL) ? mapped + segmentSize * i : fallback.data() + segmentSize * i;
+	}
+
+	size_t getSegmentSize() {
+		return segmentSize;
+	}
+
+	int getNumSegments() {
+		return numSegments;
+	}
+
+	bool isPersistent() {
+		return mapped != NULL;
+	}
+
+	// Whether the GPU is done copying out of segment i. Never waits (GL thread only)
+	bool isSegmentFree(int i) {
+		if (fences[i] == 0)
+			return true;
+		GLenum status = glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return false;
+		glDeleteSync(fences[i]);
+		fences[i] = 0;
+		return true;
+	}
+
+	// Queue a copy of the first bytes of segment i into destination at offset, then fence the segment (GL thread only)
+	void copyToBuffer(int i, size_t bytes, GLuint destination, size_t offset) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+		if (mapped == NULL) {
+			// The data is copied before glBufferSubData returns, so there is nothing to fence
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, getSegment(i));
+			return;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)(segmentSize * i), (GLintptr)offset, (GLsizeiptr)bytes);
+		if (fences[i] != 0)
+			glDeleteSync(fences[i]);
+		fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+};
@@ -12,6 +12,7 @@
 #include <fstream>
 #include <glm\glm.hpp>
 #include <glm\ext.hpp>
+#include "ShaderCompiler.h"
 
 // Check for Errors (1/3), copied from TB
 void printShaderLog(GLuint shader) {
@@ -53,85 +54,23 @@ bool checkOpenGLError() {
 	return foundError;
 }
 
-// Make GLSL code a String
+// Make GLSL code a String: the first section of the file (or the whole file if it has no #sof markers)
 std::string readShaderSource(const char * filePath) {
-	std::string content;
-	std::ifstream fileStream(filePath, std::ios::in);
-	std::string line = "";
-
-	// Search for start-of-file marker
-	std::getline(fileStream, line);
-	while (line.find("#sof") == std::string::npos) {
-		getline(fileStream, line);
-	}
-
-	// Read shader file until end-of-file marker
-	getline(fileStream, line);
-	while (line.find("#eof") == std::string::npos) {
-		content.append(line + "\n");
-		getline(fileStream, line);
-	}
-	fileStream.close();
+	return ShaderPreprocessor::process(ShaderSource(filePath)).source;
+}
 
-	return content;
+// Compile the GLSL code of a section of each file, with #includes pasted in and the given #defines. Waits for the
+// program; use a ShaderCompiler to build several at once or without waiting. Returns 0 if it doesn't compile
+GLuint createShaderProgram(const ShaderSource & vertexSource, const ShaderSource & fragmentSource) {
+	ShaderCompiler compiler;
+	int program = compiler.submit(vertexSource, fragmentSource);
+	compiler.finish(program);
+	return compiler.getProgram(program);
 }
 
-// Compile the GLSL code
+// Compile the first section of each file
 GLuint createShaderProgram(const char * vshaderSrc, const char * fshaderSrc) {
-	// For debugging
-	GLint vertCompiled;
-	GLint fragCompiled;
-	GLint linked;
-
-	// Get shader src code from GLSL file -- NOTE: file structure varies from that used in textbook
-	std::string vertShaderStr = readShaderSource(vshaderSrc);
-	std::string fragShaderStr = readShaderSource(fshaderSrc);
-
-	// Make GLSL code a c-string
-	const char * vertShaderSrc = vertShaderStr.c_str();
-	const char * fragShaderSrc = fragShaderStr.c_str();
-
-	// Generate the shaders
-	GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Populate each shader with the string arrays
-	glShaderSource(vShader, 1, &vertShaderSrc, NULL);
-	glShaderSource(fShader, 1, &fragShaderSrc, NULL);
-
-	// Compile vertex shader and check for error
-	glCompileShader(vShader);
-	checkOpenGLError();
-	glGetShaderiv(vShader, GL_COMPILE_STATUS, &vertCompiled);
-	if (vertCompiled != 1) {
-		std::cout << "vertex compilation failed" << std::endl;
-		printShaderLog(vShader);
-	}
-
-	// Compile fragment shader and check for error
-	glCompileShader(fShader);
-	checkOpenGLError();
-	glGetShaderiv(fShader, GL_COMPILE_STATUS, &fragCompiled);
-	if (fragCompiled != 1) {
-		std::cout << "fragment compilation failed" << std::endl;
-		printShaderLog(fShader);
-	}
-
-	// Create OpenGL program (see page 15, P2)
-	GLuint vfProgram = glCreateProgram();
-	glAttachShader(vfProgram, vShader);
-	glAttachShader(vfProgram, fShader);
-	glLinkProgram(vfProgram);
-
-	// Check for linking errors
-	checkOpenGLError();
-	glGetProgramiv(vfProgram, GL_LINK_STATUS, &linked);
-	if (linked != 1) {
-		std::cout << "linking failed" << std::endl;
-		printProgramLog(vfProgram);
-	}
-
-	return vfProgram;
+	return createShaderProgram(ShaderSource(vshaderSrc), ShaderSource(fshaderSrc));
 }
 
 // Copied from Text
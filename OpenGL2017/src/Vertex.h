@@ -0,0 +1,62 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: The interleaved vertex layouts shared by the importer, the mesh cache and the GPU buffers,
+ *              plus a small non-owning view type for handing arrays around without copying them
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// One vertex of an imported model, exactly as it is stored in the vertex buffer
+struct Vertex {
+	glm::vec3 position;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+	glm::vec4 tangent;		// xyz = tangent, w = bitangent sign (+1 or -1)
+};
+
+// The same vertex quantized to 20 bytes (see VertexQuantizer). vertShader_F.glsl turns it back into floats
+struct PackedVertex {
+	uint16_t position[4];	// Normalized position inside the mesh bounds; [3] is the bitangent sign (0 = -1, 65535 = +1)
+	uint16_t texCoord[2];	// Half floats
+	int16_t normal[2];		// Octahedral encoding, normalized
+	int16_t tangent[2];		// Octahedral encoding, normalized
+};
+
+// Pointer and element count of an array owned by someone else
+template <typename T>
+struct ArrayView {
+	const T * data;
+	size_t count;
+
+	ArrayView() : data(NULL), count(0) {}
+	ArrayView(const T * viewData, size_t viewCount) : data(viewData), count(viewCount) {}
+
+	const T & operator[](size_t i) const {
+		return data[i];
+	}
+
+	const T * begin() const {
+		return data;
+	}
+
+	const T * end() const {
+		return data + count;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	size_t sizeInBytes() const {
+		return count * sizeof(T);
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+};
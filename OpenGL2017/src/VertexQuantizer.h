@@ -0,0 +1,187 @@
+/*
+ * Name: Pranav Rao
+ * Class: CSCI 168 Graphics Programming in OpenGL
+ * Description: This class packs 48-byte float vertices into 20-byte PackedVertex records: 16-bit positions relative to the
+ *              mesh bounds, octahedral normals and tangents, and half float texture coordinates. It decodes every vertex
+ *              the same way the vertex shader does, so it can report how much precision was lost
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+// Largest and average errors of a packed mesh against the float original
+struct QuantizationStats {
+	float maxPositionError;		// In model units
+	float avgPositionError;
+	float maxNormalError;		// In degrees
+	float maxTangentError;		// In degrees
+	float maxTexCoordError;		// In UV units
+};
+
+class VertexQuantizer {
+
+private:
+	static float signNotZero(float value) {
+		return (value >= 0.0f) ? 1.0f : -1.0f;
+	}
+
+	static int16_t toSnorm16(float value) {
+		return (int16_t)std::floor(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f + 0.5f);
+	}
+
+	// Same conversion as OpenGL for normalized signed attributes
+	static float fromSnorm16(int16_t value) {
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	static float angleDegrees(glm::vec3 a, glm::vec3 b) {
+		float cosine = glm::dot(a, b) / std::max(glm::length(a) * glm::length(b), 1e-20f);
+		return std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * 57.2957795f;
+	}
+
+public:
+	// Map a unit vector onto the octahedron and unfold it into the [-1, 1] square
+	static glm::vec2 octEncode(glm::vec3 n) {
+		float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (sum == 0.0f)
+			return glm::vec2(0.0f);
+		n /= sum;
+		if (n.z >= 0.0f)
+			return glm::vec2(n.x, n.y);
+		return glm::vec2((1.0f - std::fabs(n.y)) * signNotZero(n.x), (1.0f - std::fabs(n.x)) * signNotZero(n.y));
+	}
+
+	static glm::vec3 octDecode(glm::vec2 e) {
+		glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+		if (n.z < 0.0f) {
+			float x = n.x;
+			n.x = (1.0f - std::fabs(n.y)) * signNotZero(x);
+			n.y = (1.0f - std::fabs(x)) * signNotZero(n.y);
+		}
+		return glm::normalize(n);
+	}
+
+	// IEEE half float, rounded to nearest even
+	static uint16_t floatToHalf(float value) {
+		uint32_t f;
+		memcpy(&f, &value, sizeof(f));
+		uint32_t sign = (f >> 16) & 0x8000;
+		int32_t floatExponent = (f >> 23) & 0xFF;
+		int32_t exponent = floatExponent - 127 + 15;
+		uint32_t mantissa = f & 0x7FFFFF;
+
+		if (floatExponent == 0xFF)
+			return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0)); // Inf or NaN
+		if (exponent >= 31)
+			return (uint16_t)(sign | 0x7C00); // Too big: Inf
+
+		if (exponent <= 0) {
+			// Denormal half (or zero)
+			if (exponent < -10)
+				return (uint16_t)sign;
+			mantissa |= 0x800000;
+			int shift = 14 - exponent;
+			uint32_t half = mantissa >> shift;
+			uint32_t remainder = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (remainder > halfway || (remainder == halfway && (half & 1)))
+				half++;
+			return (uint16_t)(sign | half);
+		}
+
+		// A carry out of the mantissa correctly bumps the exponent
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		uint32_t remainder = mantissa & 0x1FFF;
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+			half++;
+		return (uint16_t)half;
+	}
+
+	static float halfToFloat(uint16_t half) {
+		float sign = (half & 0x8000) ? -1.0f : 1.0f;
+		int exponent = (half >> 10) & 0x1F;
+		int mantissa = half & 0x3FF;
+
+		if (exponent == 0)
+			return sign * std::ldexp((float)mantissa, -24);
+		if (exponent == 31)
+			return mantissa ? NAN : sign * INFINITY;
+		return sign * std::ldexp((float)(mantissa | 0x400), exponent - 25);
+	}
+
+	// Pack vertices, whose positions lie inside [boundsMin, boundsMax]. The shader gets position = boundsMin + q * (boundsMax - boundsMin)
+	static QuantizationStats pack(ArrayView<Vertex> vertices, glm::vec3 boundsMin, glm::vec3 boundsMax, std::vector<PackedVertex> & packed) {
+		packed.resize(vertices.size());
+		return pack(vertices, boundsMin, boundsMax, packed.data());
+	}
+
+	// Same, into memory the caller provides (vertices.size() records)
+	static QuantizationStats pack(ArrayView<Vertex> vertices, glm::vec3 boundsMin, glm::vec3 boundsMax, PackedVertex * packed) {
+		QuantizationStats stats = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+		glm::vec3 extent = boundsMax - boundsMin;
+		glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+			extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		double positionErrorSum = 0.0;
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const Vertex & vertex = vertices[i];
+			PackedVertex & out = packed[i];
+
+			glm::vec3 decodedPosition;
+			for (int c = 0; c < 3; c++) {
+				float normalized = std::min(std::max((vertex.position[c] - boundsMin[c]) * invExtent[c], 0.0f), 1.0f);
+				out.position[c] = (uint16_t)std::floor(normalized * 65535.0f + 0.5f);
+				decodedPosition[c] = boundsMin[c] + (out.position[c] / 65535.0f) * extent[c];
+			}
+			out.position[3] = (vertex.tangent.w < 0.0f) ? 0 : 65535;
+
+			out.texCoord[0] = floatToHalf(vertex.texCoord.x);
+			out.texCoord[1] = floatToHalf(vertex.texCoord.y);
+
+			glm::vec2 normal = octEncode(vertex.normal);
+			glm::vec2 tangent = octEncode(glm::vec3(vertex.tangent));
+			out.normal[0] = toSnorm16(normal.x);
+			out.normal[1] = toSnorm16(normal.y);
+			out.tangent[0] = toSnorm16(tangent.x);
+			out.tangent[1] = toSnorm16(tangent.y);
+
+			// Measure the round trip
+			float positionError = glm::length(decodedPosition - vertex.position);
+			positionErrorSum += positionError;
+			stats.maxPositionError = std::max(stats.maxPositionError, positionError);
+
+			glm::vec3 decodedNormal = octDecode(glm::vec2(fromSnorm16(out.normal[0]), fromSnorm16(out.normal[1])));
+			glm::vec3 decodedTangent = octDecode(glm::vec2(fromSnorm16(out.tangent[0]), fromSnorm16(out.tangent[1])));
+			if (glm::length(vertex.normal) > 0.0f)
+				stats.maxNormalError = std::max(stats.maxNormalError, angleDegrees(decodedNormal, vertex.normal));
+			if (glm::length(glm::vec3(vertex.tangent)) > 0.0f)
+				stats.maxTangentError = std::max(stats.maxTangentError, angleDegrees(decodedTangent, glm::vec3(vertex.tangent)));
+
+			glm::vec2 decodedTexCoord(halfToFloat(out.texCoord[0]), halfToFloat(out.texCoord[1]));
+			glm::vec2 texCoordError = glm::abs(decodedTexCoord - vertex.texCoord);
+			stats.maxTexCoordError = std::max(stats.maxTexCoordError, std::max(texCoordError.x, texCoordError.y));
+		}
+
+		stats.avgPositionError = vertices.empty() ? 0.0f : (float)(positionErrorSum / vertices.size());
+		return stats;
+	}
+
+	// Combine the stats of two packed batches of numA and numB vertices
+	static QuantizationStats merge(QuantizationStats a, size_t numA, QuantizationStats b, size_t numB) {
+		QuantizationStats stats;
+		stats.maxPositionError = std::max(a.maxPositionError, b.maxPositionError);
+		stats.avgPositionError = (numA + numB == 0) ? 0.0f : (float)(((double)a.avgPositionError * numA + (double)b.avgPositionError * numB) / (numA + numB));
+		stats.maxNormalError = std::max(a.maxNormalError, b.maxNormalError);
+		stats.maxTangentError = std::max(a.maxTangentError, b.maxTangentError);
+		stats.maxTexCoordError = std::max(a.maxTexCoordError, b.maxTexCoordError);
+		return stats;
+	}
+
+};
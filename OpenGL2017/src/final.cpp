@@ -13,45 +13,72 @@
  * "Sobrato Municipal Airfield" is a fictional place and may or may not have anything to do with the Sobrato family
  *
  */
-#include <stack>
+#include <chrono>
+#include <cstddef>
 #include "Utils_PR.h"
 #include "ImportedModel.h"
-
- // Number of Vertex Array Objects and Vertex Buffer Objects (P, T, N for Falcon; P, T for plane; P only for skybox)
-#define numVAOs 1
-#define numVBOs 25
+#include "ImpostorBaker.h"
+#include "AssetLoader.h"
+#include "GLState.h"
+#include "MaterialLibrary.h"
+#include "Scene.h"
+#include "SceneUniforms.h"
+#include "ShaderPermutations.h"
+#include "TransformHierarchy.h"
+#include "UniformBuffer.h"
 
 // Vertex and Fragment shader file paths
 const char * vShaderFile = "res/shaders/vertShader_F.glsl";
 const char * fShaderFile = "res/shaders/fragShader_F.glsl";
 const char * vShaderSkyFile = "res/shaders/vertCShader_F.glsl";
 const char * fShaderSkyFile = "res/shaders/fragCShader_F.glsl";
+const char * vShaderImpostorFile = "res/shaders/vertImpostorShader_F.glsl";
+const char * fShaderImpostorFile = "res/shaders/fragImpostorShader_F.glsl";
+const char * vShaderImpostorBakeFile = "res/shaders/vertImpostorBakeShader_F.glsl";
+const char * fShaderImpostorBakeFile = "res/shaders/fragImpostorBakeShader_F.glsl";
+
+// What is drawn and where: the sky, the meshes, and the nodes that place them (see Scene.h)
+const char * scenePath = "res/scenes/airport.scene";
+Scene scene;
+
+// The scene's meshes, by index into scene.meshes: OBJs as empty placeholders until each one has streamed in, the
+// buffers each is drawn from (interleaved vertices, and indices for OBJs; planes only use their vertex buffer) and the
+// vertex array that reads them, so drawing a mesh binds one object
+std::vector<ImportedModel> objects;
+std::vector<GLuint> vertexBuffers, indexBuffers;
+std::vector<GLuint> vertexArrays;
+std::vector<GLuint> normalMaps; // Planes only; flat until the map has loaded
 
-// Texture file paths
-const char * skyBoxPath = "res/cubeMap";
-const char texPaths[7][50] = {
-	"res/textures/ground_plane_tex.png",
-	"res/textures/Fuselage_TOTAL_TEX.png",
-	"res/textures/hi_ace_tex.png",
-	"res/textures/terminal_tex.png",
-	"res/textures/tower_tex.png",
-	"res/textures/tower_roof_tex.png",
-	"res/textures/dish_tex.png"
-};
+// Materials of every model, deduplicated, with their diffuse maps in texture arrays. objectMaterials[i][m] is the
+// library's index for material m of objects[i] (empty until the mesh has loaded; a plane's one material from the start)
+MaterialLibrary materialLibrary;
+std::vector<std::vector<int>> objectMaterials;
 
-// OBJ file paths
-const char meshPaths[7][50] = {
-	"res/meshes/dassault_falcon2.obj",
-	"res/meshes/hi_ace.obj",
-	"res/meshes/terminal.obj",
-	"res/meshes/tower.obj",
-	"res/meshes/tower_windows.obj",
-	"res/meshes/tower_roof.obj",
-	"res/meshes/dish.obj"
-};
+// The binds and enables the draw loop repeats for every object go through here, so unchanged state isn't sent again
+GLState glState;
 
-// Create instances of the OBJs
-std::vector<ImportedModel> objects;
+// Parses meshes and decodes images on worker threads; finished assets are uploaded between frames
+AssetLoader assetLoader;
+double uploadBudgetMilliseconds = 4.0;	// Upload time per frame (at least one asset is always uploaded)
+int meshesLoaded = 0;
+
+// OBJs bigger than this are streamed straight into their vertex buffers instead of being imported whole
+bool streamLargeMeshes = true;
+uint64_t streamingThresholdBytes = 256ull << 20;
+
+// Startup timing
+std::chrono::high_resolution_clock::time_point programStart;
+bool firstFrameDrawn = false;
+
+// Upload the OBJs as 20-byte PackedVertex records instead of 48-byte float Vertex records
+bool usePackedVertices = true;
+
+// Impostors of the meshes the scene marks for them, drawn instead of the meshes beyond impostorDistance
+std::vector<Impostor> impostors;
+bool useImpostors = true;
+float impostorDistance = 60.0f;
+int impostorGridSize = 8;		// Views per side of the octahedral atlas
+int impostorCellSize = 128;		// Pixels per side of one view
 
 // Location variables for the matrices
 float cameraX, cameraY, cameraZ;
@@ -60,27 +87,96 @@ float cameraX, cameraY, cameraZ;
 bool keepFixed = 1;
 
 // Important variables
-GLuint renderingProgram, renderingProgramCubeMap;
-GLuint vao[numVAOs];
-GLuint vbo[numVBOs];
+const ShaderProgram * renderingProgram;
+const ShaderProgram * renderingProgramCubeMap, * renderingProgramImpostor, * renderingProgramImpostorBake;
+
+// Compiles shader programs in the background; polled once a frame
+ShaderCompiler shaderCompiler;
+
+// Specialized versions of the object shaders ("unlit" sections), one per combination of fac and normal map that is drawn.
+// Until one has compiled, the version without #defines is drawn with. renderingProgram is the one in use
+ShaderPermutations objectPrograms(shaderCompiler);
+
+// Uniforms of vertexInput.glsl, in the programs that draw imported models
+struct VertexUniforms {
+	Uniform<int> packedVertices;
+	Uniform<glm::vec3> posScale, posOffset;
+
+	VertexUniforms() {}
+	explicit VertexUniforms(const ShaderProgram & program) : packedVertices(program.uniform<int>("packedVertices")),
+		posScale(program.uniform<glm::vec3>("posScale")), posOffset(program.uniform<glm::vec3>("posOffset")) {}
+};
+
+// Uniforms set for each object drawn, found again whenever renderingProgram changes
+struct ObjectUniforms {
+	Uniform<glm::mat4> mvMatrix, nrmMatrix;
+	Uniform<float> fac;
+	VertexUniforms vertex;
+
+	ObjectUniforms() {}
+	explicit ObjectUniforms(const ShaderProgram & program) : mvMatrix(program.uniform<glm::mat4>("mv_matrix")),
+		nrmMatrix(program.uniform<glm::mat4>("nrm_matrix")), fac(program.uniform<float>("fac")), vertex(program) {}
+};
+
+// Uniforms set for each impostor drawn
+struct ImpostorUniforms {
+	Uniform<glm::mat4> mvMatrix, nrmMatrix;
+	Uniform<float> fac, radius, gridSize;
+	Uniform<glm::vec3> center, viewDir;
+
+	ImpostorUniforms() {}
+	explicit ImpostorUniforms(const ShaderProgram & program) : mvMatrix(program.uniform<glm::mat4>("mv_matrix")),
+		nrmMatrix(program.uniform<glm::mat4>("nrm_matrix")), fac(program.uniform<float>("fac")), radius(program.uniform<float>("radius")),
+		gridSize(program.uniform<float>("gridSize")), center(program.uniform<glm::vec3>("center")), viewDir(program.uniform<glm::vec3>("viewDir")) {}
+};
+
+ObjectUniforms objectUniforms;
+
+// An object permutation, found by its sources once, and the uniforms of the program it last handed out (the fallback
+// until it has compiled), so switching between permutations while drawing builds no strings and looks nothing up
+struct ObjectProgram {
+	int handle;
+	const ShaderProgram * program;
+	ObjectUniforms uniforms;
+
+	ObjectProgram() : handle(-1), program(NULL) {}
+};
 
-// Declare variables used in display function to save resources
-std::stack<glm::mat4> mvStack;
+// By objectVariant(fac), then without and with the normal map
+ObjectProgram objectProgramSlots[3][2];
+ImpostorUniforms impostorUniforms;
+VertexUniforms bakeUniforms;
 
-GLuint mvLoc, projLoc, vLoc, nLoc;
-GLuint skyboxTexture, facLoc;
-GLuint tex[3];
-GLuint globalAmbLoc, ambLoc, diffLoc, specLoc, posLoc, mAmbLoc, mDiffLoc, mSpecLoc, mShiLoc;
-glm::mat4 pMat, vMat, mMat, mvMat, invTrMat;
+// Uniform blocks: what every program shares for a frame, and one MaterialBlock per material of the library (the last
+// one for draws without a material). Both are filled once a frame
+UniformBuffer<FrameUniforms> frameBlock;
+UniformBuffer<MaterialUniforms> materialBlocks;
+GLuint skyboxBuffer, skyboxVertexArray;
+
+GLuint skyboxTexture;
+GLuint environmentMap; // The sky prefiltered for rough reflections, 0 until it has been built or read
+glm::mat4 pMat, vMat, mMat;
+
+// World transform of each scene node, recomputed only below nodes that moved. How many were recomputed this frame, and
+// how long updating and drawing the scene took
+TransformHierarchy sceneTransforms;
+std::vector<int> animatedNodes;
+int transformsRecomputed;
+double sceneMilliseconds;
 
-int vboInd, texInd, objInd;
 int width, height;
 float aspect;
 
+// Level of detail: draw the coarsest level whose simplification error covers at most this many pixels on screen
+float lodPixelError = 1.0f;
+
+// Triangles drawn in the current frame, what they would have been at full detail, and when they were last reported
+long trianglesDrawn, fullDetailTriangles;
+double lastTriangleReport = 0.0;
+
 //Lights
 void installLights(glm::mat4 vMatrix);
 glm::vec3 currentLightPos, lightPosV;
-float lightPos[3];
 
 glm::vec3 initialLightLoc = glm::vec3(5.0f, 2.0f, 2.0f);
 
@@ -89,10 +185,26 @@ float lightAmbient[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 float lightDiffuse[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 float lightSpecular[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-float* matAmb = goldAmbient();
-float* matDif = goldDiffuse();
-float* matSpec = goldSpecular();
-float matShi = goldShininess();
+// Light from the sky (EnvironmentMap), zero until the sky has been prefiltered
+glm::vec4 skyIrradiance[9];
+
+// Animations scene nodes can use by name. Each one is computed once a frame, however many nodes use it
+typedef glm::mat4(*Animation)(double currentTime);
+glm::mat4 animateFalconLanding(double currentTime);
+glm::mat4 animateHiaceDrive(double currentTime);
+glm::mat4 animateDishSpin(double currentTime);
+
+const struct {
+	const char * name;
+	Animation animate;
+} animationTable[] = {
+	{ "falconLanding", animateFalconLanding },
+	{ "hiaceDrive", animateHiaceDrive },
+	{ "dishSpin", animateDishSpin }
+};
+
+std::vector<Animation> sceneAnimations;	// By index into scene.animations
+std::vector<glm::mat4> animationTransforms;
 
 // For animation
 float rotation = -toRadians(2.0f);
@@ -129,80 +241,308 @@ float mouseSpeed = 0.05f;
 
 /*************************************************   End of Variable declarations  ********************************************/
 
-// Set up an instance of an Imported model (.obj), defined in the VBO at positions <offset> through <offset+2>
-void setupVerticesObj(ImportedModel model, unsigned int offset) {
-	std::vector<glm::vec3> vert = model.getVertices();
-	std::vector<glm::vec2> tex = model.getTextureCoords();
-	std::vector<glm::vec3> nrm = model.getNormals();
+// Set up an instance of an Imported model (.obj) in the buffers of scene mesh <mesh> (interleaved vertices and indices)
+// The model's interleaved stream (owned or mapped straight from its cache) goes to the GPU as it is, or packed if usePackedVertices is set
+void setupVerticesObj(ImportedModel & model, int mesh) {
 
-	// pvalues will store the positions of the vertices in the sphere
-	std::vector<float> pvalues;
-	std::vector<float> tvalues;
-	std::vector<float> nvalues;
+	// Put the vertices into the VBO
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[mesh]);
+	if (usePackedVertices) {
+		ArrayView<PackedVertex> vertices = model.getPackedVertexStream();
+		glBufferData(GL_ARRAY_BUFFER, vertices.sizeInBytes(), vertices.data, GL_STATIC_DRAW);
+	}
+	else {
+		ArrayView<Vertex> vertices = model.getVertexStream();
+		glBufferData(GL_ARRAY_BUFFER, vertices.sizeInBytes(), vertices.data, GL_STATIC_DRAW);
+	}
+
+	// Put the indices into the element buffer (16-bit when the model is small enough). They go through the copy target:
+	// the element array binding belongs to whichever vertex array is bound
+	if (model.isIndexed()) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffers[mesh]);
+		glBufferData(GL_COPY_WRITE_BUFFER, model.getNumIndices() * model.getIndexSize(), model.getIndexData(), GL_STATIC_DRAW);
+	}
+
+}
 
-	int numObjVertices = model.getNumVertices();
+// Create the vertex array of scene mesh <mesh>: attributes (Position, Tex, NRM, Tangent) read from its interleaved
+// vertex buffer, float Vertex records or PackedVertex ones, and its index buffer for OBJs. The format is set once here,
+// so drawing the mesh is a single bind
+void setupVertexArray(int mesh, bool packed) {
+	glGenVertexArrays(1, &vertexArrays[mesh]);
+	glBindVertexArray(vertexArrays[mesh]);
+
+	if (packed) {
+		glVertexAttribFormat(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+		glVertexAttribFormat(1, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord));
+		glVertexAttribFormat(2, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+		glVertexAttribFormat(3, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, tangent));
+	}
+	else {
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+		glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, texCoord));
+		glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+		glVertexAttribFormat(3, 4, GL_FLOAT, GL_FALSE, offsetof(Vertex, tangent));
+	}
+	for (GLuint i = 0; i < 4; i++) {
+		glVertexAttribBinding(i, 0);
+		glEnableVertexAttribArray(i);
+	}
+	glBindVertexBuffer(0, vertexBuffers[mesh], 0, packed ? sizeof(PackedVertex) : sizeof(Vertex));
 
-	// Populate position, texture, and normal vectors with the objects's acual values
-	for (int i = 0; i < numObjVertices; i++) {
-		pvalues.push_back((vert[i]).x);
-		pvalues.push_back((vert[i]).y);
-		pvalues.push_back((vert[i]).z);
+	if (!scene.meshes[mesh].path.empty())
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffers[mesh]);
 
-		tvalues.push_back((tex[i]).s);
-		tvalues.push_back((tex[i]).t);
+	glBindVertexArray(0);
+}
 
-		nvalues.push_back((nrm[i]).x);
-		nvalues.push_back((nrm[i]).y);
-		nvalues.push_back((nrm[i]).z);
+// Packed models need their bounds to turn their 16-bit positions back into model space (uniforms of program)
+void setObjUniforms(ImportedModel & model, const ShaderProgram & program, const VertexUniforms & uniforms) {
+	if (usePackedVertices) {
+		glm::vec3 boundsMin = model.getBoundsMin();
+		glm::vec3 extent = model.getBoundsMax() - boundsMin;
+		program.set(uniforms.packedVertices, 1);
+		program.set(uniforms.posScale, extent);
+		program.set(uniforms.posOffset, boundsMin);
+	}
+	else {
+		program.set(uniforms.packedVertices, 0);
 	}
+}
 
-	// No need to initialize VBOs and VAOs. That was done in setupVerticesSphere()
+// The object shader sources for a surface that mixes sky reflection and diffuse map by fac, with or without the ground's
+// normal map. fac of 0 or 1 gets a permutation that only samples one of them; the rest share one that mixes at run time
+ShaderSource objectVertexShader() {
+	return ShaderSource(vShaderFile, "unlit");
+}
 
-	// Put the vertices into the VBO at position 0
-	// Multiply by 4 because pvalues contains floats, and each float is 4 bytes (quicker than sizeof(float) ).
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset]);
-	glBufferData(GL_ARRAY_BUFFER, pvalues.size() * 4, &pvalues[0], GL_STATIC_DRAW);
+// Which #defines fac picks: 0 for none (mixed at run time), 1 for PURE_DIFFUSE, 2 for PURE_REFLECTION
+int objectVariant(float fac) {
+	return (fac >= 1.0f) ? 1 : (fac <= 0.0f) ? 2 : 0;
+}
 
-	// Put texture coordinates into VBO
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset + 1]);
-	glBufferData(GL_ARRAY_BUFFER, tvalues.size() * 4, &tvalues[0], GL_STATIC_DRAW);
+ShaderSource objectFragmentShader(float fac, bool normalMap) {
+	static const char * variantDefines[3] = { NULL, "PURE_DIFFUSE", "PURE_REFLECTION" };
+	std::vector<std::string> defines;
+	if (variantDefines[objectVariant(fac)] != NULL)
+		defines.push_back(variantDefines[objectVariant(fac)]);
+	if (normalMap)
+		defines.push_back("NORMAL_MAP");
+	return ShaderSource(fShaderFile, "unlit", defines);
+}
 
-	// Put normals into VBO
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset + 2]);
-	glBufferData(GL_ARRAY_BUFFER, nvalues.size() * 4, &nvalues[0], GL_STATIC_DRAW);
+// The permutation for fac and normalMap, requested the first time it is asked for
+ObjectProgram & objectProgram(float fac, bool normalMap) {
+	ObjectProgram & slot = objectProgramSlots[objectVariant(fac)][normalMap ? 1 : 0];
+	if (slot.handle < 0)
+		slot.handle = objectPrograms.request(objectVertexShader(), objectFragmentShader(fac, normalMap));
+	return slot;
+}
+
+// Switch to the object program for fac and normalMap (the fallback while it is compiling)
+void useObjectProgram(float fac, bool normalMap) {
+	ObjectProgram & slot = objectProgram(fac, normalMap);
+	const ShaderProgram * program = objectPrograms.get(slot.handle);
+	if (program != slot.program) {
+		slot.program = program;
+		slot.uniforms = ObjectUniforms(*program);
+	}
 
+	if (program != renderingProgram) {
+		renderingProgram = program;
+		objectUniforms = slot.uniforms;
+	}
+	glState.useProgram(renderingProgram->getId());
+	renderingProgram->set(objectUniforms.fac, fac);
 }
 
-// Set up an instance of an square plane with side length radius*2, defined in the VBO at positions <offset> through <offset+2>
-void setupVerticesPlane(float radius, unsigned int offset) {
-	float vertexPositions[18] = {
-		-radius,  0.0f, -radius, -radius, 0.0f, radius, radius, 0.0f, radius,
-		radius, 0.0f, radius, radius, 0.0f, -radius, -radius,  0.0f, -radius,
-	};
+// Pick the level of detail for a model drawn with the model-view matrix mvMatrix, from how big it is on screen
+int selectLod(ImportedModel & model, glm::mat4 mvMatrix) {
+	glm::vec3 boundsMin = model.getBoundsMin();
+	glm::vec3 boundsMax = model.getBoundsMax();
+	glm::vec3 extent = boundsMax - boundsMin;
+	float size = glm::max(extent.x, glm::max(extent.y, extent.z));
+
+	// Bounding sphere in view space (scaled by the biggest scale in the matrix)
+	float scale = glm::max(glm::length(glm::vec3(mvMatrix[0])), glm::max(glm::length(glm::vec3(mvMatrix[1])), glm::length(glm::vec3(mvMatrix[2]))));
+	glm::vec3 center = glm::vec3(mvMatrix * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+	float radius = glm::length(extent) * 0.5f * scale;
+	float distance = glm::max(glm::length(center) - radius, 0.1f);
+
+	// pMat[1][1] is 1 / tan(fov / 2), so this is how many pixels one unit covers at that distance
+	float pixelsPerUnit = 0.5f * height * pMat[1][1] / distance;
+
+	for (int lod = model.getNumLods() - 1; lod > 0; lod--) {
+		if (model.getLod(lod).error * size * scale * pixelsPerUnit <= lodPixelError)
+			return lod;
+	}
+	return 0;
+}
 
-	float texCoords[12] = {
-		0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-		1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
-	};
+// Fill the material blocks from the library and upload them. Once a frame, and before baking impostors (meshes that
+// arrive add materials, textures that arrive move them to other layers)
+void updateMaterialBlocks() {
+	int numMaterials = materialLibrary.getNumMaterials();
+	materialBlocks.resize(numMaterials + 1);
+	for (int material = -1; material < numMaterials; material++) {
+		MaterialUniforms & block = materialBlocks[(material >= 0) ? material : numMaterials];
+		if (material >= 0) {
+			Material m = materialLibrary.getMaterial(material);
+			block.ambient = m.ambient;
+			block.diffuse = m.diffuse;
+			block.specular = m.specular;
+			block.shininess = m.shininess;
+		}
+		block.baseColor = materialLibrary.getBaseColor(material);
+		block.roughness = materialLibrary.getRoughness(material);
+		block.texLayer = materialLibrary.getTextureLayer(material).layer;
+	}
+	materialBlocks.upload();
+}
 
-	float normals[12] = {
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f
-	};
+// Point tex_map (unit 1) at the array holding material's diffuse map, and MaterialBlock at the material's copy. The
+// array is only rebound when it changes (glState), so objects whose textures share an array (same size) draw one after
+// another with just a buffer range change
+void useMaterial(int material) {
+	glState.bindTexture(1, GL_TEXTURE_2D_ARRAY, materialLibrary.getTextureLayer(material).array);
+	materialBlocks.bind(glState, (material >= 0) ? material : materialBlocks.size() - 1);
+}
 
-	// Set up and bind the vertex positions to the vertex buffer object
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_STATIC_DRAW);
+// Draw level of detail lodIndex of an imported model whose buffers are bound, one material range at a time.
+// materials maps the model's materials to the library's. Indexed models reuse shared vertices through the element buffer
+void drawLod(ImportedModel & model, int lodIndex, const std::vector<int> & materials) {
+	MeshLod lod = model.getLod(lodIndex);
+	for (uint32_t i = 0; i < lod.numMaterialRanges; i++) {
+		MeshMaterialRange range = model.getMaterialRange(lodIndex, i);
+		useMaterial((range.material < materials.size()) ? materials[range.material] : -1);
+		if (model.isIndexed())
+			glState.drawElements(GL_TRIANGLES, range.numIndices, (model.getIndexSize() == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+				(void *)((size_t)range.firstIndex * model.getIndexSize()));
+		else
+			glState.drawArrays(GL_TRIANGLES, range.firstIndex, range.numIndices);
+	}
+}
+
+// Draw imported object i (its buffers bound) at the level of detail that suits its size on screen.
+// Models that are still loading draw nothing
+void drawObj(int i, glm::mat4 mvMatrix) {
+	ImportedModel & model = objects[i];
+	if (!model.isLoaded())
+		return;
+
+	int lod = selectLod(model, mvMatrix);
+	trianglesDrawn += model.getLod(lod).numIndices / 3;
+	fullDetailTriangles += model.getLod(0).numIndices / 3;
+	drawLod(model, lod, objectMaterials[i]);
+}
+
+// Whether a model drawn with mvMatrix is far enough away to be drawn as its impostor (once the impostor is baked)
+bool beyondImpostorDistance(Impostor & impostor, ImportedModel & model, glm::mat4 mvMatrix) {
+	if (!useImpostors || impostor.albedoAtlas == 0)
+		return false;
+	glm::vec3 center = glm::vec3(mvMatrix * glm::vec4((model.getBoundsMin() + model.getBoundsMax()) * 0.5f, 1.0f));
+	return glm::length(center) > impostorDistance;
+}
+
+// Bake the impostor of scene mesh i, if it has one, once both the mesh (objects[i]) and its materials' textures have
+// streamed in
+void bakeImpostorWhenReady(int i) {
+	ImportedModel & model = objects[i];
+	if (!scene.meshes[i].impostor || impostors[i].albedoAtlas != 0 || !model.isLoaded() || objectMaterials[i].empty())
+		return;
+	for (size_t m = 0; m < objectMaterials[i].size(); m++) {
+		if (!materialLibrary.isReady(objectMaterials[i][m]))
+			return;
+	}
 
-	// Put texture coordinates into VBO
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset + 1]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(texCoords), texCoords, GL_STATIC_DRAW);
+	// Uploads may have used GL directly since the last frame, and the baker does too
+	glState.invalidate();
+	updateMaterialBlocks();
+	glState.useProgram(renderingProgramImpostorBake->getId());
+	impostors[i] = ImpostorBaker::bake(*renderingProgramImpostorBake, model.getBoundsMin(), model.getBoundsMax(), [&]() {
+		glState.bindVertexArray(vertexArrays[i]);
+		setObjUniforms(model, *renderingProgramImpostorBake, bakeUniforms);
+		drawLod(model, 0, objectMaterials[i]);
+	}, width, height, impostorGridSize, impostorCellSize);
+	glState.invalidate();
+}
+
+// Load the textures materials were given since the last call, as one batch of texture arrays
+void requestTextures() {
+	std::vector<int> textures = materialLibrary.takeNewTextures();
+	if (textures.empty())
+		return;
+
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < textures.size(); i++)
+		paths.push_back(materialLibrary.getTexturePath(textures[i]));
+	assetLoader.loadTextureArrays(paths, [textures](std::vector<TextureLayer> layers) {
+		for (size_t i = 0; i < textures.size(); i++)
+			materialLibrary.setTextureLayer(textures[i], layers[i]);
+		for (size_t i = 0; i < impostors.size(); i++)
+			bakeImpostorWhenReady((int)i);
+	});
+}
 
-	// Put normals into VBO
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[offset + 2]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
+// A 1x1 texture of one color
+GLuint createSolidTexture(unsigned char r, unsigned char g, unsigned char b) {
+	unsigned char pixel[4] = { r, g, b, 255 };
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return texture;
+}
+
+// Draw a model's impostor as one camera-facing quad, lit like the model (fac mixes sky reflection and albedo)
+void drawImpostor(Impostor & impostor, ImportedModel & model, const glm::mat4 & mvMatrix, const glm::mat4 & nrmMatrix, float fac) {
+	glState.useProgram(renderingProgramImpostor->getId());
+
+	// Direction from the impostor to the camera, in object space: picks the baked views to blend. The inverse of the
+	// model-view 3x3 is the transpose of the normal matrix
+	glm::vec3 centerView = glm::vec3(mvMatrix * glm::vec4(impostor.center, 1.0f));
+	glm::vec3 viewDir = glm::normalize(glm::transpose(glm::mat3(nrmMatrix)) * -centerView);
+
+	const ShaderProgram & program = *renderingProgramImpostor;
+	program.set(impostorUniforms.mvMatrix, mvMatrix);
+	program.set(impostorUniforms.nrmMatrix, nrmMatrix);
+	program.set(impostorUniforms.fac, fac);
+	program.set(impostorUniforms.center, impostor.center);
+	program.set(impostorUniforms.radius, impostor.radius);
+	program.set(impostorUniforms.viewDir, viewDir);
+	program.set(impostorUniforms.gridSize, (float)impostor.gridSize);
+
+	glState.bindTexture(3, GL_TEXTURE_2D, impostor.albedoAtlas);
+	glState.bindTexture(4, GL_TEXTURE_2D, impostor.normalAtlas);
+
+	// The quad's corners come from gl_VertexID
+	glState.drawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	trianglesDrawn += 2;
+	fullDetailTriangles += model.getLod(0).numIndices / 3;
+}
+
+// Set up an instance of an square plane with side length radius*2 in the vertex buffer of scene mesh <mesh>, as six
+// float Vertex records
+void setupVerticesPlane(float radius, int mesh) {
+	float corners[6][4] = {
+		// x, z, u, v
+		{ -radius, -radius, 0.0f, 1.0f }, { -radius, radius, 0.0f, 0.0f }, { radius, radius, 1.0f, 0.0f },
+		{ radius, radius, 1.0f, 0.0f }, { radius, -radius, 1.0f, 1.0f }, { -radius, -radius, 0.0f, 1.0f }
+	};
+
+	// u runs along +x and v along -z, so the tangent is +x and the bitangent sign is +1
+	Vertex vertices[6];
+	for (int i = 0; i < 6; i++) {
+		vertices[i].position = glm::vec3(corners[i][0], 0.0f, corners[i][1]);
+		vertices[i].texCoord = glm::vec2(corners[i][2], corners[i][3]);
+		vertices[i].normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		vertices[i].tangent = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[mesh]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
 }
 
@@ -239,20 +579,83 @@ void setupVerticesBox(void) {
 		0.50f, 0.66f, 0.25f, 0.66f, 0.25f, 1.00f
 	};
 
-	// Set up vertex array objects
-	glGenVertexArrays(1, vao);
-	glBindVertexArray(vao[0]);
-
 	// Set up and bind the vertex positions to the vertex buffer object
-	glGenBuffers(numVBOs, vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+	glGenBuffers(1, &skyboxBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, skyboxBuffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertexPositions), cubeVertexPositions, GL_STATIC_DRAW);
 
+	// The cube's vertex array: positions only
+	glGenVertexArrays(1, &skyboxVertexArray);
+	glBindVertexArray(skyboxVertexArray);
+	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribBinding(0, 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexBuffer(0, skyboxBuffer, 0, 3 * sizeof(float));
+	glBindVertexArray(0);
+
 }
 
 void init(GLFWwindow* window) {
-	renderingProgram = createShaderProgram(vShaderFile, fShaderFile);
-	renderingProgramCubeMap = createShaderProgram(vShaderSkyFile, fShaderSkyFile);
+	// What to draw. Without it there is nothing to show
+	if (!Scene::load(scenePath, scene))
+		exit(EXIT_FAILURE);
+	for (size_t a = 0; a < scene.animations.size(); a++) {
+		Animation animate = NULL;
+		for (size_t i = 0; i < sizeof(animationTable) / sizeof(animationTable[0]); i++) {
+			if (scene.animations[a] == animationTable[i].name)
+				animate = animationTable[i].animate;
+		}
+		if (animate == NULL) {
+			std::cout << "error: " << scenePath << " uses animation " << scene.animations[a] << ", which doesn't exist" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		sceneAnimations.push_back(animate);
+	}
+	animationTransforms.resize(scene.animations.size());
+
+	// Static nodes keep their transform for good; animated ones get theirs every frame
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const SceneNode & node = scene.nodes[i];
+		sceneTransforms.addNode(node.parent, node.beforeAnimation * node.afterAnimation);
+		if (node.animation >= 0)
+			animatedNodes.push_back((int)i);
+	}
+
+	// The uniform blocks every program is checked against and bound to as it links
+	SceneUniforms::registerBlocks();
+	frameBlock.create(SceneUniforms::FRAME_BINDING);
+	materialBlocks.create(SceneUniforms::MATERIAL_BINDING);
+
+	// The programs needed for the first frame, submitted together so the driver can compile them side by side
+	int skyProgram = shaderCompiler.submit(ShaderSource(vShaderSkyFile), ShaderSource(fShaderSkyFile));
+	int impostorProgram = shaderCompiler.submit(ShaderSource(vShaderImpostorFile), ShaderSource(fShaderImpostorFile));
+	int impostorBakeProgram = shaderCompiler.submit(ShaderSource(vShaderImpostorBakeFile), ShaderSource(fShaderImpostorBakeFile));
+	int mixedProgram = objectProgram(0.5f, false).handle; // The mixed permutation, without #defines
+	shaderCompiler.finishAll();
+
+	renderingProgramCubeMap = shaderCompiler.getShaderProgram(skyProgram);
+	renderingProgramImpostor = shaderCompiler.getShaderProgram(impostorProgram);
+	renderingProgramImpostorBake = shaderCompiler.getShaderProgram(impostorBakeProgram);
+	renderingProgram = shaderCompiler.getShaderProgram(mixedProgram);
+	objectPrograms.setFallback(renderingProgram);
+	if (renderingProgramCubeMap == NULL || renderingProgramImpostor == NULL || renderingProgramImpostorBake == NULL || renderingProgram == NULL) {
+		std::cout << "error: the scene's shader programs could not be built" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Find every uniform the frame sets now, so a misspelled name stops the program before anything is drawn
+	objectUniforms = ObjectUniforms(*renderingProgram);
+	impostorUniforms = ImpostorUniforms(*renderingProgramImpostor);
+	bakeUniforms = VertexUniforms(*renderingProgramImpostorBake);
+	renderingProgram = NULL;
+
+	// The specialized object permutations the scene's nodes use (planes are normal mapped) compile in the background,
+	// drawn with the fallback until they are ready
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const SceneNode & node = scene.nodes[i];
+		if (node.mesh >= 0)
+			objectProgram(node.fac, scene.meshes[node.mesh].path.empty());
+	}
 
 	// Compute perspective (camera viewing angle) matrix
 	glfwGetFramebufferSize(window, &width, &height);
@@ -267,17 +670,190 @@ void init(GLFWwindow* window) {
 
 	// Box must happen first!
 	setupVerticesBox();
-	skyboxTexture = loadCubeMap(skyBoxPath);
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-	// There are 8 models, one defined here and 7 defined in obj files. Initialize them and their textures now
-	setupVerticesPlane(28, 1); // 1 because VBO[0] contains the skybox
-	for (int i = 0; i < 7; i++) {
-		objects.push_back(ImportedModel(meshPaths[i]));
-		setupVerticesObj(objects[i], (3 * i) + 4);
-		tex[i] = loadTexture(texPaths[i]);
+	// Everything below streams in on worker threads while the scene runs. Until an asset arrives the scene uses a
+	// stand-in: no sky, grey textures, a flat normal map, and nothing at all for meshes
+	materialLibrary.createPlaceholders();
+	GLuint flatNormalMap = createSolidTexture(128, 128, 255);
+
+	// Textures upload block compressed with mipmaps from their KTX2 copies, built on the first run
+	assetLoader.setTextureCompression(TextureCache::bestSupported());
+
+	// Materials OBJs can name without an MTL file
+	materialLibrary.addPreset("gold", goldAmbient(), goldDiffuse(), goldSpecular(), goldShininess());
+	materialLibrary.addPreset("bronze", bronzeAmbient(), bronzeDiffuse(), bronzeSpecular(), bronzeShininess());
+
+	// Every mesh's buffers up front, so large OBJs can stream straight into theirs
+	size_t numMeshes = scene.meshes.size();
+	objects.resize(numMeshes);
+	objectMaterials.resize(numMeshes);
+	impostors.resize(numMeshes);
+	normalMaps.assign(numMeshes, flatNormalMap);
+	vertexBuffers.resize(numMeshes);
+	indexBuffers.resize(numMeshes);
+	glGenBuffers((GLsizei)numMeshes, vertexBuffers.data());
+	glGenBuffers((GLsizei)numMeshes, indexBuffers.data());
+	vertexArrays.resize(numMeshes);
+	for (size_t i = 0; i < numMeshes; i++)
+		setupVertexArray((int)i, usePackedVertices && !scene.meshes[i].path.empty());
+
+	// Planes' textures and every mesh's fallback load as soon as possible; maps named by MTL files follow once their meshes arrive
+	int numObjs = 0;
+	for (size_t i = 0; i < numMeshes; i++) {
+		const SceneMesh & mesh = scene.meshes[i];
+		if (mesh.path.empty()) {
+			objectMaterials[i].push_back(materialLibrary.addTextured(mesh.name, mesh.texture));
+		}
+		else {
+			materialLibrary.addTexture(mesh.texture);
+			numObjs++;
+		}
+	}
+	requestTextures();
+
+	// The sky first, since it covers the whole screen
+	assetLoader.loadCubeMap(scene.skyPath.c_str(), [](GLuint texture) {
+		skyboxTexture = texture;
+	}, [](GLuint texture, const PrefilteredEnvironment & environment) {
+		environmentMap = texture;
+		for (int i = 0; i < 9; i++)
+			skyIrradiance[i] = glm::vec4(environment.irradiance[i][0], environment.irradiance[i][1], environment.irradiance[i][2], 0.0f);
+	});
+
+	// Planes are made here, with their normal maps to follow
+	for (size_t i = 0; i < numMeshes; i++) {
+		const SceneMesh & mesh = scene.meshes[i];
+		if (!mesh.path.empty())
+			continue;
+		setupVerticesPlane(mesh.planeSize, (int)i);
+		assetLoader.loadTexture(mesh.normalMap.c_str(), [i](GLuint texture) {
+			if (texture != 0)
+				normalMaps[i] = texture;
+		}, false);
 	}
+	std::cout << "Memory before loading meshes: " << toMegabytes(getCurrentResidentBytes()) << " MB (peak "
+		<< toMegabytes(getPeakResidentBytes()) << " MB)" << std::endl;
+
+	for (size_t n = 0; n < numMeshes; n++) {
+		const SceneMesh & mesh = scene.meshes[n];
+		if (mesh.path.empty())
+			continue;
+
+		int i = (int)n;
+		std::function<void(ImportedModel &)> meshReady = [i, numObjs](ImportedModel & model) {
+			const SceneMesh & mesh = scene.meshes[i];
+			objectMaterials[i] = materialLibrary.resolve(model, mesh.path.c_str(), mesh.texture);
+			requestTextures();
+			objects[i] = std::move(model);
+			bakeImpostorWhenReady(i);
+
+			if (++meshesLoaded == numObjs) {
+				std::cout << "Memory after loading meshes: " << toMegabytes(getCurrentResidentBytes()) << " MB (peak "
+					<< toMegabytes(getPeakResidentBytes()) << " MB)" << std::endl;
+			}
+		};
+
+		uint64_t fileBytes;
+		int64_t modified;
+		if (streamLargeMeshes && FileInfo::getSourceInfo(mesh.path.c_str(), fileBytes, modified) && fileBytes > streamingThresholdBytes) {
+			// Already in the VBO by the time meshReady runs
+			assetLoader.streamMesh(mesh.path.c_str(), vertexBuffers[i], usePackedVertices, meshReady);
+		}
+		else {
+			assetLoader.loadMesh(mesh.path.c_str(), [i, meshReady](ImportedModel & model) {
+				setupVerticesObj(model, i);
+				model.releaseCPUData(); // The GPU has its own copy now
+				meshReady(model);
+			});
+		}
+	}
+
+}
+
+// Draw a plane mesh, which is always plain floats and normal mapped
+void drawPlane(int mesh, const glm::mat4 & mvMatrix, const glm::mat4 & nrmMatrix, float fac) {
+	useObjectProgram(fac, true);
+	renderingProgram->set(objectUniforms.mvMatrix, mvMatrix);
+	renderingProgram->set(objectUniforms.nrmMatrix, nrmMatrix);
+	renderingProgram->set(objectUniforms.vertex.packedVertices, 0);
+
+	glState.bindVertexArray(vertexArrays[mesh]);
+
+	useMaterial(objectMaterials[mesh][0]);
+	glState.bindTexture(2, GL_TEXTURE_2D, normalMaps[mesh]);
 
+	glState.drawArrays(GL_TRIANGLES, 0, 6);
+	trianglesDrawn += 2;
+	fullDetailTriangles += 2;
+}
+
+// Draw the mesh of a scene node with its model-view and normal matrices: as its impostor when it is far enough away
+void drawNode(const SceneNode & node, const glm::mat4 & mvMatrix, const glm::mat4 & nrmMatrix) {
+	int mesh = node.mesh;
+	if (scene.meshes[mesh].path.empty()) {
+		drawPlane(mesh, mvMatrix, nrmMatrix, node.fac);
+		return;
+	}
+
+	ImportedModel & model = objects[mesh];
+	if (!model.isLoaded())
+		return;
+	if (beyondImpostorDistance(impostors[mesh], model, mvMatrix)) {
+		drawImpostor(impostors[mesh], model, mvMatrix, nrmMatrix, node.fac);
+		return;
+	}
+
+	useObjectProgram(node.fac, false);
+	renderingProgram->set(objectUniforms.mvMatrix, mvMatrix);
+	renderingProgram->set(objectUniforms.nrmMatrix, nrmMatrix);
+
+	// The mesh's vertex array has its vertex and index buffers
+	glState.bindVertexArray(vertexArrays[mesh]);
+	setObjUniforms(model, *renderingProgram, objectUniforms.vertex);
+
+	drawObj(mesh, mvMatrix);
+}
+
+// The Falcon comes in to land: it descends, flares and rolls out along z
+glm::mat4 animateFalconLanding(double currentTime) {
+	// Animate the z-rotation
+	rotation += rFactor;
+	if (abs(rotation) >= MAX_ROT) {
+		rFactor = 0.0f;
+	}
+
+	// Animate z-location
+	zPosFalcon += zPosDFFactor;
+
+	// Animate the y-location
+	altitude += aFactor;
+	if (altitude <= MIN_ALT) {
+		aFactor = 0.015f;
+		altitude += aFactor;
+		rFactor = -toRadians(0.1f);
+	}
+
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, altitude, zPosFalcon));
+	transform = glm::rotate(transform, toRadians(180.0f), yAxis);
+	return glm::rotate(transform, rotation, xAxis);
+}
+
+// The HiAce drives off along z after 20 seconds, and stops at MAX_ZPOS_HIACE
+glm::mat4 animateHiaceDrive(double currentTime) {
+	if ((float)currentTime >= 20.0f) {
+		zPosHiace += zPosHiaceFactor;
+	}
+
+	if (zPosHiace <= MAX_ZPOS_HIACE) {
+		zPosHiaceFactor = 0.0f;
+	}
+	return glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, zPosHiace));
+}
+
+// The radar dish turns about y
+glm::mat4 animateDishSpin(double currentTime) {
+	return glm::rotate(glm::mat4(1.0f), (float)currentTime * 2, yAxis);
 }
 
 void display(GLFWwindow* window, double currentTime) {
@@ -286,9 +862,11 @@ void display(GLFWwindow* window, double currentTime) {
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	// Reset counters
-	vboInd = 0;
-	texInd = 0;
-	objInd = 0;
+	trianglesDrawn = 0;
+	fullDetailTriangles = 0;
+
+	// Uploads and impostor bakes between frames use GL directly
+	glState.invalidate();
 
 	// Capture Mouse position
 	glfwGetCursorPos(window, &xpos, &ypos);
@@ -344,11 +922,7 @@ void display(GLFWwindow* window, double currentTime) {
 	}
 
 	/*************************************************   Draw the Skybox  ********************************************/
-	glUseProgram(renderingProgramCubeMap);
-
-	// Get pointers to the view and projection matrices
-	vLoc = glGetUniformLocation(renderingProgramCubeMap, "v_matrix");
-	projLoc = glGetUniformLocation(renderingProgramCubeMap, "proj_matrix");
+	glState.useProgram(renderingProgramCubeMap->getId());
 
 	// Build model matrix for the Skybox and position it at camera
 	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(cameraX, cameraY, cameraZ));
@@ -356,357 +930,94 @@ void display(GLFWwindow* window, double currentTime) {
 	// Compute view (camera position) matrix
 	vMat = glm::lookAt(position, position + direction, up);
 	vMat = glm::rotate(vMat, toRadians(120.0f), yAxis);
-	mvStack.push(vMat); // View matrix is at top of stack
 
-	// Bind the model-view matrix and projection matrix with the appropriate matrices in the vertex shader
-	glUniformMatrix4fv(vLoc, 1, GL_FALSE, glm::value_ptr(vMat));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(pMat));
+	// Everything the programs share this frame goes up in one buffer, and the materials in another
+	FrameUniforms & frame = frameBlock[0];
+	frame.projection = pMat;
+	frame.view = vMat;
+	frame.environment = glm::mat4(glm::transpose(glm::mat3(vMat)));
+	for (int i = 0; i < 9; i++)
+		frame.skyIrradiance[i] = skyIrradiance[i];
+	installLights(vMat);
+	frameBlock.upload();
+	frameBlock.bind(glState);
+	updateMaterialBlocks();
 
-	// Bind the cube to the vertex buffer (makes sure we draw the cube)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
+	// Bind the cube's vertex array (makes sure we draw the cube)
+	glState.bindVertexArray(skyboxVertexArray);
 
-	// Enable vertex attributes (position)
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
+	// Rough reflections read the prefiltered sky; until it is ready they all get the sharp one
+	glState.bindTexture(5, GL_TEXTURE_CUBE_MAP, (environmentMap != 0) ? environmentMap : skyboxTexture);
 
 	// Activate default skybox texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
+	glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, skyboxTexture);
 
 	// Enable backface culling 
-	glEnable(GL_CULL_FACE);
-	glFrontFace(GL_CCW);
+	glState.enable(GL_CULL_FACE);
+	glState.frontFace(GL_CCW);
 
 	// Set up 3D view
-	glDisable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	glState.disable(GL_DEPTH_TEST);
+	glState.depthFunc(GL_LEQUAL);
 
-	// Draw the box
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glEnable(GL_DEPTH_TEST);
+	// Draw the box (once its texture has streamed in)
+	if (skyboxTexture != 0)
+		glState.drawArrays(GL_TRIANGLES, 0, 36);
+	glState.enable(GL_DEPTH_TEST);
 
 	/*************************************************   Draw the Scene   **********************************************/
-	glUseProgram(renderingProgram);
-
-	// Get locations for uniform variables
-	mvLoc = glGetUniformLocation(renderingProgram, "mv_matrix");
-	projLoc = glGetUniformLocation(renderingProgram, "proj_matrix");
-	nLoc = glGetUniformLocation(renderingProgram, "nrm_matrix");
-	facLoc = glGetUniformLocation(renderingProgram, "fac");
-
-	/*************************************************   Ground   **********************************************/
-
-	// Build model-view matrix
-	mMat = glm::translate(glm::mat4(1.0f), origin);
-
-	mvStack.push(vMat);			// View matrix is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for plane is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	// Bind new values of uniform variables to their counterparts in the vertex/fragment shader
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(pMat));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.95f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
+	std::chrono::high_resolution_clock::time_point sceneStart = std::chrono::high_resolution_clock::now();
 
-	// Set textures
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
+	for (size_t a = 0; a < sceneAnimations.size(); a++)
+		animationTransforms[a] = sceneAnimations[a](currentTime);
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	mvStack.pop(); // Pop MV matrix -- View matrix is at top of stack
-
-	/***************************************************    Falcon   **********************************************/
-	// Animate the z-rotation
-	rotation += rFactor;
-	if (abs(rotation) >= MAX_ROT) {
-		rFactor = 0.0f;
-	}
-
-	// Animate z-location
-	zPosFalcon += zPosDFFactor;
-
-	// Animate the y-location
-	altitude += aFactor;
-	if (altitude <= MIN_ALT) {
-		aFactor = 0.015f;
-		altitude += aFactor;
-		rFactor = -toRadians(0.1f);
+	// Only the animated nodes and what hangs below them have new world transforms
+	for (size_t n = 0; n < animatedNodes.size(); n++) {
+		const SceneNode & node = scene.nodes[animatedNodes[n]];
+		sceneTransforms.setLocal(animatedNodes[n], node.beforeAnimation * animationTransforms[node.animation] * node.afterAnimation);
 	}
-
-	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, altitude, zPosFalcon));
-	mMat = glm::rotate(mMat, toRadians(180.0f), yAxis);
-	mMat = glm::rotate(mMat, rotation, xAxis);
-
-	mvStack.push(vMat);	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.8f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- View matrix is at top of stack
-
-	/***************************************************    Toyota HiAce   **********************************************/
-	// Animate z-location of HiAce
-	if ((float)currentTime >= 20.0f) {
-		zPosHiace += zPosHiaceFactor;
-	}
-
-	if (zPosHiace <= MAX_ZPOS_HIACE) {
-		zPosHiaceFactor = 0.0f;
+	transformsRecomputed = sceneTransforms.update();
+
+	// The view is a rotation and a translation, so its 3x3 is its own inverse transpose and carries world space normal
+	// matrices to view space as it is
+	glm::mat3 viewRotation = glm::mat3(vMat);
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const SceneNode & node = scene.nodes[i];
+		if (node.mesh < 0)
+			continue;
+		glm::mat4 mvMatrix;
+		TransformHierarchy::multiply(vMat, sceneTransforms.getWorld((int)i), mvMatrix);
+		drawNode(node, mvMatrix, glm::mat4(viewRotation * sceneTransforms.getNormalMatrix((int)i)));
 	}
-
-	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, 0.19f, zPosHiace));
-	mMat = glm::scale(mMat, glm::vec3(1.2f, 1.2f, 1.2f));
-
-	mvStack.push(vMat);	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.8f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- View matrix is at top of stack
-
-	/***************************************************    Terminal Building (Parent)  **********************************************/
-	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(-0.5f, 0.0f, 0.2f));
-	mvStack.push(vMat);	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	// Do not pop MV matrix so that terminal can act as parent for tower and dish
-
-	/***************************************************    Control Tower  **********************************************/
-	mMat = glm::translate(glm::mat4(1.0f), origin);
-	mvStack.push(mvStack.top());	// MV matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- MV matrix is at top of stack
-
-	/***************************************************    Tower window   **********************************************/
-	mMat = glm::translate(glm::mat4(1.0f), origin);
-	mvStack.push(mvStack.top());	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.0f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	// Do not increment texInd because this object has no texture
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- MV matrix is at top of stack
-
-	/***************************************************    Tower roof   **********************************************/
-	mMat = glm::translate(glm::mat4(1.0f), origin);
-	mvStack.push(mvStack.top());	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- MV matrix is at top of stack
-
-	/***************************************************    Dish   **********************************************/
-	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(-12.85f, 3.51f, 1.51f));
-	mMat = glm::rotate(mMat, (float)currentTime * 2, yAxis);
-
-	mvStack.push(mvStack.top());	// View matrix copy is at top of stack
-	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
-	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
-
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
-
-	// Set vertex attributes (Position, Tex, NRM)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(2);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, tex[texInd++]);
-
-	glDrawArrays(GL_TRIANGLES, 0, objects[objInd++].getNumVertices());
-	mvStack.pop(); // Pop MV matrix -- MV matrix is at top of stack
+	sceneMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sceneStart).count();
 
 	/***************************************************    Finishing Up   **********************************************/
 
-	// Pop MV matrix -- View matrix is at top of stack
-	mvStack.pop();
-	// Pop view matrix and we are done
-	mvStack.pop();
+	// Report the savings from the levels of detail, and what the frame cost in GL calls, every couple of seconds
+	GLStateCounters calls = glState.endFrame();
+	if (currentTime - lastTriangleReport >= 2.0) {
+		std::cout << "Triangles drawn: " << trianglesDrawn << " (" << fullDetailTriangles << " at full detail)" << std::endl;
+		std::cout << "Scene: " << scene.nodes.size() << " nodes (" << transformsRecomputed << " transforms recomputed) in "
+			<< sceneMilliseconds << " ms of CPU ("
+			<< sceneMilliseconds * 1000.0 / glm::max((double)scene.nodes.size(), 1.0) << " us per node)" << std::endl;
+		std::cout << "GL calls: " << calls.drawCalls << " draws, " << calls.stateChanges << " state changes (" << calls.bufferBinds
+			<< " buffer binds, " << calls.textureBinds << " texture binds, " << calls.programBinds << " program binds), "
+			<< calls.redundantCalls << " redundant calls skipped; uniforms and uploads not counted" << std::endl;
+		lastTriangleReport = currentTime;
+	}
 }
 
 void installLights(glm::mat4 vMatrix) {
-	// convert light's position to view space and save it in a float array
+	// convert light's position to view space
 	lightPosV = glm::vec3(vMatrix * glm::vec4(currentLightPos, 1.0));
-	lightPos[0] = lightPosV.x;
-	lightPos[1] = lightPosV.y;
-	lightPos[2] = lightPosV.z;
-
-	// Get locations of light and material fields in shader
-	globalAmbLoc = glGetUniformLocation(renderingProgram, "globalAmbient");
-	ambLoc = glGetUniformLocation(renderingProgram, "light.ambient");
-	diffLoc = glGetUniformLocation(renderingProgram, "light.diffuse");
-	specLoc = glGetUniformLocation(renderingProgram, "ligh.specular");
-	posLoc = glGetUniformLocation(renderingProgram, "light.position");
-
-	mAmbLoc = glGetUniformLocation(renderingProgram, "material.ambient");
-	mDiffLoc = glGetUniformLocation(renderingProgram, "material.diffuse");
-	mSpecLoc = glGetUniformLocation(renderingProgram, "material.specular");
-	mShiLoc = glGetUniformLocation(renderingProgram, "material.shininess");
-
-	// Set the uniform light and material values in shader
-	glProgramUniform4fv(renderingProgram, globalAmbLoc, 1, globalAmbient);
-	glProgramUniform4fv(renderingProgram, ambLoc, 1, lightAmbient);
-	glProgramUniform4fv(renderingProgram, diffLoc, 1, lightDiffuse);
-	glProgramUniform4fv(renderingProgram, specLoc, 1, lightSpecular);
-
-	glProgramUniform3fv(renderingProgram, posLoc, 1, lightPos);
-
-	glProgramUniform4fv(renderingProgram, mAmbLoc, 1, matAmb);
-	glProgramUniform4fv(renderingProgram, mDiffLoc, 1, matDif);
-	glProgramUniform4fv(renderingProgram, mSpecLoc, 1, matSpec);
-
-	glProgramUniform1f(renderingProgram, mShiLoc, matShi);
 
+	// Light fields of the frame's uniform block, sent with the rest of it
+	FrameUniforms & frame = frameBlock[0];
+	frame.globalAmbient = glm::make_vec4(globalAmbient);
+	frame.light.ambient = glm::make_vec4(lightAmbient);
+	frame.light.diffuse = glm::make_vec4(lightDiffuse);
+	frame.light.specular = glm::make_vec4(lightSpecular);
+	frame.light.position = lightPosV;
 }
 
 // Reset perspective matrix when window is resized
@@ -721,6 +1032,7 @@ void window_resize_callback(GLFWwindow* win, int newWidth, int newHeight) {
 }
 
 int main(void) {
+	programStart = std::chrono::high_resolution_clock::now();
 	std::cout << "Hello" << std::endl;
 	// Initialize GLFW
 	if (!glfwInit())
@@ -751,11 +1063,23 @@ int main(void) {
 
 	// Main event loop
 	while (!glfwWindowShouldClose(window)) {
+		// Upload whatever the loader's workers have finished since the last frame
+		assetLoader.uploadFinished(uploadBudgetMilliseconds);
+
+		// Swap in shader permutations that have finished compiling
+		shaderCompiler.poll();
+
 		// While user is ok with it, run display function
 		if (keepFixed)
 			display(window, glfwGetTime());
 
 		glfwSwapBuffers(window);		// "Paint" the window, ensure vsync is active
+
+		if (!firstFrameDrawn) {
+			firstFrameDrawn = true;
+			std::cout << "Time to first frame: " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - programStart).count()
+				<< " ms (" << assetLoader.getNumPending() << " assets still streaming)" << std::endl;
+		}
 		glfwPollEvents();				// Log user input, keystrokes, etc.
 
 		// If user hits "Escape," they want to leave the window, so stop running display and show the cursor
@@ -16,8 +16,12 @@
 #include <stack>
 #include "Utils_PR.h"
 #include "ImportedModel.h"
+#include "EnvironmentMap.h"
+#include "SceneUniforms.h"
+#include "ShaderPermutations.h"
+#include "UniformBuffer.h"
 
-// Number of Vertex Array Objects and Vertex Buffer Objects (P, T, N for Falcon; P, T for plane; P only for skybox)
+// Number of Vertex Array Objects and Vertex Buffer Objects (P, T, N for each of the 7 OBJs from vbo[4]; P, T for plane; P only for skybox)
 #define numVAOs 1
 #define numVBOs 25
 
@@ -60,17 +64,41 @@ float cameraX, cameraY, cameraZ;
 bool keepFixed = 1;
 
 // Important variables
-GLuint renderingProgram, renderingProgramCubeMap;
+const ShaderProgram * renderingProgram;
+const ShaderProgram * renderingProgramCubeMap;
+
+// The lit object program with the flashlight on and off (NO_FLASHLIGHT). Both are built at startup, the second in the
+// background (the first is drawn with until it's ready)
+ShaderCompiler shaderCompiler;
+ShaderPermutations litPrograms(shaderCompiler);
+
+// Uniforms set for each object drawn, found again whenever renderingProgram changes
+struct ObjectUniforms {
+	Uniform<glm::mat4> mvMatrix, nrmMatrix;
+	Uniform<float> fac;
+	Uniform<int> packedVertices;
+
+	ObjectUniforms() {}
+	explicit ObjectUniforms(const ShaderProgram & program) : mvMatrix(program.uniform<glm::mat4>("mv_matrix")),
+		nrmMatrix(program.uniform<glm::mat4>("nrm_matrix")), fac(program.uniform<float>("fac")),
+		packedVertices(program.uniform<int>("packedVertices")) {}
+};
+
+ObjectUniforms objectUniforms;
+
+// What every program shares for a frame, and the one material everything is drawn with (gold)
+UniformBuffer<FrameUniforms> frameBlock;
+UniformBuffer<MaterialUniforms> materialBlock;
 GLuint vao[numVAOs];
 GLuint vbo[numVBOs];
 
 // Declare variables used in display function to save resources
 std::stack<glm::mat4> mvStack;
 
-GLuint mvLoc, projLoc, vLoc, nLoc;
-GLuint skyboxTexture, facLoc;
-GLuint tex[3];
-GLuint globalAmbLoc, ambLoc, diffLoc, specLoc, posLoc, mAmbLoc, mDiffLoc, mSpecLoc, mShiLoc, dirLoc, cutoffLoc, isOnLoc;
+GLuint skyboxTexture;
+GLuint environmentMap; // The sky prefiltered for rough reflections (0 if it couldn't be made)
+glm::vec4 skyIrradiance[9]; // Light from the sky as spherical harmonics, for the ambient term
+GLuint tex[7]; // One per OBJ (texPaths)
 glm::mat4 pMat, vMat, mMat, mvMat, invTrMat;
 
 int vboInd, texInd, objInd;
@@ -80,7 +108,6 @@ float aspect;
 //Lights
 void installLights(glm::mat4 vMatrix);
 glm::vec3 currentLightPos, lightPosV, currentLightDir;
-float lightPos[3], lightDir[3];
 float lightCutoff = toRadians(12.5f);
 
 glm::vec3 initialLightLoc = glm::vec3(5.0f, -2.0f, 2.0f);
@@ -254,9 +281,42 @@ void setupVerticesBox(void) {
 
 }
 
+// The "lit" sections of the object shaders, with or without the flashlight
+const ShaderProgram * litProgram() {
+	std::vector<std::string> defines;
+	if (isOn < 0.0f)
+		defines.push_back("NO_FLASHLIGHT");
+	return litPrograms.get(ShaderSource(vShaderFile, "lit"), ShaderSource(fShaderFile, "lit", defines));
+}
+
 void init(GLFWwindow* window) {
-	renderingProgram = createShaderProgram(vShaderFile, fShaderFile);
-	renderingProgramCubeMap = createShaderProgram(vShaderSkyFile, fShaderSkyFile);
+	SceneUniforms::registerBlocks();
+	frameBlock.create(SceneUniforms::FRAME_BINDING);
+	materialBlock.create(SceneUniforms::MATERIAL_BINDING);
+
+	int skyProgram = shaderCompiler.submit(ShaderSource(vShaderSkyFile), ShaderSource(fShaderSkyFile));
+	renderingProgram = litPrograms.get(ShaderSource(vShaderFile, "lit"), ShaderSource(fShaderFile, "lit"), true);
+	litPrograms.setFallback(renderingProgram);
+	litPrograms.request(ShaderSource(vShaderFile, "lit"), ShaderSource(fShaderFile, "lit", std::vector<std::string>(1, "NO_FLASHLIGHT")));
+	shaderCompiler.finish(skyProgram);
+	renderingProgramCubeMap = shaderCompiler.getShaderProgram(skyProgram);
+	if (renderingProgram == NULL || renderingProgramCubeMap == NULL) {
+		std::cout << "error: the scene's shader programs could not be built" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	objectUniforms = ObjectUniforms(*renderingProgram);
+
+	// Gold, without a diffuse map tint or blurred reflections
+	MaterialUniforms & material = materialBlock[0];
+	material.ambient = glm::make_vec4(matAmb);
+	material.diffuse = glm::make_vec4(matDif);
+	material.specular = glm::make_vec4(matSpec);
+	material.shininess = matShi;
+	material.baseColor = glm::vec4(1.0f);
+	material.roughness = 0.0f;
+	material.texLayer = 0;
+	materialBlock.upload();
+	materialBlock.bind();
 
 	// Compute perspective (camera viewing angle) matrix
 	glfwGetFramebufferSize(window, &width, &height);
@@ -272,12 +332,18 @@ void init(GLFWwindow* window) {
 	// Box must happen first!
 	setupVerticesBox();
 	skyboxTexture = loadCubeMap(skyBoxPath);
+	std::shared_ptr<PrefilteredEnvironment> environment = EnvironmentMap::load(skyBoxPath);
+	if (environment) {
+		environmentMap = EnvironmentMap::upload(*environment);
+		for (int i = 0; i < 9; i++)
+			skyIrradiance[i] = glm::vec4(environment->irradiance[i][0], environment->irradiance[i][1], environment->irradiance[i][2], 0.0f);
+	}
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 	
 	// There are 8 models, one defined here and 7 defined in obj files. Initialize them and their textures now
 	setupVerticesPlane(28, 1); // 1 because VBO[0] contains the skybox
 	for (int i = 0; i < 7; i++) {
-		objects.push_back( ImportedModel(meshPaths[i]) );
+		objects.push_back( ImportedModel(meshPaths[i], false) ); // This variant draws with glDrawArrays
 		setupVerticesObj(objects[i], (3 * i) + 4);
 		tex[i] = loadTexture(texPaths[i]);
 	}
@@ -353,14 +419,9 @@ void display(GLFWwindow* window, double currentTime) {
 	else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE && isPressed) {
 		isPressed = 0;
 	}
-	glUniform1f(isOnLoc, isOn);
 
 	/*************************************************   Draw the Skybox  ********************************************/
-	glUseProgram(renderingProgramCubeMap);
-
-	// Get pointers to the view and projection matrices
-	vLoc = glGetUniformLocation(renderingProgramCubeMap, "v_matrix");
-	projLoc = glGetUniformLocation(renderingProgramCubeMap, "proj_matrix");
+	glUseProgram(renderingProgramCubeMap->getId());
 
 	// Build model matrix for the Skybox and position it at camera
 	mMat = glm::translate(glm::mat4(1.0f), glm::vec3(cameraX, cameraY, cameraZ));
@@ -370,9 +431,12 @@ void display(GLFWwindow* window, double currentTime) {
 	vMat = glm::rotate(vMat, toRadians(120.0f), yAxis);
 	mvStack.push(vMat); // View matrix is at top of stack
 
-	// Bind the model-view matrix and projection matrix with the appropriate matrices in the vertex shader
-	glUniformMatrix4fv(vLoc, 1, GL_FALSE, glm::value_ptr(vMat));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(pMat));
+	// Everything the programs share this frame goes up in one buffer: the matrices and the flashlight, which is at the camera
+	frameBlock[0].projection = pMat;
+	frameBlock[0].view = vMat;
+	currentLightPos = glm::vec3(position.x, position.y, position.z);
+	currentLightDir = glm::vec3((position + direction).x, (position + direction).y, (position + direction).z);
+	installLights(vMat);
 
 	// Bind the cube to the vertex buffer (makes sure we draw the cube)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -381,6 +445,10 @@ void display(GLFWwindow* window, double currentTime) {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(0);
 
+	// Reflections read the prefiltered sky (the sharp one if it couldn't be made)
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, (environmentMap != 0) ? environmentMap : skyboxTexture);
+
 	// Activate default skybox texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
@@ -398,22 +466,20 @@ void display(GLFWwindow* window, double currentTime) {
 	glEnable(GL_DEPTH_TEST);
 
 	/*************************************************   Draw the Scene   **********************************************/
-	glUseProgram(renderingProgram);
-
-	// Get locations for uniform variables
-	mvLoc = glGetUniformLocation(renderingProgram, "mv_matrix");
-	projLoc = glGetUniformLocation(renderingProgram, "proj_matrix");
-	nLoc = glGetUniformLocation(renderingProgram, "nrm_matrix");
-	facLoc = glGetUniformLocation(renderingProgram, "fac");
-	isOnLoc = glGetUniformLocation(renderingProgram, "isOn");
+	// The flashlight is compiled in or out rather than switched per fragment
+	shaderCompiler.poll();
+	const ShaderProgram * program = litProgram();
+	if (program != renderingProgram) {
+		renderingProgram = program;
+		objectUniforms = ObjectUniforms(*renderingProgram);
+	}
+	glUseProgram(renderingProgram->getId());
+	renderingProgram->set(objectUniforms.packedVertices, 0); // These models are always plain floats
 
 	//std::cout << position.x << ", " << position.y << ", " << position.z << std::endl;
 	//std::cout << direction.x << ", " << direction.y << ", " << direction.z << std::endl;
 
-	currentLightPos = glm::vec3(position.x, position.y, position.z);
-	currentLightDir = glm::vec3((position + direction).x, (position + direction).y, (position + direction).z);
 	//std::cout << currentLightPos.x << ", " << currentLightPos.y << ", " << currentLightPos.z << std::endl;
-	installLights(mvStack.top()); // View matrix is at top of stack
 
 	/*************************************************   Ground   **********************************************/
 
@@ -425,10 +491,9 @@ void display(GLFWwindow* window, double currentTime) {
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
 	// Bind new values of uniform variables to their counterparts in the vertex/fragment shader
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(pMat));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.95f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.95f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -477,9 +542,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.8f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.8f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -518,9 +583,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.8f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.8f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -548,9 +613,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.9f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -577,9 +642,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.9f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -606,9 +671,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.0f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.0f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -636,9 +701,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.9f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -667,9 +732,9 @@ void display(GLFWwindow* window, double currentTime) {
 	mvStack.top() *= mMat;		// MV matrix for obj is at top of stack
 	invTrMat = glm::transpose(glm::inverse(mvStack.top()));
 
-	glUniformMatrix4fv(mvLoc, 1, GL_FALSE, glm::value_ptr(mvStack.top()));
-	glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-	glUniform1f(facLoc, 0.9f);
+	renderingProgram->set(objectUniforms.mvMatrix, mvStack.top());
+	renderingProgram->set(objectUniforms.nrmMatrix, invTrMat);
+	renderingProgram->set(objectUniforms.fac, 0.9f);
 
 	// Set vertex attributes (Position, Tex, NRM)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo[vboInd++]);
@@ -699,44 +764,26 @@ void display(GLFWwindow* window, double currentTime) {
 }
 
 void installLights(glm::mat4 vMatrix) {
-	// convert light's position to view space and save it in a float array (Results in poor setup)
+	// convert light's position to view space (Results in poor setup), so it stays in world space
 	//lightPosV = glm::vec3(vMatrix * glm::vec4(currentLightPos, 1.0));
-	lightPos[0] = currentLightPos.x;
-	lightPos[1] = currentLightPos.y;
-	lightPos[2] = currentLightPos.z;
-
-	lightDir[0] = currentLightDir.x;
-	lightDir[1] = currentLightDir.y;
-	lightDir[2] = currentLightDir.z;
-
-	// Get locations of light and material fields in shader
-	globalAmbLoc = glGetUniformLocation(renderingProgram, "globalAmbient");
-	ambLoc = glGetUniformLocation(renderingProgram, "light.ambient");
-	diffLoc = glGetUniformLocation(renderingProgram, "light.diffuse");
-	specLoc = glGetUniformLocation(renderingProgram, "ligh.specular");
-	posLoc = glGetUniformLocation(renderingProgram, "light.position");
-
-	mAmbLoc = glGetUniformLocation(renderingProgram, "material.ambient");
-	mDiffLoc = glGetUniformLocation(renderingProgram, "material.diffuse");
-	mSpecLoc = glGetUniformLocation(renderingProgram, "material.specular");
-	mShiLoc = glGetUniformLocation(renderingProgram, "material.shininess");
-
-	// Set the uniform light and material values in shader
-	glProgramUniform4fv(renderingProgram, globalAmbLoc, 1, globalAmbient);
-	glProgramUniform4fv(renderingProgram, ambLoc, 1, lightAmbient);
-	glProgramUniform4fv(renderingProgram, diffLoc, 1, lightDiffuse);
-	glProgramUniform4fv(renderingProgram, specLoc, 1, lightSpecular);
-
-	glProgramUniform3fv(renderingProgram, posLoc, 1, lightPos);
-	glProgramUniform3fv(renderingProgram, dirLoc, 1, lightDir);
-	glProgramUniform1f(renderingProgram, cutoffLoc, lightCutoff);
-
-	glProgramUniform4fv(renderingProgram, mAmbLoc, 1, matAmb);
-	glProgramUniform4fv(renderingProgram, mDiffLoc, 1, matDif);
-	glProgramUniform4fv(renderingProgram, mSpecLoc, 1, matSpec);
-
-	glProgramUniform1f(renderingProgram, mShiLoc, matShi);
 
+	// Set the light fields of the frame's uniform block
+	FrameUniforms & frame = frameBlock[0];
+	frame.globalAmbient = glm::make_vec4(globalAmbient);
+	frame.light.ambient = glm::make_vec4(lightAmbient);
+	frame.light.diffuse = glm::make_vec4(lightDiffuse);
+	frame.light.specular = glm::make_vec4(lightSpecular);
+	frame.light.position = currentLightPos;
+	frame.light.direction = currentLightDir;
+	frame.light.cutoff = lightCutoff;
+
+	// The sky lights the scene in world space, so normals are turned back from view space
+	for (int i = 0; i < 9; i++)
+		frame.skyIrradiance[i] = skyIrradiance[i];
+	frame.environment = glm::mat4(glm::transpose(glm::mat3(vMatrix)));
+
+	frameBlock.upload();
+	frameBlock.bind();
 }
 
 // Reset perspective matrix when window is resized